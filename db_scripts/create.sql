@@ -27,6 +27,7 @@ create table plan(
     queue_name      varchar(255) default null,  -- queue name
     amd_mode        int default 0,              -- AMD mode
     service_level   int unsigned default 0,     -- service level. determine how many calls can going out campare to available agents. 
+    originate_backend   int default 0,          -- originate backend(0:ami, 1:core)
     
     -- retry number
     max_retry_cnt_1     int default 5,  -- max retry count for dial number 1
@@ -111,6 +112,10 @@ create table dl_list(
     trycnt_7    int default 0,      -- try count for tel number 7
     trycnt_8    int default 0,      -- try count for tel number 8
 
+    -- dial key. maintained on every insert and update.
+    trycnt_total    int default 0,  -- sum of the try counts.
+    eligible        int default 1,  -- 0:no more dial, 1:dial-able(has any number and not answered). the retry counts are checked by the plan.
+
     -- result info
     res_dial            int default 0 not null,   -- last dial result.(no answer, answer, busy, ...)
     res_dial_detail     text,
@@ -123,7 +128,9 @@ create table dl_list(
     tm_update       datetime(6),   -- last update time
     tm_last_dial    datetime(6),   -- last tried dial time
     
-    primary key(uuid)
+    primary key(uuid),
+    index idx_dl_list_dial(dlma_uuid, status, eligible, trycnt_total),    -- next dial-able dl_list seek.
+    index idx_dl_list_dlma(dlma_uuid, in_use)                             -- dl_list count by dlma.
 );
 
 -- CREATE TRIGGER init_uuid BEFORE INSERT ON dl_list
@@ -173,6 +180,10 @@ create table campaign(
     dlma    varchar(255),                       -- dial_list_ma uuid
 --    trunk_group varchar(255),                       -- trunk group uuid -- will be removed.
 
+    -- dialing schedule
+    weight      int             default 1,      -- dialing turns in a round among the started campaigns.
+    priority    int             default 0,      -- higher priority campaign takes turns first.
+
     -- timestamp. UTC.
     tm_create           datetime(6),   -- create time.
     tm_delete           datetime(6),   -- delete time.
@@ -0,0 +1,15 @@
+-- upgrade.sql
+-- Adds the columns of the newer versions to the existing database.
+-- The sqlite3 database is upgraded by the module on load(g_db_sql_upgrade_columns). This is for the databases made by create.sql.
+
+-- campaign dialing schedule
+alter table campaign add column weight      int default 1;  -- dialing turns in a round among the started campaigns.
+alter table campaign add column priority    int default 0;  -- higher priority campaign takes turns first.
+
+-- dl_list dial key
+alter table dl_list add column trycnt_total int default 0;  -- sum of the try counts.
+alter table dl_list add column eligible     int default 1;  -- 0:no more dial, 1:dial-able.
+update dl_list set trycnt_total = (trycnt_1 + trycnt_2 + trycnt_3 + trycnt_4 + trycnt_5 + trycnt_6 + trycnt_7 + trycnt_8);
+update dl_list set eligible = 0 where res_dial = 4;  -- 4:answer
+create index idx_dl_list_dial on dl_list(dlma_uuid, status, eligible, trycnt_total);
+create index idx_dl_list_dlma on dl_list(dlma_uuid, in_use);
@@ -10,25 +10,126 @@
 #include "asterisk/utils.h"
 #include "asterisk/manager.h"
 #include "asterisk/json.h"
+#include "asterisk/strings.h"
+#include "asterisk/causes.h"
+#include "asterisk/frame.h"
+#include "asterisk/channelstate.h"
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <sched.h>
 
+#include "res_outbound.h"
+#include "ami_handler.h"
 #include "dialing_handler.h"
 #include "event_handler.h"
 #include "utils.h"
+#include "stasis_handler.h"
+#include "destination_handler.h"
+
+#define DEF_AMI_EVT_HEADER_MAX		128		///< max header count of the event view.
+#define DEF_AMI_EVT_KEY_LEN			128
+#define DEF_AMI_EVT_VALUE_LEN		4096
+#define DEF_AMI_EVT_UNIQUEID_LEN	256
+#define DEF_AMI_EVT_NAME_LEN		64
+#define DEF_AMI_EVT_SLOT_LEN		8192	///< max event size in the ring. bigger one is dropped.
+#define DEF_AMI_CMD_LEN				512		///< initial size of the action. grows.
+#define DEF_AMI_CMD_RES_LEN			1024	///< initial size of the action response. grows.
+
+#define DEF_AMI_EVT_TABLE_SIZE		32		///< event table size. See ami_evt_hash().
+#define DEF_AMI_EVT_HIST_SIZE		6		///< handler time histogram. <10us, <100us, <1ms, <10ms, <100ms, >=100ms
+
+#define DEF_AMI_EVT_FLAG_CHANNEL	0x01	///< event of the outbound channel. Needs the Uniqueid of the dialing.
+#define DEF_AMI_EVT_FLAG_ACTION		0x02	///< response event of the outbound action. Needs the ActionID of the dialing.
+#define DEF_AMI_EVT_FLAG_MANAGER	0x04	///< manager only event. No stasis message. Taken from the manager hook with any event source.
+
+#define DEF_AMI_EVT_QUEUE_SIZE		"1024"
+#define DEF_AMI_EVT_QUEUE_POLICY	"drop"
+#define DEF_AMI_EVT_QUEUE_WAIT		"10"
+#define DEF_AMI_EVT_SOURCE			"manager"
+
+typedef enum _E_AMI_EVT_POLICY_T
+{
+	E_AMI_EVT_POLICY_DROP	= 0,	///< drop the event when the ring is full.
+	E_AMI_EVT_POLICY_WAIT,			///< wait for a free slot for ami_evt_queue_wait(ms), then drop.
+} E_AMI_EVT_POLICY_T;
 
+typedef enum _E_AMI_EVT_SOURCE_T
+{
+	E_AMI_EVT_SOURCE_MANAGER	= 0,	///< manager hook. every manager event text is checked.
+	E_AMI_EVT_SOURCE_STASIS,			///< stasis subscription. typed snapshots. See stasis_handler.c.
+} E_AMI_EVT_SOURCE_T;
 
-static char* g_cmd_buf = NULL;  //!< action cmd buffer
-struct manager_custom_hook* g_hook_evt;
+/**
+ * Slot of the event ring.
+ * seq is the ticket of the slot. See ami_evt_ring_push/pop.
+ */
+struct ami_evt_slot {
+	uint64_t seq;
+	size_t len;
+	int idx;	///< index of the event table
+	struct ast_json* j_evt;	///< typed event(stasis). the content is empty and not parsed if set.
+	char event[DEF_AMI_EVT_NAME_LEN];
+	char content[DEF_AMI_EVT_SLOT_LEN];
+};
 
-static int ami_evt_handler(void);
-static int ami_cmd_helper(int category, const char *event, char *content);
-static int ami_evt_helper(int category, const char *event, char *content);
-static struct ast_json* parse_ami_msg(char* msg);
-static void trim(char * s);
-static void lower_string(char s[]);
+/**
+ * Bounded lock-free event ring.
+ * Multi producers(manager event dispatch), single consumer(event worker).
+ * The size is the power of 2.
+ */
+struct ami_evt_ring {
+	struct ami_evt_slot* slots;
+	uint64_t mask;
+	uint64_t head;		///< next push ticket
+	uint64_t tail;		///< next pop ticket
+
+	// stats
+	uint64_t cnt_pushed;
+	uint64_t cnt_processed;
+	uint64_t cnt_dropped_full;
+	uint64_t cnt_dropped_oversize;
+	uint64_t cnt_waited;
+	uint64_t high_water;
+};
+
+/**
+ * Header view of the ami event.
+ * Points into the event content. Not null terminated.
+ */
+struct ami_evt_header {
+	const char* key;
+	size_t key_len;
+	const char* value;
+	size_t value_len;
+};
+
+/**
+ * Stack allocated header view of the ami event.
+ */
+struct ami_evt_view {
+	struct ami_evt_header headers[DEF_AMI_EVT_HEADER_MAX];
+	int count;
+};
+
+/**
+ * Event table entry.
+ * The stats are updated by the event worker only.
+ */
+struct ami_evt_entry {
+	const char* name;
+	size_t len;
+	int flags;									///< DEF_AMI_EVT_FLAG_XXX
+	bool (*prefilter)(const char* content);		///< drops the event in the hook if returns false. optional.
+	ami_evt_handler_t handler;					///< NULL if not registered. The event is dropped in the hook.
+
+	// stats
+	uint64_t cnt;
+	uint64_t tm_total;		///< handling time(us)
+	uint64_t tm_max;		///< max handling time(us)
+	uint64_t hist[DEF_AMI_EVT_HIST_SIZE];
+};
 
-void ami_evt_process(struct ast_json* j_evt);
 static void ami_evt_Newchannel(struct ast_json* j_evt);
 static void ami_evt_Newexten(struct ast_json* j_evt);
 static void ami_evt_Newstate(struct ast_json* j_evt);
@@ -41,16 +142,107 @@ static void ami_evt_AgentComplete(struct ast_json* j_evt);
 static void ami_evt_DialBegin(struct ast_json* j_evt);
 static void ami_evt_DialEnd(struct ast_json* j_evt);
 static void ami_evt_Hangup(struct ast_json* j_evt);
+static int ami_evt_hangup_cause_to_res_dial(int cause);
+static void ami_evt_BridgeEnter(struct ast_json* j_evt);
+static void ami_evt_VarSet(struct ast_json* j_evt);
+static bool ami_evt_prefilter_VarSet(const char* content);
+
+/**
+ * Event table.
+ * Indexed by the perfect hash of the event name. See ami_evt_hash().
+ * The slots are generated for the names below. A new event name needs a new hash parameter
+ * if it collides. init_ami_handle() checks the table.
+ * Handlers of the events without the handler here can be registered by ami_evt_register_handler().
+ */
+static struct ami_evt_entry g_ami_evt_table[DEF_AMI_EVT_TABLE_SIZE] = {
+	[23] = {"Newchannel",			10, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_Newchannel},
+	[28] = {"Newexten",				 8, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_Newexten},
+	[ 3] = {"Newstate",				 8, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_Newstate},
+	[14] = {"QueueCallerJoin",		15, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_QueueCallerJoin},
+	[ 2] = {"QueueCallerLeave",		16, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_QueueCallerLeave},
+	[12] = {"OriginateResponse",	17, DEF_AMI_EVT_FLAG_ACTION | DEF_AMI_EVT_FLAG_MANAGER,	NULL,	ami_evt_OriginateResponse},
+	[ 5] = {"AgentCalled",			11, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_AgentCalled},
+	[26] = {"AgentConnect",			12, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_AgentConnect},
+	[16] = {"AgentComplete",		13, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_AgentComplete},
+	[25] = {"DialBegin",			 9, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_DialBegin},
+	[19] = {"DialEnd",				 7, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_DialEnd},
+	[11] = {"Hangup",				 6, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_Hangup},
+	[ 6] = {"BridgeEnter",			11, DEF_AMI_EVT_FLAG_CHANNEL,	NULL,	ami_evt_BridgeEnter},
+	[ 9] = {"VarSet",				 6, DEF_AMI_EVT_FLAG_CHANNEL,	ami_evt_prefilter_VarSet,	ami_evt_VarSet},
+
+	// queue member events. no channel.
+	[27] = {"QueueMemberStatus",	17, 0,	NULL,	NULL},
+	[15] = {"QueueMemberAdded",		16, 0,	NULL,	NULL},
+	[18] = {"QueueMemberRemoved",	18, 0,	NULL,	NULL},
+	[20] = {"QueueMemberPause",		16, 0,	NULL,	NULL},
+};
+
+/**
+ * Response context of the ami action.
+ */
+struct ami_cmd_ctx {
+	struct ast_str* res;	///< response
+};
+
+static __thread struct ami_cmd_ctx* g_ami_cmd_ctx = NULL;  ///< response context of the calling thread's action.
+struct manager_custom_hook* g_hook_evt;
+
+// event worker
+static struct ami_evt_ring g_ami_evt_ring;
+static E_AMI_EVT_POLICY_T g_ami_evt_policy = E_AMI_EVT_POLICY_DROP;
+static int g_ami_evt_wait = 0;		///< ami_evt_queue_wait(ms).
+static E_AMI_EVT_SOURCE_T g_ami_evt_source = E_AMI_EVT_SOURCE_MANAGER;	///< ami_evt_source
+AST_MUTEX_DEFINE_STATIC(g_ami_evt_mutex);
+static ast_cond_t g_ami_evt_cond;
+static pthread_t g_ami_evt_thread = AST_PTHREADT_NULL;
+static int g_ami_evt_stop = 0;
+static int g_ami_evt_sleeping = 0;	///< worker is waiting on the cond.
+
+static int ami_evt_handler(void);
+static int ami_cmd_helper(int category, const char *event, char *content);
+static int ami_evt_helper(int category, const char *event, char *content);
+static struct ast_json* parse_ami_msg(const char* msg);
+static void ami_cmd_append_header(struct ast_str** cmd, const char* key, struct ast_json* j_val);
+static const char* ami_evt_scan_header(const char* content, const char* key, size_t* len);
+static unsigned int ami_evt_hash(const char* event, size_t len);
+static struct ami_evt_entry* ami_evt_lookup(const char* event, size_t len);
+static bool ami_evt_check_table(void);
+static void ami_evt_dispatch(struct ami_evt_entry* entry, struct ast_json* j_evt);
+static bool ami_evt_parse_view(const char* content, struct ami_evt_view* view);
+static struct ast_json* ami_evt_create_json(const struct ami_evt_view* view);
+static bool ami_evt_start_worker(void);
+static void ami_evt_stop_worker(void);
+static void* ami_evt_worker_loop(void* data);
+static bool ami_evt_ring_push(int idx, const char* event, size_t event_len, const char* content, size_t len, struct ast_json* j_evt);
+static bool ami_evt_init_source(void);
+static bool ami_evt_enqueue(struct ami_evt_entry* entry, const char* event, size_t event_len, const char* content);
+static bool ami_evt_ring_pop(struct ami_evt_slot* slot);
+static void ami_evt_process_raw(struct ami_evt_entry* entry, const char* content);
 
 
 int init_ami_handle(void)
 {
 	int ret;
 
+	ret = ami_evt_check_table();
+	if(ret == false) {
+		return false;
+	}
+
+	ret = ami_evt_start_worker();
+	if(ret == false) {
+		return false;
+	}
+
 	ret = ami_evt_handler();
 	if(ret == false) {
 		return false;
 	}
+
+	ret = ami_evt_init_source();
+	if(ret == false) {
+		return false;
+	}
 	ast_log(LOG_NOTICE, "Initiated AMI handler.\n");
 
 	return true;
@@ -58,119 +250,169 @@ int init_ami_handle(void)
 
 void term_ami_handle(void)
 {
-	ast_manager_unregister_hook(g_hook_evt);
-}
-
-/**
- *
- * @param s
- */
-static void trim(char * s)
-{
-	char * p = s;
-	int l = strlen(p);
-
-	while(isspace(p[l - 1])) p[--l] = 0;
-	while(* p && isspace(* p)) ++p, --l;
-
-	memmove(s, p, l + 1);
-}
-
-static void lower_string(char s[])
-{
-	int c = 0;
-
-	while (s[c] != '\0') {
-		if (s[c] >= 'A' && s[c] <= 'Z') {
-			s[c] = s[c] + 32;
-		}
-		c++;
+	term_stasis_handler();
+	if(g_hook_evt != NULL) {
+		ast_manager_unregister_hook(g_hook_evt);
+		ast_free(g_hook_evt);
+		g_hook_evt = NULL;
 	}
+	ami_evt_stop_worker();
 }
 
 /**
- *
+ * Parse the ami response message.
+ * Linear time. Every message(ends with the empty line) becomes an object of the array.
  * @param msg
  * @return
  */
-static struct ast_json* parse_ami_msg(char* msg)
+static struct ast_json* parse_ami_msg(const char* msg)
 {
 	struct ast_json* j_out;
 	struct ast_json* j_tmp;
-	int i, j;
-	int ret;
-	char  tmp[2048];
+	const char* line;
+	const char* end;
+	const char* colon;
+	size_t len;
 	char* key;
 	char* value;
-	char* dump;
 
 	if(msg == NULL) {
 		return NULL;
 	}
 
-	memset(tmp, 0x00, sizeof(tmp));
 	j_out = ast_json_array_create();
 	j_tmp = ast_json_object_create();
-	for(i = 0, j = 0; i < strlen(msg); i++) {
-		if((msg[i] == '\r') && (msg[i + 1] == '\n')) {
-			// Check /r/n/r/n
-			ret = strlen(tmp);
-			if(ret == 0) {
-				ret = ast_json_array_append(j_out, ast_json_deep_copy(j_tmp));
-				AST_JSON_UNREF(j_tmp);
-				j_tmp = NULL;
-
-				j_tmp = ast_json_object_create();
-				j = 0;
-				i++;
-				continue;
+	for(line = msg; *line != '\0'; line = end + 1) {
+		end = strchr(line, '\n');
+		if(end == NULL) {
+			end = line + strlen(line);
+		}
+
+		len = end - line;
+		if((len > 0) && (line[len - 1] == '\r')) {
+			len--;
+		}
+
+		// end of message
+		if(len == 0) {
+			if(*end == '\0') {
+				break;
 			}
+			ast_json_array_append(j_out, j_tmp);
+			j_tmp = ast_json_object_create();
+			continue;
+		}
 
-			value = ast_strdup(tmp);
-			dump = value;
-			key = strsep(&value, ":");
+		colon = memchr(line, ':', len);
+		if(colon != NULL) {
+			key = ast_strndup(line, len);
 			if(key == NULL) {
-				ast_free(dump);
-				continue;
+				break;
 			}
+			key[colon - line] = '\0';
+			value = key + (colon - line) + 1;
+			ast_json_object_set(j_tmp, ast_strip(key), ast_json_string_create(ast_strip(value)));
+			ast_free(key);
+		}
 
-			trim(key);
-			trim(value);
-			ast_json_object_set(j_tmp, key, ast_json_string_create(value));
-
-			ast_free(dump);
-			memset(tmp, 0x00, sizeof(tmp));
-			j = 0;
-			i++;
-			continue;
+		if(*end == '\0') {
+			break;
 		}
-		tmp[j] = msg[i];
-		j++;
 	}
 
-	if(j_tmp != NULL) {
-		AST_JSON_UNREF(j_tmp);
-	}
+	// incomplete message. drop it.
+	AST_JSON_UNREF(j_tmp);
+
 	return j_out;
 }
 
+/**
+ * Append the action header to the action.
+ * @param cmd
+ * @param key
+ * @param j_val
+ */
+static void ami_cmd_append_header(struct ast_str** cmd, const char* key, struct ast_json* j_val)
+{
+	struct ast_json* j_vars;
+	struct ast_json_iter* j_iter;
+	int type;
+
+	// Variables. json string of the variables.
+	if(strcmp(key, "Variables") == 0) {
+		j_vars = ast_json_load_string(ast_json_string_get(j_val) ? : "", NULL);
+		for(j_iter = ast_json_object_iter(j_vars);
+				j_iter != NULL;
+				j_iter = ast_json_object_iter_next(j_vars, j_iter))
+		{
+			ast_str_append(cmd, 0, "Variable: %s=%s\n",
+					ast_json_object_iter_key(j_iter),
+					ast_json_string_get(ast_json_object_iter_value(j_iter)) ? : ""
+					);
+		}
+		AST_JSON_UNREF(j_vars);
+		return;
+	}
+
+	type = ast_json_typeof(j_val);
+	switch(type) {
+		case AST_JSON_INTEGER:
+		{
+			ast_str_append(cmd, 0, "%s: %"PRIdMAX"\n", key, ast_json_integer_get(j_val));
+		}
+		break;
+
+		case AST_JSON_REAL:
+		{
+			ast_str_append(cmd, 0, "%s: %f\n", key, ast_json_real_get(j_val));
+		}
+		break;
+
+		case AST_JSON_TRUE:
+		{
+			ast_str_append(cmd, 0, "%s: true\n", key);
+		}
+		break;
+
+		case AST_JSON_FALSE:
+		{
+			ast_str_append(cmd, 0, "%s: false\n", key);
+		}
+		break;
+
+		case AST_JSON_STRING:
+		{
+			ast_str_append(cmd, 0, "%s: %s\n", key, ast_json_string_get(j_val));
+		}
+		break;
+
+		default:
+		{
+			ast_log(LOG_WARNING, "Invalid type. key[%s], type[%d]\n", key, type);
+		}
+		break;
+	}
+
+	return;
+}
 
 /**
- * zmq command msg handler
- * @param data
+ * Send the ami action and get the raw response.
+ * Thread safe. The response is collected in the context of the call.
+ * The caller must free the response.
+ * @param j_cmd
+ * @return
  */
-struct ast_json* ami_cmd_handler(struct ast_json* j_cmd)
+static struct ast_str* ami_cmd_send_action(struct ast_json* j_cmd)
 {
 	int ret;
 	struct ast_json* j_val;
-	struct ast_json* j_res;
-	const char*	 key;
-	struct manager_custom_hook* hook;
-	char str_cmd[10240];
+	const char* key;
+	struct manager_custom_hook hook;
+	struct ast_str* cmd;
+	struct ami_cmd_ctx ctx;
+	struct ami_cmd_ctx* ctx_prev;
 	struct ast_json_iter* j_iter;
-	int type;
-	char* tmp;
-	const char* tmp_const;
 
 	// just for log
 	if(j_cmd == NULL) {
@@ -184,78 +426,68 @@ struct ast_json* ami_cmd_handler(struct ast_json* j_cmd)
 		return NULL;
 	}
 
-	memset(str_cmd, 0x00, sizeof(str_cmd));
-	sprintf(str_cmd, "Action: %s\n", ast_json_string_get(j_val));
+	cmd = ast_str_create(DEF_AMI_CMD_LEN);
+	if(cmd == NULL) {
+		ast_log(LOG_ERROR, "Could not create action string.\n");
+		return NULL;
+	}
+	ast_str_append(&cmd, 0, "Action: %s\n", ast_json_string_get(j_val));
 	ast_log(LOG_VERBOSE, "AMI Action command. action[%s]\n", ast_json_string_get(j_val));
 	for(j_iter = ast_json_object_iter(j_cmd);
 			j_iter != NULL;
 			j_iter = ast_json_object_iter_next(j_cmd, j_iter))
 	{
-		j_val = ast_json_object_iter_value(j_iter);
 		key = ast_json_object_iter_key(j_iter);
-
-		ret = strcmp(key, "Action");
-		if(ret == 0) {
-			continue;
-		}
-
-		ret = strcmp(key, "Variables");
-		if(ret == 0) {
-			tmp_const = ast_json_string_get(j_val);
-			tmp = get_variables_info_ami_str_from_string(tmp_const);
-			if(tmp != NULL) {
-				sprintf(str_cmd, "%s%s\n", str_cmd, tmp);
-			}
-			ast_free(tmp);
+		if(strcmp(key, "Action") == 0) {
 			continue;
 		}
-
-		type = ast_json_typeof(j_val);
-		switch(type) {
-			case AST_JSON_REAL:
-			case AST_JSON_INTEGER:
-			{
-				sprintf(str_cmd, "%s%s: %"PRIdMAX"\n", str_cmd, key, ast_json_integer_get(j_val));
-			}
-			break;
-
-			case AST_JSON_FALSE:
-			case AST_JSON_TRUE:
-			case AST_JSON_STRING:
-			{
-				sprintf(str_cmd, "%s%s: %s\n", str_cmd, key, ast_json_string_get(j_val));
-			}
-			break;
-
-			default:
-			{
-				ast_log(LOG_WARNING, "Invalid type. type[%d]\n", type);
-
-			}
-			break;
-
-		}
-
-		sprintf(str_cmd, "%s%s: %s\n", str_cmd, key, ast_json_string_get(j_val));
+		ami_cmd_append_header(&cmd, key, ast_json_object_iter_value(j_iter));
 	}
 
-	// Set hook
-	hook = ast_calloc(1, sizeof(struct manager_custom_hook));
-	hook->file	  = NULL;
-	hook->helper	= &ami_cmd_helper;
-	if(g_cmd_buf != NULL) {
-		ast_free(g_cmd_buf);
-		g_cmd_buf = NULL;
+	ctx.res = ast_str_create(DEF_AMI_CMD_RES_LEN);
+	if(ctx.res == NULL) {
+		ast_log(LOG_ERROR, "Could not create response string.\n");
+		ast_free(cmd);
+		return NULL;
 	}
 
-	ret = ast_hook_send_action(hook, str_cmd);
-	ast_free(hook);
+	// Set hook
+	memset(&hook, 0x00, sizeof(hook));
+	hook.file = NULL;
+	hook.helper = &ami_cmd_helper;
+
+	// the hook calls the helper on this thread.
+	ctx_prev = g_ami_cmd_ctx;
+	g_ami_cmd_ctx = &ctx;
+	ret = ast_hook_send_action(&hook, ast_str_buffer(cmd));
+	g_ami_cmd_ctx = ctx_prev;
+	ast_free(cmd);
 	if(ret != 0) {
 		ast_log(AST_LOG_ERROR, "Could not hook. ret[%d], err[%d:%s]\n", ret, errno, strerror(errno));
+		ast_free(ctx.res);
+		return NULL;
+	}
+
+	return ctx.res;
+}
+
+/**
+ * Send the ami action and get the response.
+ * @param j_cmd
+ * @return
+ */
+struct ast_json* ami_cmd_handler(struct ast_json* j_cmd)
+{
+	struct ast_str* res;
+	struct ast_json* j_res;
+
+	res = ami_cmd_send_action(j_cmd);
+	if(res == NULL) {
 		return NULL;
 	}
 
-	j_res = parse_ami_msg(g_cmd_buf);
+	j_res = parse_ami_msg(ast_str_buffer(res));
+	ast_free(res);
 	if(j_res == NULL) {
 		ast_log(LOG_ERROR, "Could not parse response message.");
 		return NULL;
@@ -265,7 +497,34 @@ struct ast_json* ami_cmd_handler(struct ast_json* j_cmd)
 }
 
 /**
- *
+ * Send the async ami action(Async: true).
+ * The action is queued by the manager and the result comes later as an event.
+ * Checks the Response header only. The response is not parsed.
+ * @param j_cmd
+ * @return
+ */
+bool ami_cmd_send_async(struct ast_json* j_cmd)
+{
+	struct ast_str* res;
+	bool ret;
+
+	res = ami_cmd_send_action(j_cmd);
+	if(res == NULL) {
+		return false;
+	}
+
+	ret = (strncmp(ast_str_buffer(res), "Response: Success", 17) == 0) ? true : false;
+	if(ret == false) {
+		ast_log(LOG_NOTICE, "Could not queue the ami action. response[%s]\n", ast_str_buffer(res));
+	}
+	ast_free(res);
+
+	return ret;
+}
+
+/**
+ * Action response hook.
+ * Appends the response to the context of the calling thread.
  * @param category
  * @param event
  * @param content
@@ -273,96 +532,920 @@ struct ast_json* ami_cmd_handler(struct ast_json* j_cmd)
  */
 static int ami_cmd_helper(int category, const char *event, char *content)
 {
-	char* tmp;
-	int   ret;
+	int ret;
+
+	if((g_ami_cmd_ctx == NULL) || (content == NULL)) {
+		return 0;
+	}
+
+	ret = ast_str_append(&g_ami_cmd_ctx->res, 0, "%s", content);
+	if(ret == -1) {
+		ast_log(LOG_ERROR, "Could not append response. err[%d:%s]\n", errno, strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+static int ami_evt_handler(void)
+{
+//	struct manager_custom_hook* hook;
+
+	g_hook_evt = ast_calloc(1, sizeof(struct manager_custom_hook));
+	g_hook_evt->file = __FILE__;
+	g_hook_evt->helper = &ami_evt_helper;
+	ast_manager_register_hook(g_hook_evt);
+	ast_log(LOG_NOTICE, "Start zmq_evt hook.\n");
+
+	return true;
+}
+
+/**
+ * Manager event hook.
+ * Runs inside the manager event dispatch. Takes no module lock.
+ * Drops the not handling events and copies the rest to the event ring.
+ * The event worker does the rest.
+ * @param category
+ * @param event
+ * @param content
+ * @return
+ */
+static int ami_evt_helper(int category, const char *event, char *content)
+{
+	struct ami_evt_entry* entry;
+	const char* tmp_const;
+	size_t len;
+
+	if(content == NULL) {
+		return 0;
+	}
 
-	if(g_cmd_buf == NULL) {
-		ast_asprintf(&tmp, "%s", content);
+	// check event name
+	if(event != NULL) {
+		tmp_const = event;
+		len = strlen(event);
 	}
 	else {
-		ast_asprintf(&tmp, "%s%s", g_cmd_buf, content);
+		tmp_const = ami_evt_scan_header(content, "Event", &len);
+	}
+	entry = ami_evt_lookup(tmp_const, len);
+	if(entry == NULL) {
+		return 0;
+	}
+
+	// the stasis subscription gives the rest.
+	if((g_ami_evt_source == E_AMI_EVT_SOURCE_STASIS) && ((entry->flags & DEF_AMI_EVT_FLAG_MANAGER) == 0)) {
+		return 0;
+	}
+
+	ami_evt_enqueue(entry, tmp_const, len, content);
+
+	return 0;
+}
+
+/**
+ * Check the handler and the prefilter of the event and push it to the ring.
+ * @param entry
+ * @param event not null terminated.
+ * @param event_len
+ * @param content
+ * @return
+ */
+static bool ami_evt_enqueue(struct ami_evt_entry* entry, const char* event, size_t event_len, const char* content)
+{
+	int ret;
+
+	if(__atomic_load_n(&entry->handler, __ATOMIC_ACQUIRE) == NULL) {
+		return false;
+	}
+
+	if(entry->prefilter != NULL) {
+		ret = entry->prefilter(content);
+		if(ret == false) {
+			return false;
+		}
+	}
+
+	return ami_evt_ring_push(entry - g_ami_evt_table, event, event_len, content, strlen(content), NULL);
+}
+
+/**
+ * Push the manager event text to the event ring.
+ * For the events converted from the stasis message(stasis_message_to_ami).
+ * The content must have the Event header.
+ * @param content
+ * @return
+ */
+bool ami_evt_push_content(const char* content)
+{
+	struct ami_evt_entry* entry;
+	const char* tmp_const;
+	size_t len;
+
+	if(content == NULL) {
+		return false;
+	}
+
+	tmp_const = ami_evt_scan_header(content, "Event", &len);
+	entry = ami_evt_lookup(tmp_const, len);
+	if(entry == NULL) {
+		return false;
+	}
+
+	return ami_evt_enqueue(entry, tmp_const, len, content);
+}
+
+/**
+ * Push the typed event to the event ring.
+ * The event must have the "event" key. The keys are lower case, same with the manager event.
+ * The prefilter is not applied. The caller filters the event.
+ * Takes a new reference of the event.
+ * @param j_evt
+ * @return
+ */
+bool ami_evt_push(struct ast_json* j_evt)
+{
+	struct ami_evt_entry* entry;
+	const char* event;
+	size_t len;
+	int ret;
+
+	event = ast_json_string_get(ast_json_object_get(j_evt, "event"));
+	if(event == NULL) {
+		return false;
+	}
+	len = strlen(event);
+
+	entry = ami_evt_lookup(event, len);
+	if((entry == NULL) || (__atomic_load_n(&entry->handler, __ATOMIC_ACQUIRE) == NULL)) {
+		return false;
 	}
 
-	if(g_cmd_buf != NULL) {
-		ast_free(g_cmd_buf);
-	}
+	ast_json_ref(j_evt);
+	ret = ami_evt_ring_push(entry - g_ami_evt_table, event, len, "", 0, j_evt);
+	if(ret == false) {
+		ast_json_unref(j_evt);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Initiate the event source.
+ * The manager hook is always registered. It gives the manager only events(OriginateResponse)
+ * with the stasis source.
+ * @return
+ */
+static bool ami_evt_init_source(void)
+{
+	const char* tmp_const;
+	int ret;
+
+	// ami_evt_source
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "ami_evt_source"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_AMI_EVT_SOURCE;
+		ast_log(LOG_NOTICE, "Could not get correct ami_evt_source value. Set default. ami_evt_source[%s]\n", tmp_const);
+	}
+
+	if(strcasecmp(tmp_const, "stasis") != 0) {
+		if(strcasecmp(tmp_const, "manager") != 0) {
+			ast_log(LOG_WARNING, "Unsupported ami_evt_source. Set manager. ami_evt_source[%s]\n", tmp_const);
+		}
+		g_ami_evt_source = E_AMI_EVT_SOURCE_MANAGER;
+		return true;
+	}
+
+	ret = init_stasis_handler();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate stasis handler.\n");
+		return false;
+	}
+	g_ami_evt_source = E_AMI_EVT_SOURCE_STASIS;
+
+	return true;
+}
+
+/**
+ * Process the event popped from the ring.
+ * Runs on the event worker.
+ * @param entry
+ * @param content
+ */
+static void ami_evt_process_raw(struct ami_evt_entry* entry, const char* content)
+{
+	struct ast_json* j_out;
+	struct ami_evt_view view;
+	const char* tmp_const;
+	size_t len;
+	char uuid[DEF_AMI_EVT_UNIQUEID_LEN];
+	int ret;
+
+	// check outbound channel/action
+	if((entry->flags & (DEF_AMI_EVT_FLAG_CHANNEL | DEF_AMI_EVT_FLAG_ACTION)) != 0) {
+		tmp_const = ami_evt_scan_header(content, ((entry->flags & DEF_AMI_EVT_FLAG_ACTION) != 0) ? "ActionID" : "Uniqueid", &len);
+		if((tmp_const == NULL) || (len == 0) || (len >= sizeof(uuid))) {
+			return;
+		}
+		memcpy(uuid, tmp_const, len);
+		uuid[len] = '\0';
+		ret = rb_dialing_is_exist_uuid(uuid);
+		if(ret == false) {
+			return;
+		}
+	}
+
+	// parse
+	ret = ami_evt_parse_view(content, &view);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not parse the event. event[%s]\n", entry->name);
+		return;
+	}
+
+	j_out = ami_evt_create_json(&view);
+	if(j_out == NULL) {
+		ast_log(LOG_WARNING, "Could not create event json. event[%s]\n", entry->name);
+		return;
+	}
+
+	ami_evt_dispatch(entry, j_out);
+	AST_JSON_UNREF(j_out);
+
+	return;
+}
+
+/**
+ * Start the event worker.
+ * Allocates the event ring with ami_evt_queue_size slots(rounded up to the power of 2).
+ * @return
+ */
+static bool ami_evt_start_worker(void)
+{
+	const char* tmp_const;
+	uint64_t size;
+	uint64_t i;
+	int ret;
+
+	if(g_ami_evt_thread != AST_PTHREADT_NULL) {
+		return true;
+	}
+
+	// ami_evt_queue_size
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "ami_evt_queue_size"));
+	if((tmp_const == NULL) || (atoi(tmp_const) <= 0)) {
+		tmp_const = DEF_AMI_EVT_QUEUE_SIZE;
+		ast_log(LOG_NOTICE, "Could not get correct ami_evt_queue_size value. Set default. ami_evt_queue_size[%s]\n", tmp_const);
+	}
+	for(size = 1; size < atoi(tmp_const); size <<= 1);
+
+	// ami_evt_queue_policy
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "ami_evt_queue_policy"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_AMI_EVT_QUEUE_POLICY;
+		ast_log(LOG_NOTICE, "Could not get correct ami_evt_queue_policy value. Set default. ami_evt_queue_policy[%s]\n", tmp_const);
+	}
+	if(strcasecmp(tmp_const, "wait") == 0) {
+		g_ami_evt_policy = E_AMI_EVT_POLICY_WAIT;
+	}
+	else {
+		if(strcasecmp(tmp_const, "drop") != 0) {
+			ast_log(LOG_WARNING, "Unsupported ami_evt_queue_policy. Set drop. ami_evt_queue_policy[%s]\n", tmp_const);
+		}
+		g_ami_evt_policy = E_AMI_EVT_POLICY_DROP;
+	}
+
+	// ami_evt_queue_wait
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "ami_evt_queue_wait"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_AMI_EVT_QUEUE_WAIT;
+	}
+	g_ami_evt_wait = atoi(tmp_const);
+	if(g_ami_evt_wait < 0) {
+		g_ami_evt_wait = 0;
+	}
+
+	memset(&g_ami_evt_ring, 0x00, sizeof(g_ami_evt_ring));
+	g_ami_evt_ring.slots = ast_calloc(size, sizeof(struct ami_evt_slot));
+	if(g_ami_evt_ring.slots == NULL) {
+		ast_log(LOG_ERROR, "Could not allocate event ring. size[%"PRIu64"]\n", size);
+		return false;
+	}
+	g_ami_evt_ring.mask = size - 1;
+	for(i = 0; i < size; i++) {
+		g_ami_evt_ring.slots[i].seq = i;
+	}
+
+	g_ami_evt_stop = 0;
+	g_ami_evt_sleeping = 0;
+	ast_cond_init(&g_ami_evt_cond, NULL);
+
+	ret = ast_pthread_create_background(&g_ami_evt_thread, NULL, ami_evt_worker_loop, NULL);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Unable to launch thread for event worker. err[%d:%s]\n", errno, strerror(errno));
+		g_ami_evt_thread = AST_PTHREADT_NULL;
+		ast_cond_destroy(&g_ami_evt_cond);
+		ast_free(g_ami_evt_ring.slots);
+		g_ami_evt_ring.slots = NULL;
+		return false;
+	}
+	ast_log(LOG_NOTICE, "Started event worker. size[%"PRIu64"], policy[%s], wait[%d]\n",
+			size,
+			(g_ami_evt_policy == E_AMI_EVT_POLICY_WAIT)? "wait" : "drop",
+			g_ami_evt_wait
+			);
+
+	return true;
+}
+
+/**
+ * Stop the event worker.
+ * The hook must be unregistered before.
+ */
+static void ami_evt_stop_worker(void)
+{
+	uint64_t i;
+
+	if(g_ami_evt_thread == AST_PTHREADT_NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_ami_evt_mutex);
+	__atomic_store_n(&g_ami_evt_stop, 1, __ATOMIC_SEQ_CST);
+	ast_cond_signal(&g_ami_evt_cond);
+	ast_mutex_unlock(&g_ami_evt_mutex);
+
+	pthread_join(g_ami_evt_thread, NULL);
+	g_ami_evt_thread = AST_PTHREADT_NULL;
+
+	// release the left typed events
+	for(i = 0; i <= g_ami_evt_ring.mask; i++) {
+		if(g_ami_evt_ring.slots[i].j_evt != NULL) {
+			AST_JSON_UNREF(g_ami_evt_ring.slots[i].j_evt);
+		}
+	}
+
+	ast_cond_destroy(&g_ami_evt_cond);
+	ast_free(g_ami_evt_ring.slots);
+	g_ami_evt_ring.slots = NULL;
+
+	return;
+}
+
+/**
+ * Event worker loop.
+ * Processes the events in the pushed order.
+ * @param data
+ * @return
+ */
+static void* ami_evt_worker_loop(__attribute__((unused)) void* data)
+{
+	struct ami_evt_slot* slot;
+	struct timeval tv;
+	struct timespec ts;
+	int ret;
+
+	slot = ast_malloc(sizeof(*slot));
+	if(slot == NULL) {
+		ast_log(LOG_ERROR, "Could not allocate event slot.\n");
+		return NULL;
+	}
+
+	while(__atomic_load_n(&g_ami_evt_stop, __ATOMIC_SEQ_CST) == 0) {
+		ret = ami_evt_ring_pop(slot);
+		if(ret == true) {
+			if(slot->j_evt != NULL) {
+				ami_evt_dispatch(&g_ami_evt_table[slot->idx], slot->j_evt);
+				AST_JSON_UNREF(slot->j_evt);
+			}
+			else {
+				ami_evt_process_raw(&g_ami_evt_table[slot->idx], slot->content);
+			}
+			__atomic_add_fetch(&g_ami_evt_ring.cnt_processed, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		// empty. sleep until the producer signals.
+		// the timeout is just for the safety.
+		ast_mutex_lock(&g_ami_evt_mutex);
+		__atomic_store_n(&g_ami_evt_sleeping, 1, __ATOMIC_SEQ_CST);
+		if((__atomic_load_n(&g_ami_evt_ring.tail, __ATOMIC_SEQ_CST) == __atomic_load_n(&g_ami_evt_ring.head, __ATOMIC_SEQ_CST))
+				&& (__atomic_load_n(&g_ami_evt_stop, __ATOMIC_SEQ_CST) == 0)) {
+			tv = ast_tvadd(ast_tvnow(), ast_samp2tv(100, 1000));
+			ts.tv_sec = tv.tv_sec;
+			ts.tv_nsec = tv.tv_usec * 1000;
+			ast_cond_timedwait(&g_ami_evt_cond, &g_ami_evt_mutex, &ts);
+		}
+		__atomic_store_n(&g_ami_evt_sleeping, 0, __ATOMIC_SEQ_CST);
+		ast_mutex_unlock(&g_ami_evt_mutex);
+	}
+	ast_free(slot);
+
+	return NULL;
+}
+
+/**
+ * Push the event to the ring.
+ * Lock-free. Many producers can push at the same time.
+ * Follows the back-pressure policy when the ring is full.
+ * @param idx index of the event table
+ * @param event not null terminated.
+ * @param event_len
+ * @param content
+ * @param len
+ * @param j_evt typed event. The ring takes the reference if succeed. NULL for the event text.
+ * @return
+ */
+static bool ami_evt_ring_push(int idx, const char* event, size_t event_len, const char* content, size_t len, struct ast_json* j_evt)
+{
+	struct ami_evt_ring* ring;
+	struct ami_evt_slot* slot;
+	struct timeval tv_start;
+	uint64_t pos;
+	uint64_t seq;
+	uint64_t used;
+	uint64_t high;
+	int64_t diff;
+	bool waited;
+
+	ring = &g_ami_evt_ring;
+	if(ring->slots == NULL) {
+		return false;
+	}
+
+	if((len >= DEF_AMI_EVT_SLOT_LEN) || (event_len >= DEF_AMI_EVT_NAME_LEN)) {
+		__atomic_add_fetch(&ring->cnt_dropped_oversize, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	waited = false;
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	while(1) {
+		slot = &ring->slots[pos & ring->mask];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (int64_t)seq - (int64_t)pos;
+		if(diff == 0) {
+			// slot is free. take the ticket.
+			if(__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+			continue;
+		}
+
+		if(diff > 0) {
+			// somebody took it.
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		// full
+		if((g_ami_evt_policy == E_AMI_EVT_POLICY_WAIT) && (g_ami_evt_wait > 0)) {
+			if(waited == false) {
+				waited = true;
+				tv_start = ast_tvnow();
+				__atomic_add_fetch(&ring->cnt_waited, 1, __ATOMIC_RELAXED);
+			}
+			if(ast_tvdiff_ms(ast_tvnow(), tv_start) < g_ami_evt_wait) {
+				sched_yield();
+				pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+				continue;
+			}
+		}
+		__atomic_add_fetch(&ring->cnt_dropped_full, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	slot->idx = idx;
+	slot->j_evt = j_evt;
+	memcpy(slot->event, event, event_len);
+	slot->event[event_len] = '\0';
+	memcpy(slot->content, content, len);
+	slot->content[len] = '\0';
+	slot->len = len;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	// stats
+	__atomic_add_fetch(&ring->cnt_pushed, 1, __ATOMIC_RELAXED);
+	used = pos + 1 - __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	high = __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+	while((used > high) && (used <= ring->mask + 1)) {
+		if(__atomic_compare_exchange_n(&ring->high_water, &high, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+
+	// wake up the worker
+	if(__atomic_load_n(&g_ami_evt_sleeping, __ATOMIC_SEQ_CST) == 1) {
+		ast_mutex_lock(&g_ami_evt_mutex);
+		ast_cond_signal(&g_ami_evt_cond);
+		ast_mutex_unlock(&g_ami_evt_mutex);
+	}
+
+	return true;
+}
+
+/**
+ * Pop the oldest event from the ring.
+ * Single consumer(event worker) only.
+ * @param slot copied event.
+ * @return false if empty.
+ */
+static bool ami_evt_ring_pop(struct ami_evt_slot* slot)
+{
+	struct ami_evt_ring* ring;
+	struct ami_evt_slot* src;
+	uint64_t pos;
+	uint64_t seq;
+
+	ring = &g_ami_evt_ring;
+
+	pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	src = &ring->slots[pos & ring->mask];
+	seq = __atomic_load_n(&src->seq, __ATOMIC_ACQUIRE);
+	if(seq != pos + 1) {
+		// empty or the producer is still writing.
+		return false;
+	}
+
+	slot->idx = src->idx;
+	slot->j_evt = src->j_evt;
+	src->j_evt = NULL;
+	strcpy(slot->event, src->event);
+	memcpy(slot->content, src->content, src->len + 1);
+	slot->len = src->len;
+
+	// release the slot for the next round.
+	__atomic_store_n(&src->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->tail, pos + 1, __ATOMIC_SEQ_CST);
+
+	return true;
+}
+
+/**
+ * Get the event worker stats.
+ * @return
+ */
+struct ast_json* ami_evt_get_stats(void)
+{
+	struct ast_json* j_res;
+	struct ast_json* j_events;
+	struct ast_json* j_hist;
+	struct ami_evt_ring* ring;
+	struct ami_evt_entry* entry;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t cnt;
+	int i;
+	int j;
+
+	ring = &g_ami_evt_ring;
+	head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+	j_res = ast_json_pack("{s:s, s:i, s:i, s:s, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i}",
+			"source",				(g_ami_evt_source == E_AMI_EVT_SOURCE_STASIS)? "stasis" : "manager",
+			"size",					(ring->slots != NULL)? (int)(ring->mask + 1) : 0,
+			"used",					(int)(head - tail),
+			"policy",				(g_ami_evt_policy == E_AMI_EVT_POLICY_WAIT)? "wait" : "drop",
+			"wait",					g_ami_evt_wait,
+			"high_water",			(int)__atomic_load_n(&ring->high_water, __ATOMIC_RELAXED),
+			"pushed",				(int)__atomic_load_n(&ring->cnt_pushed, __ATOMIC_RELAXED),
+			"processed",			(int)__atomic_load_n(&ring->cnt_processed, __ATOMIC_RELAXED),
+			"dropped_full",			(int)__atomic_load_n(&ring->cnt_dropped_full, __ATOMIC_RELAXED),
+			"dropped_oversize",		(int)__atomic_load_n(&ring->cnt_dropped_oversize, __ATOMIC_RELAXED),
+			"waited",				(int)__atomic_load_n(&ring->cnt_waited, __ATOMIC_RELAXED),
+			"slot_len",				DEF_AMI_EVT_SLOT_LEN
+			);
+
+	// events
+	j_events = ast_json_array_create();
+	for(i = 0; i < DEF_AMI_EVT_TABLE_SIZE; i++) {
+		entry = &g_ami_evt_table[i];
+		if(entry->name == NULL) {
+			continue;
+		}
+
+		j_hist = ast_json_array_create();
+		for(j = 0; j < DEF_AMI_EVT_HIST_SIZE; j++) {
+			ast_json_array_append(j_hist, ast_json_integer_create(__atomic_load_n(&entry->hist[j], __ATOMIC_RELAXED)));
+		}
+
+		cnt = __atomic_load_n(&entry->cnt, __ATOMIC_RELAXED);
+		ast_json_array_append(j_events, ast_json_pack("{s:s, s:b, s:I, s:I, s:I, s:o}",
+				"name",			entry->name,
+				"registered",	(__atomic_load_n(&entry->handler, __ATOMIC_RELAXED) != NULL)? 1 : 0,
+				"count",		(intmax_t)cnt,
+				"avg_us",		(intmax_t)((cnt > 0)? __atomic_load_n(&entry->tm_total, __ATOMIC_RELAXED) / cnt : 0),
+				"max_us",		(intmax_t)__atomic_load_n(&entry->tm_max, __ATOMIC_RELAXED),
+				"hist",			j_hist
+				));
+	}
+	ast_json_object_set(j_res, "events", j_events);
+
+	return j_res;
+}
+
+/**
+ * Find the given header from the event content.
+ * Does not allocate/modify anything. Stops at the end of the event.
+ * @param content
+ * @param key
+ * @param len length of the value
+ * @return pointer of the value in the content. NULL if not exists.
+ */
+static const char* ami_evt_scan_header(const char* content, const char* key, size_t* len)
+{
+	const char* line;
+	const char* end;
+	const char* value;
+	size_t key_len;
+
+	if((content == NULL) || (key == NULL) || (len == NULL)) {
+		return NULL;
+	}
+
+	key_len = strlen(key);
+	for(line = content; *line != '\0'; line = end + 1) {
+		end = strchr(line, '\n');
+		if(end == NULL) {
+			end = line + strlen(line);
+		}
+
+		// end of event
+		if((line == end) || ((*line == '\r') && (line + 1 == end))) {
+			return NULL;
+		}
+
+		if((strncasecmp(line, key, key_len) == 0) && (line[key_len] == ':')) {
+			value = line + key_len + 1;
+			while((value < end) && (isspace(*value))) {
+				value++;
+			}
+			while((end > value) && (isspace(*(end - 1)))) {
+				end--;
+			}
+			*len = end - value;
+			return value;
+		}
+
+		if(*end == '\0') {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Perfect hash of the handling event names.
+ * (len + first * 5 + middle * 11 + last * 5) % DEF_AMI_EVT_TABLE_SIZE
+ * No collision for the names of the event table.
+ * @param event not null terminated.
+ * @param len
+ * @return
+ */
+static unsigned int ami_evt_hash(const char* event, size_t len)
+{
+	const unsigned char* tmp;
+
+	tmp = (const unsigned char*)event;
+	return (len + tmp[0] * 5 + tmp[len / 2] * 11 + tmp[len - 1] * 5) % DEF_AMI_EVT_TABLE_SIZE;
+}
+
+/**
+ * Return the event table entry of the given event.
+ * @param event not null terminated.
+ * @param len
+ * @return NULL if not handling event.
+ */
+static struct ami_evt_entry* ami_evt_lookup(const char* event, size_t len)
+{
+	struct ami_evt_entry* entry;
+
+	if((event == NULL) || (len == 0)) {
+		return NULL;
+	}
+
+	entry = &g_ami_evt_table[ami_evt_hash(event, len)];
+	if((entry->name == NULL) || (entry->len != len) || (memcmp(entry->name, event, len) != 0)) {
+		return NULL;
+	}
+
+	return entry;
+}
+
+/**
+ * Check the event table was generated with the current hash.
+ * @return
+ */
+static bool ami_evt_check_table(void)
+{
+	int i;
+	struct ami_evt_entry* entry;
+
+	for(i = 0; i < DEF_AMI_EVT_TABLE_SIZE; i++) {
+		entry = &g_ami_evt_table[i];
+		if(entry->name == NULL) {
+			continue;
+		}
+
+		if((entry->len != strlen(entry->name)) || (ami_evt_hash(entry->name, entry->len) != i)) {
+			ast_log(LOG_ERROR, "Wrong event table entry. name[%s], index[%d], hash[%u]\n",
+					entry->name, i, ami_evt_hash(entry->name, strlen(entry->name)));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Register the handler of the given event.
+ * The event must be in the event table.
+ * @param name
+ * @param handler NULL to unregister.
+ * @return
+ */
+bool ami_evt_register_handler(const char* name, ami_evt_handler_t handler)
+{
+	struct ami_evt_entry* entry;
+
+	if(name == NULL) {
+		return false;
+	}
+
+	entry = ami_evt_lookup(name, strlen(name));
+	if(entry == NULL) {
+		ast_log(LOG_WARNING, "Not supported event. name[%s]\n", name);
+		return false;
+	}
+
+	__atomic_store_n(&entry->handler, handler, __ATOMIC_RELEASE);
+	ast_log(LOG_NOTICE, "Registered event handler. name[%s], registered[%d]\n", name, (handler != NULL)? 1 : 0);
+
+	return true;
+}
+
+/**
+ * Call the handler of the entry and update the stats.
+ * Runs on the event worker.
+ * @param entry
+ * @param j_evt
+ */
+static void ami_evt_dispatch(struct ami_evt_entry* entry, struct ast_json* j_evt)
+{
+	ami_evt_handler_t handler;
+	struct timeval tv_start;
+	uint64_t elapsed;
+	uint64_t bound;
+	char* tmp;
+	int i;
+
+	handler = __atomic_load_n(&entry->handler, __ATOMIC_ACQUIRE);
+	if(handler == NULL) {
+		return;
+	}
+
+	// log
+	if(DEBUG_ATLEAST(1)) {
+		tmp = ast_json_dump_string_format(j_evt, 0);
+		ast_log(LOG_DEBUG, "Received event. tmp[%s]\n", tmp);
+		ast_json_free(tmp);
+	}
+
+	tv_start = ast_tvnow();
+	handler(j_evt);
+	elapsed = ast_tvdiff_us(ast_tvnow(), tv_start);
+
+	// stats
+	for(i = 0, bound = 10; i < DEF_AMI_EVT_HIST_SIZE - 1; i++, bound *= 10) {
+		if(elapsed < bound) {
+			break;
+		}
+	}
+	__atomic_add_fetch(&entry->hist[i], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&entry->cnt, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&entry->tm_total, elapsed, __ATOMIC_RELAXED);
+	if(elapsed > __atomic_load_n(&entry->tm_max, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&entry->tm_max, elapsed, __ATOMIC_RELAXED);
+	}
+
+	return;
+}
+
+/**
+ * Parse the event content into the header view.
+ * Does not allocate/modify anything. The view points into the content.
+ * @param content
+ * @param view
+ * @return
+ */
+static bool ami_evt_parse_view(const char* content, struct ami_evt_view* view)
+{
+	const char* line;
+	const char* end;
+	const char* colon;
+	const char* value_end;
+	struct ami_evt_header* header;
+
+	if((content == NULL) || (view == NULL)) {
+		return false;
+	}
+
+	view->count = 0;
+	for(line = content; *line != '\0'; line = end + 1) {
+		end = strchr(line, '\n');
+		if(end == NULL) {
+			end = line + strlen(line);
+		}
+
+		value_end = end;
+		if((value_end > line) && (*(value_end - 1) == '\r')) {
+			value_end--;
+		}
+
+		// end of event
+		if(value_end == line) {
+			break;
+		}
+
+		colon = memchr(line, ':', value_end - line);
+		if(colon != NULL) {
+			if(view->count >= DEF_AMI_EVT_HEADER_MAX) {
+				ast_log(LOG_WARNING, "Too many headers. Ignore the rest. max[%d]\n", DEF_AMI_EVT_HEADER_MAX);
+				break;
+			}
+			header = &view->headers[view->count];
 
-	ret = ast_asprintf(&g_cmd_buf, "%s", tmp);
-	if(ret == -1) {
-		ast_log(LOG_ERROR, "Could not allocate string. err[%d:%s]\n", errno, strerror(errno));
-		return 0;
-	}
-	ast_free(tmp);
+			header->key = line;
+			header->key_len = colon - line;
+			while((header->key_len > 0) && (isspace(header->key[header->key_len - 1]))) {
+				header->key_len--;
+			}
 
-	return 1;
-}
+			header->value = colon + 1;
+			while((header->value < value_end) && (isspace(*header->value))) {
+				header->value++;
+			}
+			header->value_len = value_end - header->value;
+			while((header->value_len > 0) && (isspace(header->value[header->value_len - 1]))) {
+				header->value_len--;
+			}
 
-static int ami_evt_handler(void)
-{
-//	struct manager_custom_hook* hook;
+			view->count++;
+		}
 
-	g_hook_evt = ast_calloc(1, sizeof(struct manager_custom_hook));
-	g_hook_evt->file = __FILE__;
-	g_hook_evt->helper = &ami_evt_helper;
-	ast_manager_register_hook(g_hook_evt);
-	ast_log(LOG_NOTICE, "Start zmq_evt hook.\n");
+		if(*end == '\0') {
+			break;
+		}
+	}
 
 	return true;
 }
 
-static int ami_evt_helper(int category, const char *event, char *content)
+/**
+ * Create the event json from the header view.
+ * The keys are lower case.
+ * @param view
+ * @return
+ */
+static struct ast_json* ami_evt_create_json(const struct ami_evt_view* view)
 {
 	struct ast_json* j_out;
-	struct ast_json* j_tmp;
+	const struct ami_evt_header* header;
+	char key[DEF_AMI_EVT_KEY_LEN];
+	char value[DEF_AMI_EVT_VALUE_LEN];
+	size_t len;
 	int i;
 	int j;
-	int ret;
-	char*   key;
-	char*   key_tmp;
-	char*   value;
-	char	tmp_line[4096];
-	char*   tmp_org;
 
-	i = j = 0;
-	memset(tmp_line, 0x00, sizeof(tmp_line));
+	if(view == NULL) {
+		return NULL;
+	}
 
 	j_out = ast_json_object_create();
-	for(i = 0; i < strlen(content); i++)
-	{
-		if((content[i] == '\r') && (content[i + 1] == '\n')) {
-			ret = strlen(tmp_line);
-			if(ret == 0) {
-				break;
-			}
-
-			value = ast_strdup(tmp_line);
-			tmp_org = value;
-
-			key = strsep(&value, ":");
-
-			trim(key);
-			key_tmp = ast_strdup(key);
-			lower_string(key_tmp);
-			trim(value);
-			j_tmp = ast_json_string_create(value);
-			ret = ast_json_object_set(j_out, key_tmp, j_tmp);
+	for(i = 0; i < view->count; i++) {
+		header = &view->headers[i];
+		if((header->key_len == 0) || (header->key_len >= sizeof(key))) {
+			continue;
+		}
 
-			ast_free(tmp_org);
-			ast_free(key_tmp);
-			memset(tmp_line, 0x00, sizeof(tmp_line));
+		for(j = 0; j < header->key_len; j++) {
+			key[j] = tolower(header->key[j]);
+		}
+		key[j] = '\0';
 
-			j = 0;
-			i++;
-			continue;
+		len = header->value_len;
+		if(len >= sizeof(value)) {
+			len = sizeof(value) - 1;
 		}
-		tmp_line[j] = content[i];
-		j++;
-	}
+		memcpy(value, header->value, len);
+		value[len] = '\0';
 
-	ami_evt_process(j_out);
-	AST_JSON_UNREF(j_out);
+		ast_json_object_set(j_out, key, ast_json_string_create(value));
+	}
 
-	return 0;
+	return j_out;
 }
 
 /**
@@ -462,19 +1545,20 @@ struct ast_json* ami_cmd_queue_status(const char* name)
 
 
 /**
- * Send/Get QueueSummary AMI.
- * @param name
+ * Originate the call and send to application.
+ * Async. The ActionID is the channelid of the dialing.
+ * The result comes with the OriginateResponse event.
+ * @param j_dial
  * @return
  */
-struct ast_json* ami_cmd_originate_to_application(struct ast_json* j_dial)
+bool ami_cmd_originate_to_application(struct ast_json* j_dial)
 {
 	struct ast_json* j_cmd;
-	struct ast_json* j_res;
 	int ret;
 	char* tmp;
 
 	if(j_dial == NULL) {
-		return NULL;
+		return false;
 	}
 
 	//	Action: Originate
@@ -526,7 +1610,9 @@ struct ast_json* ami_cmd_originate_to_application(struct ast_json* j_dial)
 		ast_json_object_set(j_cmd, "Codecs", ast_json_ref(ast_json_object_get(j_dial, "codecs")));
 	}
 
+	// the originate response event is matched with the ActionID.
 	if(ast_json_object_get(j_dial, "channelid") != NULL) {
+		ast_json_object_set(j_cmd, "ActionID", ast_json_ref(ast_json_object_get(j_dial, "channelid")));
 		ast_json_object_set(j_cmd, "ChannelId", ast_json_ref(ast_json_object_get(j_dial, "channelid")));
 	}
 
@@ -536,38 +1622,33 @@ struct ast_json* ami_cmd_originate_to_application(struct ast_json* j_dial)
 
 	if(j_cmd == NULL) {
 		ast_log(LOG_ERROR, "Could not create ami json.\n");
-		return NULL;
+		return false;
 	}
 	tmp = ast_json_dump_string_format(j_cmd, 0);
 	ast_log(LOG_DEBUG, "Dialing. tmp[%s]\n", tmp);
 	ast_json_free(tmp);
 
-	j_res = ami_cmd_handler(j_cmd);
+	ret = ami_cmd_send_async(j_cmd);
 	AST_JSON_UNREF(j_cmd);
 
-	ret = ami_is_response_success(j_res);
-	if(ret == false) {
-		AST_JSON_UNREF(j_res);
-		return NULL;
-	}
-
-	return j_res;
+	return ret;
 }
 
 /**
- * Originate the call and send to extension
- * @param name
+ * Originate the call and send to extension.
+ * Async. The ActionID is the channelid of the dialing.
+ * The result comes with the OriginateResponse event.
+ * @param j_dial
  * @return
  */
-struct ast_json* ami_cmd_originate_to_exten(struct ast_json* j_dial)
+bool ami_cmd_originate_to_exten(struct ast_json* j_dial)
 {
 	struct ast_json* j_cmd;
-	struct ast_json* j_res;
 	int ret;
 	char* tmp;
 
 	if(j_dial == NULL) {
-		return NULL;
+		return false;
 	}
 
 	//	Action: Originate
@@ -616,7 +1697,9 @@ struct ast_json* ami_cmd_originate_to_exten(struct ast_json* j_dial)
 		ast_json_object_set(j_cmd, "Codecs", ast_json_ref(ast_json_object_get(j_dial, "codecs")));
 	}
 
+	// the originate response event is matched with the ActionID.
 	if(ast_json_object_get(j_dial, "channelid") != NULL) {
+		ast_json_object_set(j_cmd, "ActionID", ast_json_ref(ast_json_object_get(j_dial, "channelid")));
 		ast_json_object_set(j_cmd, "ChannelId", ast_json_ref(ast_json_object_get(j_dial, "channelid")));
 	}
 
@@ -631,22 +1714,16 @@ struct ast_json* ami_cmd_originate_to_exten(struct ast_json* j_dial)
 
 	if(j_cmd == NULL) {
 		ast_log(LOG_ERROR, "Could not create ami json.\n");
-		return NULL;
+		return false;
 	}
 	tmp = ast_json_dump_string_format(j_cmd, 0);
 	ast_log(LOG_DEBUG, "Dialing. tmp[%s]\n", tmp);
 	ast_json_free(tmp);
 
-	j_res = ami_cmd_handler(j_cmd);
+	ret = ami_cmd_send_async(j_cmd);
 	AST_JSON_UNREF(j_cmd);
 
-	ret = ami_is_response_success(j_res);
-	if(ret == false) {
-		AST_JSON_UNREF(j_res);
-		return NULL;
-	}
-
-	return j_res;
+	return ret;
 }
 
 
@@ -817,9 +1894,14 @@ struct ast_json* ami_cmd_dialplan_extension_remove(const char* context, const ch
 }
 
 
+/**
+ * Process the given event json.
+ * The keys must be lower case.
+ * @param j_evt
+ */
 void ami_evt_process(struct ast_json* j_evt)
 {
-	char* tmp;
+	struct ami_evt_entry* entry;
 	const char* event;
 
 	event = ast_json_string_get(ast_json_object_get(j_evt, "event"));
@@ -828,47 +1910,11 @@ void ami_evt_process(struct ast_json* j_evt)
 		return;
 	}
 
-	// log
-	tmp = ast_json_dump_string_format(j_evt, 0);
-	ast_log(LOG_DEBUG, "Received event. tmp[%s]\n", tmp);
-	ast_json_free(tmp);
-
-	if(strcmp(event, "Newchannel") == 0) {
-		ami_evt_Newchannel(j_evt);
-	}
-	else if(strcmp(event, "Newexten") == 0) {
-		ami_evt_Newexten(j_evt);
-	}
-	else if(strcmp(event, "Newstate") == 0) {
-		ami_evt_Newstate(j_evt);
-	}
-	else if(strcmp(event, "QueueCallerJoin") == 0) {
-		ami_evt_QueueCallerJoin(j_evt);
-	}
-	else if(strcmp(event, "QueueCallerLeave") == 0) {
-		ami_evt_QueueCallerLeave(j_evt);
-	}
-	else if(strcmp(event, "OriginateResponse") == 0) {
-		ami_evt_OriginateResponse(j_evt);
-	}
-	else if(strcmp(event, "AgentCalled") == 0) {
-		ami_evt_AgentCalled(j_evt);
-	}
-	else if(strcmp(event, "AgentConnect") == 0) {
-		ami_evt_AgentConnect(j_evt);
-	}
-	else if(strcmp(event, "AgentComplete") == 0) {
-		ami_evt_AgentComplete(j_evt);
-	}
-	else if(strcmp(event, "DialBegin") == 0) {
-		ami_evt_DialBegin(j_evt);
-	}
-	else if(strcmp(event, "DialEnd") == 0) {
-		ami_evt_DialEnd(j_evt);
-	}
-	else if(strcmp(event, "Hangup") == 0) {
-		ami_evt_Hangup(j_evt);
+	entry = ami_evt_lookup(event, strlen(event));
+	if(entry == NULL) {
+		return;
 	}
+	ami_evt_dispatch(entry, j_evt);
 
 	return;
 }
@@ -930,6 +1976,7 @@ static void ami_evt_Newchannel(struct ast_json* j_evt)
 	AST_JSON_UNREF(j_tmp);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -983,6 +2030,7 @@ static void ami_evt_Newexten(struct ast_json* j_evt)
 	AST_JSON_UNREF(j_tmp);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1032,7 +2080,20 @@ static void ami_evt_Newstate(struct ast_json* j_evt)
 	rb_dialing_update_event_substitute(dialing, j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
+	// originated by the core. the answer is the originate response.
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "channelstate"));
+	if((tmp_const != NULL) && (atoi(tmp_const) == AST_STATE_UP)
+			&& (rb_dialing_take_originate_pending(dialing) == true)) {
+		rb_dialing_originate_response(dialing, true);
+		rb_dialing_update_res_dial(dialing, AST_CONTROL_ANSWER);
+		j_tmp = ast_json_pack("{s:s}", "tm_dial_end", timestamp);
+		rb_dialing_update_dialing_update(dialing, j_tmp);
+		AST_JSON_UNREF(j_tmp);
+		rb_dialing_update_status(dialing, E_DIALING_ORIGINATE_RESPONSE);
+	}
+
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1085,7 +2146,14 @@ static void ami_evt_QueueCallerJoin(struct ast_json* j_evt)
 	rb_dialing_update_event_substitute(dialing, j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
+	// waiting callers of the queue cache
+	destination_queue_update_callers(
+			ast_json_string_get(ast_json_object_get(j_evt, "queue")),
+			atoi(ast_json_string_get(ast_json_object_get(j_evt, "count")) ? : "0")
+			);
+
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1138,7 +2206,17 @@ static void ami_evt_QueueCallerLeave(struct ast_json* j_evt)
 	rb_dialing_update_event_substitute(dialing, j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
+	// waiting callers of the queue cache
+	destination_queue_update_callers(
+			ast_json_string_get(ast_json_object_get(j_evt, "queue")),
+			atoi(ast_json_string_get(ast_json_object_get(j_evt, "count")) ? : "0")
+			);
+
+	// agent could be available
+	wakeup_outbound_dialing();
+
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1206,6 +2284,7 @@ static void ami_evt_AgentCalled(struct ast_json* j_evt)
 	AST_JSON_UNREF(j_tmp);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1275,6 +2354,7 @@ static void ami_evt_AgentConnect(struct ast_json* j_evt)
 	AST_JSON_UNREF(j_tmp);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1344,7 +2424,11 @@ static void ami_evt_AgentComplete(struct ast_json* j_evt)
 	rb_dialing_update_event_substitute(dialing, j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
+	// agent could be available
+	wakeup_outbound_dialing();
+
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1419,6 +2503,7 @@ static void ami_evt_DialBegin(struct ast_json* j_evt)
 	rb_dialing_update_status(dialing, E_DIALING_DIAL_BEGIN);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 
 
@@ -1537,6 +2622,7 @@ static void ami_evt_DialEnd(struct ast_json* j_evt)
 	rb_dialing_update_status(dialing, E_DIALING_DIAL_END);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 
 
@@ -1605,7 +2691,8 @@ static void ami_evt_OriginateResponse(struct ast_json* j_evt)
 //		"channel": "SIP/trunk_test_1-00000000",
 //		"context": "",
 //		"exten": "",
-//		"reason": "4"
+//		"reason": "4",
+//		"actionid": "dee9d42f-972c-4f87-b5fb-ff8edf1e6f35"
 //	}
 //
 	const char* uuid;
@@ -1613,6 +2700,7 @@ static void ami_evt_OriginateResponse(struct ast_json* j_evt)
 	char* timestamp;
 	const char* tmp_const;
 	struct ast_json* j_tmp;
+	bool success;
 
 	if(j_evt == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
@@ -1620,13 +2708,19 @@ static void ami_evt_OriginateResponse(struct ast_json* j_evt)
 	}
 
 	// get rb_dialing
-	uuid = ast_json_string_get(ast_json_object_get(j_evt, "uniqueid"));
+	// the ActionID is the dialing uuid. The failed one has no uniqueid.
+	// only the responses of our originates reach here(DEF_AMI_EVT_FLAG_ACTION).
+	uuid = ast_json_string_get(ast_json_object_get(j_evt, "actionid"));
 	dialing = rb_dialing_find_chan_uuid(uuid);
 	if(dialing == NULL) {
 		return;
 	}
 	timestamp = get_utc_timestamp();
 
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "response"));
+	success = ((tmp_const != NULL) && (strcmp(tmp_const, "Success") == 0)) ? true : false;
+	rb_dialing_originate_response(dialing, success);
+
 	ast_log(LOG_DEBUG, "Received originate response. response[%s], reason[%s]\n",
 			ast_json_string_get(ast_json_object_get(j_evt, "response")),
 			ast_json_string_get(ast_json_object_get(j_evt, "reason"))
@@ -1641,8 +2735,8 @@ static void ami_evt_OriginateResponse(struct ast_json* j_evt)
 
 	// update dialing
 	j_tmp = ast_json_object_create();
-	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "reason"));
-	ast_json_object_set(j_tmp, "res_dial", ast_json_integer_create(atoi(tmp_const)));
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "reason")) ? : "0";
+	rb_dialing_update_res_dial(dialing, atoi(tmp_const));
 	ast_json_object_set(j_tmp, "tm_dial_end", ast_json_string_create(timestamp));
 	rb_dialing_update_dialing_update(dialing, j_tmp);
 	AST_JSON_UNREF(j_tmp);
@@ -1651,12 +2745,14 @@ static void ami_evt_OriginateResponse(struct ast_json* j_evt)
 	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "response"));
 	if((tmp_const == NULL) || (strcmp(tmp_const, "Failure") == 0)) {
 		rb_dialing_update_status(dialing, E_DIALING_ERROR);
+		wakeup_outbound_dialing();
 	}
 	else {
 		rb_dialing_update_status(dialing, E_DIALING_ORIGINATE_RESPONSE);
 	}
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
 
@@ -1712,15 +2808,235 @@ static void ami_evt_Hangup(struct ast_json* j_evt)
 	// update dialing
 	j_tmp = ast_json_object_create();
 	ast_json_object_set(j_tmp, "tm_hangup", ast_json_string_create(timestamp));
-	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "cause"));
-	ast_json_object_set(j_tmp, "res_hangup", ast_json_integer_create(atoi(tmp_const)));
-	ast_json_object_set(j_tmp, "res_hangup_detail", ast_json_ref(ast_json_object_get(j_evt, "cause-txt")));
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "cause")) ? : "0";
+
+	// originated by the core and hung up before the answer.
+	// the hangup cause is the originate response.
+	if(rb_dialing_take_originate_pending(dialing) == true) {
+		rb_dialing_originate_response(dialing, false);
+		rb_dialing_update_res_dial(dialing, ami_evt_hangup_cause_to_res_dial(atoi(tmp_const)));
+		ast_json_object_set(j_tmp, "tm_dial_end", ast_json_string_create(timestamp));
+	}
+	rb_dialing_update_res_hangup(dialing, atoi(tmp_const), ast_json_string_get(ast_json_object_get(j_evt, "cause-txt")));
 	rb_dialing_update_dialing_update(dialing, j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
 	// update dialing status
 	rb_dialing_update_status(dialing, E_DIALING_HANGUP);
+	wakeup_outbound_dialing();
+
+	ast_free(timestamp);
+	ao2_ref(dialing, -1);
+	return;
+}
+
+/**
+ * Convert the hangup cause to the originate response reason(res_dial).
+ * Same values with the OriginateResponse's reason.
+ * @param cause
+ * @return
+ */
+static int ami_evt_hangup_cause_to_res_dial(int cause)
+{
+	switch(cause) {
+		case AST_CAUSE_USER_BUSY:
+		{
+			return AST_CONTROL_BUSY;
+		}
+		break;
+
+		case AST_CAUSE_NO_USER_RESPONSE:
+		case AST_CAUSE_NO_ANSWER:
+		{
+			return AST_CONTROL_RINGING;
+		}
+		break;
+
+		case AST_CAUSE_NORMAL_CIRCUIT_CONGESTION:
+		case AST_CAUSE_NETWORK_OUT_OF_ORDER:
+		case AST_CAUSE_SWITCH_CONGESTION:
+		case AST_CAUSE_REQUESTED_CHAN_UNAVAIL:
+		{
+			return AST_CONTROL_CONGESTION;
+		}
+		break;
+
+		default:
+		{
+			return AST_CONTROL_HANGUP;
+		}
+		break;
+	}
+
+	return AST_CONTROL_HANGUP;
+}
+
+static void ami_evt_BridgeEnter(struct ast_json* j_evt)
+{
+//	{
+//		"event": "BridgeEnter",
+//		"privilege": "call,all",
+//		"bridgeuniqueid": "2b6ac9a6-7b50-4e7c-9b1a-4f7a9d7c1e3a",
+//		"bridgetype": "basic",
+//		"bridgetechnology": "simple_bridge",
+//		"bridgecreator": "<unknown>",
+//		"bridgename": "<unknown>",
+//		"bridgenumchannels": "2",
+//		"channel": "SIP/trunk_test_1-00000000",
+//		"channelstate": "6",
+//		"channelstatedesc": "Up",
+//		"calleridnum": "<unknown>",
+//		"calleridname": "<unknown>",
+//		"connectedlinenum": "<unknown>",
+//		"connectedlinename": "<unknown>",
+//		"language": "en",
+//		"accountcode": "",
+//		"context": "from_provider",
+//		"exten": "",
+//		"priority": "1",
+//		"uniqueid": "dee9d42f-972c-4f87-b5fb-ff8edf1e6f35",
+//		"linkedid": "dee9d42f-972c-4f87-b5fb-ff8edf1e6f35"
+//	}
+
+	const char* tmp_const;
+	rb_dialing* dialing;
+	struct ast_json* j_tmp;
+	char* timestamp;
+
+	if(j_evt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return;
+	}
+
+	// get rb_dialing
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "uniqueid"));
+	dialing = rb_dialing_find_chan_uuid(tmp_const);
+	if(dialing == NULL) {
+		return;
+	}
+	timestamp = get_utc_timestamp();
+
+	// append/substitute event
+	j_tmp = ast_json_deep_copy(j_evt);
+	ast_json_object_set(j_tmp, "tm_event", ast_json_string_create(timestamp));
+	rb_dialing_update_events_append(dialing, j_tmp);
+	rb_dialing_update_event_substitute(dialing, j_tmp);
+	AST_JSON_UNREF(j_tmp);
+
+	// update dialing
+	j_tmp = ast_json_object_create();
+	ast_json_object_set(j_tmp, "tm_bridge_enter", ast_json_string_create(timestamp));
+	ast_json_object_set(j_tmp, "bridge_uuid", ast_json_ref(ast_json_object_get(j_evt, "bridgeuniqueid")));
+	rb_dialing_update_dialing_update(dialing, j_tmp);
+	AST_JSON_UNREF(j_tmp);
+
+	ast_free(timestamp);
+	ao2_ref(dialing, -1);
+	return;
+}
+
+/**
+ * Pre-filter of the VarSet.
+ * Runs in the manager event hook.
+ * Passes the AMD result variables(AMDSTATUS, AMDCAUSE) only.
+ * @param content
+ * @return
+ */
+static bool ami_evt_prefilter_VarSet(const char* content)
+{
+	const char* tmp_const;
+	size_t len;
+
+	tmp_const = ami_evt_scan_header(content, "Variable", &len);
+	if(tmp_const == NULL) {
+		return false;
+	}
+
+	if((len == 9) && (strncmp(tmp_const, "AMDSTATUS", len) == 0)) {
+		return true;
+	}
+	if((len == 8) && (strncmp(tmp_const, "AMDCAUSE", len) == 0)) {
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * AMI event handler
+ * Event: VarSet
+ * Keeps the AMD results only.
+ * @param j_evt
+ */
+static void ami_evt_VarSet(struct ast_json* j_evt)
+{
+//	{
+//		"event": "VarSet",
+//		"privilege": "dialplan,all",
+//		"channel": "SIP/trunk_test_1-00000000",
+//		"channelstate": "6",
+//		"channelstatedesc": "Up",
+//		"calleridnum": "<unknown>",
+//		"calleridname": "<unknown>",
+//		"connectedlinenum": "<unknown>",
+//		"connectedlinename": "<unknown>",
+//		"language": "en",
+//		"accountcode": "",
+//		"context": "from_provider",
+//		"exten": "",
+//		"priority": "2",
+//		"uniqueid": "dee9d42f-972c-4f87-b5fb-ff8edf1e6f35",
+//		"linkedid": "dee9d42f-972c-4f87-b5fb-ff8edf1e6f35",
+//		"variable": "AMDSTATUS",
+//		"value": "MACHINE"
+//	}
+
+	const char* tmp_const;
+	const char* key;
+	rb_dialing* dialing;
+	struct ast_json* j_tmp;
+	char* timestamp;
+
+	if(j_evt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return;
+	}
+
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "variable"));
+	if(tmp_const == NULL) {
+		return;
+	}
+	else if(strcmp(tmp_const, "AMDSTATUS") == 0) {
+		key = "amd_status";
+	}
+	else if(strcmp(tmp_const, "AMDCAUSE") == 0) {
+		key = "amd_cause";
+	}
+	else {
+		return;
+	}
+
+	// get rb_dialing
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "uniqueid"));
+	dialing = rb_dialing_find_chan_uuid(tmp_const);
+	if(dialing == NULL) {
+		return;
+	}
+	timestamp = get_utc_timestamp();
+
+	// append event. not a channel status.
+	j_tmp = ast_json_deep_copy(j_evt);
+	ast_json_object_set(j_tmp, "tm_event", ast_json_string_create(timestamp));
+	rb_dialing_update_events_append(dialing, j_tmp);
+	AST_JSON_UNREF(j_tmp);
+
+	// update dialing
+	j_tmp = ast_json_object_create();
+	ast_json_object_set(j_tmp, key, ast_json_ref(ast_json_object_get(j_evt, "value")));
+	rb_dialing_update_dialing_update(dialing, j_tmp);
+	AST_JSON_UNREF(j_tmp);
 
 	ast_free(timestamp);
+	ao2_ref(dialing, -1);
 	return;
 }
@@ -12,16 +12,29 @@
 
 #include <stdbool.h>
 
+/**
+ * AMI event handler.
+ * The keys of the event are lower case.
+ */
+typedef void (*ami_evt_handler_t)(struct ast_json* j_evt);
+
 int init_ami_handle(void);
 void term_ami_handle(void);
 
+void ami_evt_process(struct ast_json* j_evt);
+bool ami_evt_push(struct ast_json* j_evt);
+bool ami_evt_push_content(const char* content);
+bool ami_evt_register_handler(const char* name, ami_evt_handler_t handler);
+struct ast_json* ami_evt_get_stats(void);
+
 struct ast_json* ami_cmd_handler(struct ast_json* j_cmd);
+bool ami_cmd_send_async(struct ast_json* j_cmd);
 bool ami_is_response_success(struct ast_json* j_ami);
 
 struct ast_json* ami_cmd_queue_summary(const char* name);
 struct ast_json* ami_cmd_queue_status(const char* name);
-struct ast_json* ami_cmd_originate_to_application(struct ast_json* j_dial);
-struct ast_json* ami_cmd_originate_to_exten(struct ast_json* j_dial);
+bool ami_cmd_originate_to_application(struct ast_json* j_dial);
+bool ami_cmd_originate_to_exten(struct ast_json* j_dial);
 struct ast_json* ami_cmd_hangup(const char* channel, int cause);
 struct ast_json* ami_cmd_dialplan_extension_add(struct ast_json* j_dialplan);
 struct ast_json* ami_cmd_dialplan_extension_remove(const char* context, const char* extension, const int priority);
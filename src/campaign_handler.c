@@ -21,8 +21,29 @@
 #include "dl_handler.h"
 #include "plan_handler.h"
 
+typedef struct _camp_rq_entry
+{
+	char* uuid;		///< campaign uuid
+	int weight;		///< dialing turns in one round.
+	int priority;	///< higher priority campaign takes turns first in the round.
+	int turns;		///< remain turns in current round.
+	struct ast_json* j_camp;	///< campaign info. read only.
+
+	struct _camp_rq_entry* next;
+} camp_rq_entry;
+
+AST_MUTEX_DEFINE_STATIC(g_camp_rq_mutex);
+static camp_rq_entry* g_camp_rq = NULL;			///< run queue of started campaigns. sorted by priority.
+static camp_rq_entry* g_camp_rq_cur = NULL;		///< current turn of the run queue.
+
 static struct ast_json* get_campaign_deleted(const char* uuid);
 
+static void sync_campaign_rq(struct ast_json* j_camp);
+static void remove_campaign_rq(const char* uuid);
+static void unlink_campaign_rq(const char* uuid);
+static void insert_campaign_rq(camp_rq_entry* entry);
+static void clear_campaign_rq(void);
+
 static bool is_startable_campaign_schedule(struct ast_json* j_camp);
 static bool is_startable_campaign_schedule_day(struct ast_json* j_camp, int day);
 static bool is_startable_campaign_schedule_check(struct ast_json* j_camp, const char* cur_date, const char* cur_time, int cur_day);
@@ -30,6 +51,43 @@ static bool is_stopable_campaign_schedule_day_date_list(struct ast_json* j_camp)
 static bool is_stoppable_campaign_schedule_check(struct ast_json* j_camp, const char* cur_date, const char* cur_time, int cur_day);
 
 
+/**
+ * Initiate campaign run queue.
+ * Loads started campaigns into the run queue.
+ * @return
+ */
+bool init_campaign(void)
+{
+	struct ast_json* j_camps;
+	int i;
+	int size;
+
+	clear_campaign_rq();
+
+	j_camps = get_campaigns_by_status(E_CAMP_START);
+	if(j_camps == NULL) {
+		ast_log(LOG_ERROR, "Could not get started campaigns.\n");
+		return false;
+	}
+
+	size = ast_json_array_size(j_camps);
+	for(i = 0; i < size; i++) {
+		sync_campaign_rq(ast_json_array_get(j_camps, i));
+	}
+	AST_JSON_UNREF(j_camps);
+	ast_log(LOG_NOTICE, "Initiated campaign run queue. count[%d]\n", size);
+
+	return true;
+}
+
+/**
+ * Terminate campaign run queue.
+ */
+void term_campaign(void)
+{
+	clear_campaign_rq();
+}
+
 /**
  * Create campaign.
  * @param j_camp
@@ -68,6 +126,7 @@ bool create_campaign(const struct ast_json* j_camp)
 	// send ami event
 	j_tmp = get_campaign(uuid);
 	ast_free(uuid);
+	sync_campaign_rq(j_tmp);
 	send_manager_evt_out_campaign_create(j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
@@ -109,6 +168,7 @@ bool delete_campaign(const char* uuid)
 		ast_log(LOG_WARNING, "Could not delete campaign. uuid[%s]\n", uuid);
 		return false;
 	}
+	remove_campaign_rq(uuid);
 
 	// send notification
 	j_tmp = get_campaign_deleted(uuid);
@@ -125,8 +185,7 @@ bool delete_campaign(const char* uuid)
 struct ast_json* get_campaign(const char* uuid)
 {
 	struct ast_json* j_res;
-	db_res_t* db_res;
-	char* sql;
+	struct ast_json* j_binds;
 
 	if(uuid == NULL) {
 		return NULL;
@@ -134,17 +193,10 @@ struct ast_json* get_campaign(const char* uuid)
 	ast_log(LOG_DEBUG, "Get campaign info. uuid[%s]\n", uuid);
 
 	// get specified campaign
-	ast_asprintf(&sql, "select * from campaign where uuid=\"%s\" and in_use=%d;", uuid, E_DL_USE_OK);
-
-	db_res = db_query(sql);
-	ast_free(sql);
-	if(db_res == NULL) {
-		ast_log(LOG_WARNING, "Could not get campaign info.\n");
-		return NULL;
-	}
-
-	j_res = db_get_record(db_res);
-	db_free(db_res);
+	// apply the pending updates.
+	j_binds = ast_json_pack("[s, i]", uuid, E_DL_USE_OK);
+	j_res = db_get_row_behind("campaign", uuid, "select * from campaign where uuid=? and in_use=?;", j_binds);
+	AST_JSON_UNREF(j_binds);
 
 	return j_res;
 }
@@ -310,10 +362,11 @@ struct ast_json* get_campaigns_schedule_end(void)
  */
 bool update_campaign(const struct ast_json* j_camp)
 {
+	int ret;
 	char* tmp;
 	const char* tmp_const;
-	char* sql;
 	struct ast_json* j_tmp;
+	struct ast_json* j_conds;
 	char* uuid;
 
 	if(j_camp == NULL) {
@@ -337,27 +390,28 @@ bool update_campaign(const struct ast_json* j_camp)
 	ast_json_object_set(j_tmp, "tm_update", ast_json_string_create(tmp));
 	ast_free(tmp);
 
-	tmp = db_get_update_str(j_tmp);
-	if(tmp == NULL) {
-		ast_log(LOG_WARNING, "Could not get update str.\n");
-		AST_JSON_UNREF(j_tmp);
+	// written in the write-behind transaction.
+	// deleted campaign should not be updated.
+	ast_json_object_del(j_tmp, "uuid");
+	j_conds = ast_json_pack("{s:i}", "in_use", E_DL_USE_OK);
+	ret = db_update_behind("campaign", "uuid", uuid, j_conds, j_tmp);
+	AST_JSON_UNREF(j_conds);
+	AST_JSON_UNREF(j_tmp);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not update campaign info. uuid[%s]\n", uuid);
 		ast_free(uuid);
 		return false;
 	}
-	AST_JSON_UNREF(j_tmp);
-
-	ast_asprintf(&sql, "update campaign set %s where uuid=\"%s\" and in_use=%d;", tmp, uuid, E_DL_USE_OK);
-	ast_free(tmp);
-
-	db_exec(sql);
-	ast_free(sql);
 
 	j_tmp = get_campaign(uuid);
-	ast_free(uuid);
 	if(j_tmp == NULL) {
 		ast_log(LOG_WARNING, "Could not get updated campaign info.\n");
+		remove_campaign_rq(uuid);
+		ast_free(uuid);
 		return false;
 	}
+	ast_free(uuid);
+	sync_campaign_rq(j_tmp);
 	send_manager_evt_out_campaign_update(j_tmp);
 	AST_JSON_UNREF(j_tmp);
 
@@ -401,9 +455,13 @@ bool update_campaign_status(const char* uuid, E_CAMP_STATUS_T status)
 		ast_log(LOG_WARNING, "Could not find campaign. camp_uuid[%s]\n", uuid);
 		return false;
 	}
+	AST_JSON_UNREF(j_tmp);
 
-	// set status
-	ast_json_object_set(j_tmp, "status", ast_json_integer_create(status));
+	// set status only
+	j_tmp = ast_json_pack("{s:s, s:i}",
+			"uuid",		uuid,
+			"status",	status
+			);
 
 	// update
 	ret = update_campaign(j_tmp);
@@ -412,6 +470,7 @@ bool update_campaign_status(const char* uuid, E_CAMP_STATUS_T status)
 		ast_log(LOG_ERROR, "Could not update campaign status. camp_uuid[%s], status[%d]", uuid, status);
 		return false;
 	}
+	wakeup_outbound_campaign();
 
 	return true;
 }
@@ -454,34 +513,208 @@ struct ast_json* get_campaigns_by_status(E_CAMP_STATUS_T status)
 
 /**
  * Get campaign for dialing.
+ * Picks the next started campaign from the run queue by weighted round robin.
+ * Each campaign takes weight turns in a round, higher priority campaign first.
+ * Unused turns are not carried over to the next round.
  * @return
  */
 struct ast_json* get_campaign_for_dialing(void)
 {
+	camp_rq_entry* entry;
 	struct ast_json* j_res;
-	db_res_t* db_res;
-	char* sql;
 
-	// get "start" status campaign only.
-	ast_asprintf(&sql, "select * from campaign where status = %d and in_use = %d order by %s limit 1;",
-			E_CAMP_START,
-			E_DL_USE_OK,
-			db_translate_function(E_FUNC_RANDOM)
-			);
-
-	db_res = db_query(sql);
-	ast_free(sql);
-	if(db_res == NULL) {
-		ast_log(LOG_WARNING, "Could not get campaign info.\n");
+	ast_mutex_lock(&g_camp_rq_mutex);
+	if(g_camp_rq == NULL) {
+		ast_mutex_unlock(&g_camp_rq_mutex);
 		return NULL;
 	}
 
-	j_res = db_get_record(db_res);
-	db_free(db_res);
+	entry = g_camp_rq_cur;
+	if((entry == NULL) || (entry->turns <= 0)) {
+		// next turn
+		if((entry == NULL) || (entry->next == NULL)) {
+			entry = g_camp_rq;
+		}
+		else {
+			entry = entry->next;
+		}
+		entry->turns = entry->weight;
+		g_camp_rq_cur = entry;
+	}
+	entry->turns--;
+	j_res = ast_json_ref(entry->j_camp);
+	ast_mutex_unlock(&g_camp_rq_mutex);
 
 	return j_res;
 }
 
+/**
+ * Get the number of dialing turns in one round of the run queue.
+ * @return sum of the started campaigns weight
+ */
+int get_campaign_rq_round_size(void)
+{
+	camp_rq_entry* entry;
+	int size;
+
+	size = 0;
+	ast_mutex_lock(&g_camp_rq_mutex);
+	for(entry = g_camp_rq; entry != NULL; entry = entry->next) {
+		size += entry->weight;
+	}
+	ast_mutex_unlock(&g_camp_rq_mutex);
+
+	return size;
+}
+
+/**
+ * Sync the run queue with the given campaign info.
+ * Started campaign is added(or updated), otherwise removed.
+ * @param j_camp
+ */
+static void sync_campaign_rq(struct ast_json* j_camp)
+{
+	camp_rq_entry* entry;
+	const char* uuid;
+	int status;
+	int in_use;
+	int weight;
+
+	uuid = ast_json_string_get(ast_json_object_get(j_camp, "uuid"));
+	if(uuid == NULL) {
+		return;
+	}
+
+	// not started or being removed
+	status = ast_json_integer_get(ast_json_object_get(j_camp, "status"));
+	in_use = (ast_json_object_get(j_camp, "in_use") != NULL)? ast_json_integer_get(ast_json_object_get(j_camp, "in_use")) : E_DL_USE_OK;
+	if((status != E_CAMP_START) || (in_use == E_DL_USE_NO)) {
+		remove_campaign_rq(uuid);
+		return;
+	}
+
+	weight = ast_json_integer_get(ast_json_object_get(j_camp, "weight"));
+	if(weight <= 0) {
+		weight = 1;
+	}
+
+	entry = ast_calloc(1, sizeof(camp_rq_entry));
+	entry->uuid = ast_strdup(uuid);
+	entry->weight = weight;
+	entry->priority = ast_json_integer_get(ast_json_object_get(j_camp, "priority"));
+	entry->turns = 0;
+	entry->j_camp = ast_json_deep_copy(j_camp);
+	entry->next = NULL;
+
+	ast_mutex_lock(&g_camp_rq_mutex);
+	unlink_campaign_rq(uuid);
+	insert_campaign_rq(entry);
+	ast_log(LOG_DEBUG, "Updated campaign run queue. uuid[%s], weight[%d], priority[%d]\n",
+			entry->uuid, entry->weight, entry->priority
+			);
+	ast_mutex_unlock(&g_camp_rq_mutex);
+
+	return;
+}
+
+/**
+ * Insert entry into the run queue.
+ * Keep the priority order. Same priority entry goes to the end.
+ * Caller should hold g_camp_rq_mutex.
+ * @param entry
+ */
+static void insert_campaign_rq(camp_rq_entry* entry)
+{
+	camp_rq_entry** pos;
+
+	pos = &g_camp_rq;
+	while((*pos != NULL) && ((*pos)->priority >= entry->priority)) {
+		pos = &(*pos)->next;
+	}
+	entry->next = *pos;
+	*pos = entry;
+
+	return;
+}
+
+/**
+ * Remove campaign from the run queue.
+ * @param uuid
+ */
+static void remove_campaign_rq(const char* uuid)
+{
+	if(uuid == NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_camp_rq_mutex);
+	unlink_campaign_rq(uuid);
+	ast_mutex_unlock(&g_camp_rq_mutex);
+
+	return;
+}
+
+/**
+ * Unlink and release the campaign entry from the run queue.
+ * Caller should hold g_camp_rq_mutex.
+ * @param uuid
+ */
+static void unlink_campaign_rq(const char* uuid)
+{
+	camp_rq_entry** pos;
+	camp_rq_entry* prev;
+	camp_rq_entry* entry;
+
+	prev = NULL;
+	pos = &g_camp_rq;
+	while(*pos != NULL) {
+		entry = *pos;
+		if(strcmp(entry->uuid, uuid) != 0) {
+			prev = entry;
+			pos = &entry->next;
+			continue;
+		}
+
+		*pos = entry->next;
+		if(g_camp_rq_cur == entry) {
+			// give the turn to the next entry.
+			g_camp_rq_cur = prev;
+			if(prev != NULL) {
+				prev->turns = 0;
+			}
+		}
+
+		AST_JSON_UNREF(entry->j_camp);
+		ast_free(entry->uuid);
+		ast_free(entry);
+		break;
+	}
+
+	return;
+}
+
+/**
+ * Release all of run queue entries.
+ */
+static void clear_campaign_rq(void)
+{
+	camp_rq_entry* entry;
+
+	ast_mutex_lock(&g_camp_rq_mutex);
+	while(g_camp_rq != NULL) {
+		entry = g_camp_rq;
+		g_camp_rq = entry->next;
+
+		AST_JSON_UNREF(entry->j_camp);
+		ast_free(entry->uuid);
+		ast_free(entry);
+	}
+	g_camp_rq_cur = NULL;
+	ast_mutex_unlock(&g_camp_rq_mutex);
+
+	return;
+}
+
 /**
  *
  * \param uuid
@@ -593,7 +826,6 @@ bool is_stoppable_campgain(struct ast_json* j_camp)
 {
 	struct ao2_iterator iter;
 	rb_dialing* dialing;
-	const char* tmp_const;
 	bool flg_dialing;
 	int ret;
 
@@ -611,12 +843,11 @@ bool is_stoppable_campgain(struct ast_json* j_camp)
 			break;
 		}
 
-		tmp_const = ast_json_string_get(ast_json_object_get(dialing->j_dialing, "camp_uuid"));
-		if(tmp_const == NULL) {
+		if(dialing->camp_uuid == NULL) {
 			continue;
 		}
 
-		ret = strcmp(tmp_const, ast_json_string_get(ast_json_object_get(j_camp, "uuid")));
+		ret = strcmp(dialing->camp_uuid, ast_json_string_get(ast_json_object_get(j_camp, "uuid")));
 		if(ret == 0) {
 			ast_log(LOG_NOTICE, "Found active call. dialing-uuid[%s], dialing-name[%s]\n",
 					dialing->uuid, dialing->name
@@ -37,6 +37,9 @@ typedef enum _E_CAMP_SCHEDULE_MODE
 	E_CAMP_SCHEDULE_ON  = 1,
 } E_CAMP_SCHEDULE_MODE;
 
+bool init_campaign(void);
+void term_campaign(void);
+
 bool create_campaign(const struct ast_json* j_camp);
 bool delete_campaign(const char* uuid);
 bool update_campaign(const struct ast_json* j_camp);
@@ -48,6 +51,7 @@ struct ast_json* get_campaigns_schedule_end(void);
 struct ast_json* get_campaign(const char* uuid);
 struct ast_json* get_campaigns_by_status(E_CAMP_STATUS_T status);
 struct ast_json* get_campaign_for_dialing(void);
+int get_campaign_rq_round_size(void);
 struct ast_json* get_campaign_stat(const char* uuid);
 struct ast_json* get_campaigns_stat_all(void);
 
@@ -23,6 +23,7 @@
 #include "plan_handler.h"
 #include "queue_handler.h"
 #include "destination_handler.h"
+#include "ami_handler.h"
 #include "utils.h"
 
 /*** DOCUMENTATION
@@ -219,13 +220,14 @@ static char *out_show_campaign(struct ast_cli_entry *e, int cmd, struct ast_cli_
 	return _out_show_campaign(a->fd, NULL, NULL, NULL, a->argc, (const char**)a->argv);
 }
 
-#define PLANS_FORMAT2 "%-36.36s %-20.20s %-20.20s %-8.8s %-11.11s %-10.10s %-10.10s\n"
-#define PLANS_FORMAT3 "%-36.36s %-20.20s %-20.20s %8"PRIdMAX" %11"PRIdMAX" %-10.10s %-10.10s\n"
+#define PLANS_FORMAT2 "%-36.36s %-20.20s %-20.20s %-8.8s %-11.11s %-10.10s %-10.10s %-7.7s %-12.12s\n"
+#define PLANS_FORMAT3 "%-36.36s %-20.20s %-20.20s %8"PRIdMAX" %11"PRIdMAX" %-10.10s %-10.10s %7d %12d\n"
 
 static char* _out_show_plans(int fd, int *total, struct mansession *s, const struct message *m, int argc, const char *argv[])
 {
 	struct ast_json* j_res;
 	struct ast_json* j_tmp;
+	const char* trunk_name;
 	int size;
 	int i;
 
@@ -233,7 +235,7 @@ static char* _out_show_plans(int fd, int *total, struct mansession *s, const str
 
 	if (!s) {
 		/* Normal list */
-		ast_cli(fd, PLANS_FORMAT2, "Uuid", "Name", "Detail", "DialMode", "DialTimeout", "TrunkName", "TechName");
+		ast_cli(fd, PLANS_FORMAT2, "Uuid", "Name", "Detail", "DialMode", "DialTimeout", "TrunkName", "TechName", "Dialing", "TrunkDialing");
 	}
 
 	size = ast_json_array_size(j_res);
@@ -242,14 +244,17 @@ static char* _out_show_plans(int fd, int *total, struct mansession *s, const str
 		if(j_tmp == NULL) {
 			continue;
 		}
+		trunk_name = ast_json_string_get(ast_json_object_get(j_tmp, "trunk_name"));
 		ast_cli(fd, PLANS_FORMAT3,
 				ast_json_string_get(ast_json_object_get(j_tmp, "uuid")) ? : "",
 				ast_json_string_get(ast_json_object_get(j_tmp, "name")) ? : "",
 				ast_json_string_get(ast_json_object_get(j_tmp, "detail")) ? : "",
 				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_mode")),
 				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_timeout")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "trunk_name")) ? : "",
-				ast_json_string_get(ast_json_object_get(j_tmp, "tech_name")) ? : ""
+				trunk_name ? : "",
+				ast_json_string_get(ast_json_object_get(j_tmp, "tech_name")) ? : "",
+				rb_dialing_get_count_by_plan_uuid(ast_json_string_get(ast_json_object_get(j_tmp, "uuid")) ? : ""),
+				trunk_name ? rb_dialing_get_count_by_trunk_name(trunk_name) : 0
 				);
 	}
 	AST_JSON_UNREF(j_res);
@@ -511,6 +516,161 @@ static char *out_show_dialing(struct ast_cli_entry *e, int cmd, struct ast_cli_a
 	return _out_show_dialing(a->fd, NULL, NULL, NULL, a->argc, (const char**)a->argv);
 }
 
+#define AMI_EVTS_FORMAT2 "%-20.20s %-4.4s %10.10s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s\n"
+#define AMI_EVTS_FORMAT3 "%-20.20s %-4.4s %10"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX"\n"
+
+static char* _out_show_ami(int fd, int *total, struct mansession *s, const struct message *m, int argc, const char *argv[])
+{
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+	struct ast_json* j_hist;
+	int size;
+	int i;
+
+	if(argc != 3) {
+		return NULL;
+	}
+
+	j_res = ami_evt_get_stats();
+	if(j_res == NULL) {
+		return CLI_FAILURE;
+	}
+
+	ast_cli(fd, "Event worker\n");
+	ast_cli(fd, "  Source:           %s\n", ast_json_string_get(ast_json_object_get(j_res, "source")) ? : "");
+	ast_cli(fd, "  Queue size:       %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "size")));
+	ast_cli(fd, "  Queue used:       %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "used")));
+	ast_cli(fd, "  High water:       %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "high_water")));
+	ast_cli(fd, "  Policy:           %s\n", ast_json_string_get(ast_json_object_get(j_res, "policy")) ? : "");
+	ast_cli(fd, "  Wait(ms):         %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "wait")));
+	ast_cli(fd, "  Slot length:      %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "slot_len")));
+	ast_cli(fd, "  Pushed:           %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "pushed")));
+	ast_cli(fd, "  Processed:        %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "processed")));
+	ast_cli(fd, "  Waited:           %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "waited")));
+	ast_cli(fd, "  Dropped full:     %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "dropped_full")));
+	ast_cli(fd, "  Dropped oversize: %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "dropped_oversize")));
+
+	// events
+	ast_cli(fd, "\n");
+	ast_cli(fd, AMI_EVTS_FORMAT2, "Event", "Reg", "Count", "Avg(us)", "Max(us)", "<10us", "<100us", "<1ms", "<10ms", "<100ms", ">=100ms");
+	size = ast_json_array_size(ast_json_object_get(j_res, "events"));
+	for(i = 0; i < size; i++) {
+		j_tmp = ast_json_array_get(ast_json_object_get(j_res, "events"), i);
+		if(j_tmp == NULL) {
+			continue;
+		}
+		j_hist = ast_json_object_get(j_tmp, "hist");
+		ast_cli(fd, AMI_EVTS_FORMAT3,
+				ast_json_string_get(ast_json_object_get(j_tmp, "name")) ? : "",
+				ast_json_is_true(ast_json_object_get(j_tmp, "registered")) ? "yes" : "no",
+				ast_json_integer_get(ast_json_object_get(j_tmp, "count")),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "avg_us")),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "max_us")),
+				ast_json_integer_get(ast_json_array_get(j_hist, 0)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 1)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 2)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 3)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 4)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 5))
+				);
+	}
+	AST_JSON_UNREF(j_res);
+
+	return CLI_SUCCESS;
+}
+
+/*! \brief CLI for show ami.
+ */
+static char *out_show_ami(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+
+	if (cmd == CLI_INIT) {
+		e->command = "out show ami";
+		e->usage =
+			"Usage: out show ami\n"
+			"	   Show ami event worker stats and the event handler stats.\n";
+		return NULL;
+	} else if (cmd == CLI_GENERATE) {
+		return NULL;
+	}
+	return _out_show_ami(a->fd, NULL, NULL, NULL, a->argc, (const char**)a->argv);
+}
+
+#define ORIGINATES_FORMAT2 "%-20.20s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s %8.8s\n"
+#define ORIGINATES_FORMAT3 "%-20.20s %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX" %8"PRIdMAX"\n"
+
+static char* _out_show_originate(int fd, int *total, struct mansession *s, const struct message *m, int argc, const char *argv[])
+{
+	struct ast_json* j_res;
+	struct ast_json* j_trunks;
+	struct ast_json* j_tmp;
+	struct ast_json* j_hist;
+	struct ast_json_iter* j_iter;
+	intmax_t responded;
+
+	if(argc != 3) {
+		return NULL;
+	}
+
+	j_res = rb_dialing_get_originate_stats();
+	if(j_res == NULL) {
+		return CLI_FAILURE;
+	}
+
+	ast_cli(fd, "Originate window\n");
+	ast_cli(fd, "  Window:      %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "window")));
+	ast_cli(fd, "  Outstanding: %"PRIdMAX"\n", ast_json_integer_get(ast_json_object_get(j_res, "outstanding")));
+
+	// trunks
+	ast_cli(fd, "\n");
+	ast_cli(fd, ORIGINATES_FORMAT2, "Trunk", "Submit", "Success", "Failure", "Lost", "Pending", "Avg(ms)", "Max(ms)", "<100ms", "<1s", "<5s", "<15s", "<30s", ">=30s");
+	j_trunks = ast_json_object_get(j_res, "trunks");
+	for(j_iter = ast_json_object_iter(j_trunks);
+			j_iter != NULL;
+			j_iter = ast_json_object_iter_next(j_trunks, j_iter))
+	{
+		j_tmp = ast_json_object_iter_value(j_iter);
+		j_hist = ast_json_object_get(j_tmp, "latency_hist");
+		responded = ast_json_integer_get(ast_json_object_get(j_tmp, "success")) + ast_json_integer_get(ast_json_object_get(j_tmp, "failure"));
+		ast_cli(fd, ORIGINATES_FORMAT3,
+				ast_json_object_iter_key(j_iter),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "submitted")),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "success")),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "failure")),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "lost")),
+				ast_json_integer_get(ast_json_object_get(j_tmp, "outstanding")),
+				(responded > 0) ? ast_json_integer_get(ast_json_object_get(j_tmp, "latency_total")) / responded : 0,
+				ast_json_integer_get(ast_json_object_get(j_tmp, "latency_max")),
+				ast_json_integer_get(ast_json_array_get(j_hist, 0)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 1)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 2)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 3)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 4)),
+				ast_json_integer_get(ast_json_array_get(j_hist, 5))
+				);
+	}
+	AST_JSON_UNREF(j_res);
+
+	return CLI_SUCCESS;
+}
+
+/*! \brief CLI for show originate.
+ */
+static char *out_show_originate(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+
+	if (cmd == CLI_INIT) {
+		e->command = "out show originate";
+		e->usage =
+			"Usage: out show originate\n"
+			"	   Show originate window and the submit to response latency of each trunk.\n";
+		return NULL;
+	} else if (cmd == CLI_GENERATE) {
+		return NULL;
+	}
+	return _out_show_originate(a->fd, NULL, NULL, NULL, a->argc, (const char**)a->argv);
+}
+
 #define DL_LIST_FORMAT2 "%-36.36s %-10.10s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s\n"
 #define DL_LIST_FORMAT3 "%-36.36s %-10.10s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s %-20.20s\n"
 
@@ -716,8 +876,8 @@ static char *out_show_destination(struct ast_cli_entry *e, int cmd, struct ast_c
 	return _out_show_destination(a->fd, NULL, NULL, NULL, a->argc, (const char**)a->argv);
 }
 
-#define DESTS_FORMAT2 "%-36.36s %-10.10s %-20.20s %-5.5s %-10.10s %-10.10s %-10.10s %-10.10s\n"
-#define DESTS_FORMAT3 "%-36.36s %-10.10s %-20.20s %5"PRIdMAX" %-10.10s %-10.10s %-10.10s %-10.10s\n"
+#define DESTS_FORMAT2 "%-36.36s %-10.10s %-20.20s %-5.5s %-10.10s %-10.10s %-10.10s %-10.10s %-7.7s\n"
+#define DESTS_FORMAT3 "%-36.36s %-10.10s %-20.20s %5"PRIdMAX" %-10.10s %-10.10s %-10.10s %-10.10s %7d\n"
 
 static char* _out_show_destinations(int fd, int *total, struct mansession *s, const struct message *m, int argc, const char *argv[])
 {
@@ -728,7 +888,7 @@ static char* _out_show_destinations(int fd, int *total, struct mansession *s, co
 
 	if(!s) {
 		/* Normal list */
-		ast_cli(fd, DESTS_FORMAT2, "Uuid", "Name", "Detail", "Type", "Exten", "Context", "Application", "Data");
+		ast_cli(fd, DESTS_FORMAT2, "Uuid", "Name", "Detail", "Type", "Exten", "Context", "Application", "Data", "Dialing");
 	}
 
 	j_res = get_destinations_all();
@@ -747,7 +907,8 @@ static char* _out_show_destinations(int fd, int *total, struct mansession *s, co
 				ast_json_string_get(ast_json_object_get(j_tmp, "exten")) ? : "",
 				ast_json_string_get(ast_json_object_get(j_tmp, "context")) ? : "",
 				ast_json_string_get(ast_json_object_get(j_tmp, "application")) ? : "",
-				ast_json_string_get(ast_json_object_get(j_tmp, "data")) ? : ""
+				ast_json_string_get(ast_json_object_get(j_tmp, "data")) ? : "",
+				rb_dialing_get_count_by_dest_uuid(ast_json_string_get(ast_json_object_get(j_tmp, "uuid")) ? : "")
 				);
 	}
 	AST_JSON_UNREF(j_res);
@@ -867,6 +1028,8 @@ static char* get_campaign_str(struct ast_json* j_camp)
 			"Plan: %s\r\n"
 			"Dlma: %s\r\n"
 			"Dest: %s\r\n"
+			"Weight: %"PRIdMAX"\r\n"
+			"Priority: %"PRIdMAX"\r\n"
 
 			"ScMode: %"PRIdMAX"\r\n"
 			"ScTimeStart: %s\r\n"
@@ -888,6 +1051,8 @@ static char* get_campaign_str(struct ast_json* j_camp)
 			ast_json_string_get(ast_json_object_get(j_camp, "plan"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(j_camp, "dlma"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(j_camp, "dest"))? : "<unknown>",
+			ast_json_integer_get(ast_json_object_get(j_camp, "weight")),
+			ast_json_integer_get(ast_json_object_get(j_camp, "priority")),
 
 			ast_json_integer_get(ast_json_object_get(j_camp, "sc_mode")),
 			ast_json_string_get(ast_json_object_get(j_camp, "sc_time_start"))? : "<unknown>",
@@ -969,6 +1134,7 @@ static char* get_plan_str(struct ast_json* j_plan)
 			"RetryDelay: %"PRIdMAX"\r\n"
 			"TrunkName: %s\r\n"
 			"TechName: %s\r\n"
+			"OriginateBackend: %"PRIdMAX"\r\n"
 			"%s"// Variables
 
 			"MaxRetryCnt1: %"PRIdMAX"\r\n"
@@ -994,6 +1160,7 @@ static char* get_plan_str(struct ast_json* j_plan)
 			ast_json_integer_get(ast_json_object_get(j_plan, "retry_delay")),
 			ast_json_string_get(ast_json_object_get(j_plan, "trunk_name"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(j_plan, "tech_name"))? : "<unknown>",
+			ast_json_integer_get(ast_json_object_get(j_plan, "originate_backend")),
 			variables? : "Variable: <unknown>\r\n",
 
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_1")),
@@ -1106,11 +1273,11 @@ static char* get_dialing_str(const rb_dialing* dialing)
 			"DlListUuid: %s\r\n"	// todo: need to do more...
 
 			// dial info
-			"DialIndex: %"PRIdMAX"\r\n"
+			"DialIndex: %d\r\n"
 			"DialAddr: %s\r\n"
 			"DialChannel: %s\r\n"
-			"DialTryCnt: %"PRIdMAX"\r\n"
-			"DialTimeout: %"PRIdMAX"\r\n"
+			"DialTryCnt: %d\r\n"
+			"DialTimeout: %d\r\n"
 			"DialType: %"PRIdMAX"\r\n"
 			"DialExten: %s\r\n"
 			"DialContext: %s\r\n"
@@ -1122,8 +1289,8 @@ static char* get_dialing_str(const rb_dialing* dialing)
 			"ChannelName: %s\r\n"
 
 			// dial result
-			"ResDial: %"PRIdMAX"\r\n"
-			"ResHangup: %"PRIdMAX"\r\n"
+			"ResDial: %d\r\n"
+			"ResHangup: %d\r\n"
 			"ResHangupDetail: %s\r\n"
 
 			// tm info
@@ -1136,18 +1303,18 @@ static char* get_dialing_str(const rb_dialing* dialing)
 			dialing->status,
 
 			// uuid info
-			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "camp_uuid"))? : "<unknown>",
-			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "plan_uuid"))? : "<unknown>",
-			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dlma_uuid"))? : "<unknown>",
-			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dest_uuid"))? : "<unknown>",
-			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid"))? : "<unknown>",
+			dialing->camp_uuid? : "<unknown>",
+			dialing->plan_uuid? : "<unknown>",
+			dialing->dlma_uuid? : "<unknown>",
+			dialing->dest_uuid? : "<unknown>",
+			dialing->dl_list_uuid? : "<unknown>",
 
 			// dial info
-			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "dial_index")),
+			dialing->dial_index,
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dial_addr"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dial_channel"))? : "<unknown>",
-			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "dial_trycnt")),
-			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "dial_timeout")),
+			dialing->dial_trycnt,
+			dialing->dial_timeout,
 			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "dial_type")),
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dial_exten"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dial_context"))? : "<unknown>",
@@ -1159,9 +1326,9 @@ static char* get_dialing_str(const rb_dialing* dialing)
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "channel_name"))? : "<unknown>",
 
 			// result info
-			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "res_dial")),
-			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "res_hangup")),
-			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "res_hangup_detail"))? : "<unknown>",
+			dialing->res_dial,
+			dialing->res_hangup,
+			dialing->res_hangup_detail? : "<unknown>",
 
 			// tm info
 			dialing->tm_create? : "<unknown>",
@@ -1183,8 +1350,14 @@ static char* get_dialing_summary_str(void)
 	char* tmp;
 
 	ast_asprintf(&tmp,
-			"Count: %d\r\n",
-			rb_dialing_get_count()
+			"Count: %d\r\n"
+			"WatchdogOriginate: %d\r\n"
+			"WatchdogCall: %d\r\n"
+			"OriginateOutstanding: %d\r\n",
+			rb_dialing_get_count(),
+			rb_dialing_get_watchdog_reaped(E_DIALING_DEADLINE_ORIGINATE),
+			rb_dialing_get_watchdog_reaped(E_DIALING_DEADLINE_CALL),
+			rb_dialing_get_originate_outstanding()
 			);
 	return tmp;
 }
@@ -1299,6 +1472,7 @@ static char* get_destination_str(struct ast_json* j_dest)
 {
 	char* tmp;
 	char* variables;
+	char* available;
 
 
 	if(j_dest == NULL) {
@@ -1308,6 +1482,14 @@ static char* get_destination_str(struct ast_json* j_dest)
 	// get variables
 	variables = get_variables_info_ami_str(j_dest, "variables");
 
+	// available count. given by the OutDestinationShow with the uuid only.
+	if(ast_json_object_get(j_dest, "available_count") != NULL) {
+		ast_asprintf(&available, "AvailableCount: %"PRIdMAX"\r\n", ast_json_integer_get(ast_json_object_get(j_dest, "available_count")));
+	}
+	else {
+		ast_asprintf(&available, "%s", "");
+	}
+
 	ast_asprintf(&tmp,
 			"Uuid: %s\r\n"
 			"Name: %s\r\n"
@@ -1325,7 +1507,8 @@ static char* get_destination_str(struct ast_json* j_dest)
 
 			"TmCreate: %s\r\n"
 			"TmDelete: %s\r\n"
-			"TmUpdate: %s\r\n",
+			"TmUpdate: %s\r\n"
+			"%s",	// AvailableCount
 
 			ast_json_string_get(ast_json_object_get(j_dest, "uuid"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(j_dest, "name"))? : "<unknown>",
@@ -1343,9 +1526,11 @@ static char* get_destination_str(struct ast_json* j_dest)
 
 			ast_json_string_get(ast_json_object_get(j_dest, "tm_create"))? : "<unknown>",
 			ast_json_string_get(ast_json_object_get(j_dest, "tm_delete"))? : "<unknown>",
-			ast_json_string_get(ast_json_object_get(j_dest, "tm_update"))? : "<unknown>"
+			ast_json_string_get(ast_json_object_get(j_dest, "tm_update"))? : "<unknown>",
+			available
 			);
 	ast_free(variables);
+	ast_free(available);
 
 	ast_log(LOG_VERBOSE, "Value check. created plan string. str[%s]\n", tmp);
 	return tmp;
@@ -1413,6 +1598,11 @@ static struct ast_json* create_json_plan(const struct message* m)
 		ast_json_object_set(j_tmp, "service_level", ast_json_integer_create(atoi(tmp_const)));
 	}
 
+	tmp_const = message_get_header(m, "OriginateBackend");
+	if(tmp_const != NULL) {
+		ast_json_object_set(j_tmp, "originate_backend", ast_json_integer_create(atoi(tmp_const)));
+	}
+
 	tmp_const = message_get_header(m, "MaxRetry1");
 	if(tmp_const != NULL) {
 		ast_json_object_set(j_tmp, "max_retry_cnt_1", ast_json_integer_create(atoi(tmp_const)));
@@ -1559,6 +1749,12 @@ static struct ast_json* create_json_campaign(const struct message* m)
 	tmp_const = message_get_header(m, "Dest");
 	if(tmp_const != NULL) {ast_json_object_set(j_tmp, "dest", ast_json_string_create(tmp_const));}
 
+	tmp_const = message_get_header(m, "Weight");
+	if(tmp_const != NULL) {ast_json_object_set(j_tmp, "weight", ast_json_integer_create(atoi(tmp_const)));}
+
+	tmp_const = message_get_header(m, "Priority");
+	if(tmp_const != NULL) {ast_json_object_set(j_tmp, "priority", ast_json_integer_create(atoi(tmp_const)));}
+
 	tmp_const = message_get_header(m, "ScMode");
 	if(tmp_const != NULL) {ast_json_object_set(j_tmp, "sc_mode", ast_json_integer_create(atoi(tmp_const)));}
 
@@ -3453,6 +3649,7 @@ static int manager_out_dialing_show(struct mansession *s, const struct message *
 		}
 
 		manager_evt_out_dialing_entry(s, m, dialing, action_id);
+		ao2_ref(dialing, -1);
 		astman_send_list_complete_start(s, m, "OutDialingListComplete", 1);
 		astman_send_list_complete_end(s);
 	}
@@ -3650,6 +3847,7 @@ static int manager_out_destination_show(struct mansession *s, const struct messa
 			ast_free(action_id);
 			return 0;
 		}
+		ast_json_object_set(j_tmp, "available_count", ast_json_integer_create(get_destination_available_count(j_tmp)));
 
 		astman_send_listack(s, m, "Destination List will follow", "start");
 
@@ -3742,6 +3940,9 @@ struct ast_cli_entry cli_out[] = {
 	AST_CLI_DEFINE(out_show_dialings,			"List currently on serviced dialings"),
 	AST_CLI_DEFINE(out_show_dialing,			"Show detail given dialing info"),
 
+	AST_CLI_DEFINE(out_show_ami,				"Show ami event worker stats"),
+	AST_CLI_DEFINE(out_show_originate,		"Show originate window and latency stats"),
+
 	AST_CLI_DEFINE(out_set_campaign,			"Set campaign parameters"),
 	AST_CLI_DEFINE(out_create_campaign,		"Create new campaign"),
 	AST_CLI_DEFINE(out_delete_campaign,		"Delete campaign")
@@ -13,6 +13,7 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <ctype.h>
 //#include <mysql/mysql.h>
 
 #include "asterisk/utils.h"
@@ -20,10 +21,18 @@
 #include "asterisk/json.h"
 #include "asterisk/lock.h"
 
+#include <event2/event.h>
+
 #include "res_outbound.h"
 #include "db_sqlite3_handler.h"
 //#include "db_mysql_handler.h"
 #include "db_handler.h"
+#include "event_handler.h"
+#include "utils.h"
+
+#define DEF_DB_WRITE_BEHIND_DELAY	"100"
+#define DEF_DB_WRITE_BEHIND_MAX		"100"
+#define DEF_DB_WRITE_BEHIND_RETRY	3		///< give up the pending update after this many failed writes.
 
 
 /**
@@ -38,6 +47,32 @@ typedef enum _E_DB_TYPE
 
 E_DB_TYPE g_db_type = E_DB_NONE;
 
+AST_MUTEX_DEFINE_STATIC(g_behind_mutex);
+static struct ast_json* g_j_behinds = NULL;	///< pending updates. key:table/key_value
+static int g_behind_delay = 0;				///< write-behind flush delay(ms). 0 is disabled.
+static int g_behind_max = 0;					///< flush when the pending updates reach this count.
+static bool g_behind_scheduled = false;		///< flush event scheduled.
+
+static db_res_t* db_query_raw(const char* query);
+static bool db_exec_raw(const char* query);
+static db_res_t* db_query_bind_raw(const char* query, struct ast_json* j_binds);
+static bool db_exec_bind_raw(const char* query, struct ast_json* j_binds);
+static struct ast_json* db_get_record_raw(db_res_t* ctx);
+
+static int get_behind_option(struct ast_json* j_database, const char* name, const char* def);
+static char* create_behind_key(const char* table, const char* key_value);
+static char* get_behind_cond_str(const struct ast_json* j_conds, struct ast_json* j_binds);
+static void apply_behind(const char* table, const char* key_value, struct ast_json* j_record);
+static bool overlay_behind(const char* table, const char* key_value, struct ast_json* j_record, const char* where);
+static const char* find_query_word(const char* query, const char* word);
+static bool is_behind_row_query(const char* query, struct ast_json* j_binds, struct ast_json* j_behind);
+static void sync_behind(const char* query, struct ast_json* j_binds);
+static struct ast_json* get_behind_overlays(const char* query);
+static bool flush_behind(void);
+static bool flush_behind_keys(struct ast_json* j_keys);
+static bool schedule_flush_behind(void);
+static void cb_flush_behind(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
+
 
 
 const char* g_db_func[3][1] =
@@ -86,6 +121,15 @@ bool db_init(void)
 	ret = atoi(tmp_const);
 	set_db_type(ret);
 
+	// write-behind
+	g_behind_delay = get_behind_option(j_database, "db_write_behind_delay", DEF_DB_WRITE_BEHIND_DELAY);
+	g_behind_max = get_behind_option(j_database, "db_write_behind_max", DEF_DB_WRITE_BEHIND_MAX);
+	ast_mutex_lock(&g_behind_mutex);
+	if(g_j_behinds == NULL) {
+		g_j_behinds = ast_json_object_create();
+	}
+	ast_mutex_unlock(&g_behind_mutex);
+
 	// get db type
 	type = get_db_type();
 
@@ -119,6 +163,15 @@ void db_exit(void)
 {
 	E_DB_TYPE type;
 
+	// write pending updates.
+	ast_mutex_lock(&g_behind_mutex);
+	flush_behind();
+	if((g_j_behinds != NULL) && (ast_json_object_size(g_j_behinds) > 0)) {
+		ast_log(LOG_ERROR, "Could not write the pending updates. Discarded. count[%zu]\n", ast_json_object_size(g_j_behinds));
+	}
+	AST_JSON_UNREF(g_j_behinds);
+	ast_mutex_unlock(&g_behind_mutex);
+
 	type = get_db_type();
 
 	switch(type) {
@@ -147,13 +200,39 @@ void db_exit(void)
  */
 db_res_t* db_query(const char* query)
 {
-	E_DB_TYPE type;
+	db_res_t* db_res;
+	struct ast_json* j_overlays;
 
 	if(query == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return NULL;
 	}
 
+	// read-your-writes
+	ast_mutex_lock(&g_behind_mutex);
+	sync_behind(query, NULL);
+	j_overlays = get_behind_overlays(query);
+	ast_mutex_unlock(&g_behind_mutex);
+
+	db_res = db_query_raw(query);
+	if(db_res == NULL) {
+		AST_JSON_UNREF(j_overlays);
+		return NULL;
+	}
+	db_res->j_behinds = j_overlays;
+
+	return db_res;
+}
+
+/**
+ * database query function without the write-behind sync.
+ * @param query
+ * @return
+ */
+static db_res_t* db_query_raw(const char* query)
+{
+	E_DB_TYPE type;
+
 	type = get_db_type();
 
 	switch(type) {
@@ -186,15 +265,34 @@ db_res_t* db_query(const char* query)
  */
 bool db_exec(const char* query)
 {
-	E_DB_TYPE type;
-
-	type = get_db_type();
+	bool ret;
 
 	if(query == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return false;
 	}
 
+	// keep the write order.
+	// hold the lock. should not be written inside of the write-behind transaction.
+	ast_mutex_lock(&g_behind_mutex);
+	sync_behind(query, NULL);
+	ret = db_exec_raw(query);
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return ret;
+}
+
+/**
+ * database query execute function without the write-behind sync.
+ * @param query
+ * @return
+ */
+static bool db_exec_raw(const char* query)
+{
+	E_DB_TYPE type;
+
+	type = get_db_type();
+
 	switch(type) {
 		case E_DB_SQLITE3: {
 			return db_sqlite3_exec(query);
@@ -221,10 +319,62 @@ bool db_exec(const char* query)
 /**
  * Return 1 record info by json.
  * If there's no more record or error happened, it will return NULL.
+ * The pending write-behind updates are applied to the record.
  * @param res
  * @return  success:json_t*, fail:NULL
  */
 struct ast_json* db_get_record(db_res_t* ctx)
+{
+	size_t i;
+	bool changed;
+	const char* key_value;
+	const char* where;
+	struct ast_json* j_res;
+	struct ast_json* j_tables;
+	struct ast_json* j_table;
+
+	while(1) {
+		j_res = db_get_record_raw(ctx);
+		if((j_res == NULL) || (ctx->j_behinds == NULL)) {
+			return j_res;
+		}
+
+		// apply the pending write-behind updates of the row.
+		where = ast_json_string_get(ast_json_object_get(ctx->j_behinds, "where"));
+		j_tables = ast_json_object_get(ctx->j_behinds, "tables");
+		changed = false;
+		ast_mutex_lock(&g_behind_mutex);
+		for(i = 0; i < ast_json_array_size(j_tables); i++) {
+			j_table = ast_json_array_get(j_tables, i);
+			key_value = ast_json_string_get(ast_json_object_get(j_res, ast_json_string_get(ast_json_object_get(j_table, "key"))));
+			if(key_value == NULL) {
+				continue;
+			}
+			if(overlay_behind(ast_json_string_get(ast_json_object_get(j_table, "table")), key_value, j_res, where) == true) {
+				changed = true;
+			}
+		}
+		ast_mutex_unlock(&g_behind_mutex);
+
+		// the pending update changed the condition of the row. may not match any more.
+		if(changed == true) {
+			AST_JSON_UNREF(j_res);
+			continue;
+		}
+
+		return j_res;
+	}
+
+	// Should not reach to here.
+	return NULL;
+}
+
+/**
+ * Return 1 record info by json without the write-behind overlay.
+ * @param ctx
+ * @return
+ */
+static struct ast_json* db_get_record_raw(db_res_t* ctx)
 {
 	E_DB_TYPE type;
 
@@ -265,6 +415,7 @@ void db_free(db_res_t* db_res)
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return;
 	}
+	AST_JSON_UNREF(db_res->j_behinds);
 
 	type = get_db_type();
 
@@ -300,30 +451,33 @@ void db_free(db_res_t* db_res)
 bool db_insert(const char* table, const struct ast_json* j_data)
 {
 	E_DB_TYPE type;
+	bool ret;
 
 	type = get_db_type();
 
+	// hold the lock. should not be written inside of the write-behind transaction.
+	// the new row has no pending update. no need to sync.
+	ast_mutex_lock(&g_behind_mutex);
 	switch(type) {
 		case E_DB_SQLITE3: {
-			return db_sqlite3_insert(table, j_data);
+			ret = db_sqlite3_insert(table, j_data);
 		}
 		break;
 
 //		case E_DB_MYSQL: {
-//			return db_mysql_insert(table, j_data);
+//			ret = db_mysql_insert(table, j_data);
 //		}
 //		break;
 
 		default: {
 			ast_log(LOG_ERROR, "Unsupported database type. type[%d]\n", type);
-			return false;
+			ret = false;
 		}
+		break;
 	}
+	ast_mutex_unlock(&g_behind_mutex);
 
-	// Should not reach to here.
-	ast_log(LOG_ERROR, "Could not call the correct database handler.\n");
-
-	return false;
+	return ret;
 }
 
 /**
@@ -360,6 +514,779 @@ char* db_get_update_str(const struct ast_json* j_data)
 	return NULL;
 }
 
+/**
+ * database query function with bind parameters. (select)
+ * The prepared statement is cached by the query string.
+ * @param query		query with '?' parameters.
+ * @param j_binds	json array of bind values. Could be NULL.
+ * @return Success:, Fail:NULL
+ */
+db_res_t* db_query_bind(const char* query, struct ast_json* j_binds)
+{
+	db_res_t* db_res;
+	struct ast_json* j_overlays;
+
+	if(query == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	// read-your-writes
+	ast_mutex_lock(&g_behind_mutex);
+	sync_behind(query, j_binds);
+	j_overlays = get_behind_overlays(query);
+	ast_mutex_unlock(&g_behind_mutex);
+
+	db_res = db_query_bind_raw(query, j_binds);
+	if(db_res == NULL) {
+		AST_JSON_UNREF(j_overlays);
+		return NULL;
+	}
+	db_res->j_behinds = j_overlays;
+
+	return db_res;
+}
+
+/**
+ * database query function with bind parameters without the write-behind sync.
+ * @param query
+ * @param j_binds
+ * @return
+ */
+static db_res_t* db_query_bind_raw(const char* query, struct ast_json* j_binds)
+{
+	E_DB_TYPE type;
+
+	type = get_db_type();
+
+	switch(type) {
+		case E_DB_SQLITE3: {
+			return db_sqlite3_query_bind(query, j_binds);
+		}
+		break;
+
+		default: {
+			ast_log(LOG_ERROR, "Unsupported database type. type[%d]\n", type);
+			return NULL;
+		}
+	}
+
+	// Should not reach to here.
+	ast_log(LOG_ERROR, "Could not call the correct database handler.\n");
+
+	return NULL;
+}
+
+/**
+ * database query execute function with bind parameters. (update, delete, insert)
+ * The prepared statement is cached by the query string.
+ * @param query		query with '?' parameters.
+ * @param j_binds	json array of bind values. Could be NULL.
+ * @return  success:true, fail:false
+ */
+bool db_exec_bind(const char* query, struct ast_json* j_binds)
+{
+	bool ret;
+
+	if(query == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	// keep the write order.
+	// hold the lock. should not be written inside of the write-behind transaction.
+	ast_mutex_lock(&g_behind_mutex);
+	sync_behind(query, j_binds);
+	ret = db_exec_bind_raw(query, j_binds);
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return ret;
+}
+
+/**
+ * database query execute function with bind parameters without the write-behind sync.
+ * @param query
+ * @param j_binds
+ * @return
+ */
+static bool db_exec_bind_raw(const char* query, struct ast_json* j_binds)
+{
+	E_DB_TYPE type;
+
+	type = get_db_type();
+
+	switch(type) {
+		case E_DB_SQLITE3: {
+			return db_sqlite3_exec_bind(query, j_binds);
+		}
+		break;
+
+		default: {
+			ast_log(LOG_ERROR, "Unsupported database type. type[%d]\n", type);
+			return false;
+		}
+	}
+
+	// Should not reach to here.
+	ast_log(LOG_ERROR, "Could not call the correct database handler.\n");
+
+	return false;
+}
+
+/**
+ * Return part of update sql with '?' parameters.
+ * The values are appended to the j_binds in the same order.
+ * @param j_data
+ * @param j_binds	json array.
+ * @return
+ */
+char* db_get_update_bind_str(const struct ast_json* j_data, struct ast_json* j_binds)
+{
+	E_DB_TYPE type;
+
+	type = get_db_type();
+
+	switch(type) {
+		case E_DB_SQLITE3: {
+			return db_sqlite3_get_update_bind_str(j_data, j_binds);
+		}
+		break;
+
+		default: {
+			ast_log(LOG_ERROR, "Unsupported database type. type[%d]\n", type);
+			return NULL;
+		}
+	}
+
+	// Should not reach to here.
+	ast_log(LOG_ERROR, "Could not call the correct database handler.\n");
+
+	return NULL;
+}
+
+/**
+ * Update the row in write-behind.
+ * The updates for the same row are merged and written in one transaction later.
+ * If the write-behind is disabled, update it right now.
+ * @param table
+ * @param key		key column name.
+ * @param key_value	key column value.
+ * @param j_conds	additional conditions of the update. {column: value}. Could be NULL.
+ * @param j_data	columns to update.
+ * @return
+ */
+bool db_update_behind(const char* table, const char* key, const char* key_value, const struct ast_json* j_conds, const struct ast_json* j_data)
+{
+	int ret;
+	char* tmp;
+	char* cond;
+	char* sql;
+	char* behind_key;
+	struct ast_json* j_behind;
+	struct ast_json* j_binds;
+	struct ast_json_iter* iter;
+
+	if((table == NULL) || (key == NULL) || (key_value == NULL) || (j_data == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	if(g_behind_delay <= 0) {
+		j_binds = ast_json_array_create();
+		tmp = db_get_update_bind_str(j_data, j_binds);
+		if(tmp == NULL) {
+			ast_log(LOG_ERROR, "Could not get update sql.\n");
+			AST_JSON_UNREF(j_binds);
+			return false;
+		}
+		ast_json_array_append(j_binds, ast_json_string_create(key_value));
+		cond = get_behind_cond_str(j_conds, j_binds);
+
+		ast_asprintf(&sql, "update %s set %s where %s = ?%s;", table, tmp, key, cond);
+		ast_free(tmp);
+		ast_free(cond);
+
+		ret = db_exec_bind(sql, j_binds);
+		ast_free(sql);
+		AST_JSON_UNREF(j_binds);
+
+		return ret;
+	}
+
+	behind_key = create_behind_key(table, key_value);
+
+	ast_mutex_lock(&g_behind_mutex);
+	if(g_j_behinds == NULL) {
+		ast_mutex_unlock(&g_behind_mutex);
+		ast_free(behind_key);
+		ast_log(LOG_WARNING, "Database is not initiated.\n");
+		return false;
+	}
+
+	// merge into the pending update of the same row.
+	j_behind = ast_json_object_get(g_j_behinds, behind_key);
+	if(j_behind == NULL) {
+		j_behind = ast_json_pack("{s:s, s:s, s:s, s:i, s:o, s:o}",
+				"table",	table,
+				"key",		key,
+				"value",	key_value,
+				"retry",	0,
+				"conds",	(j_conds != NULL)? ast_json_deep_copy(j_conds) : ast_json_object_create(),
+				"data",		ast_json_object_create()
+				);
+		ast_json_object_set(g_j_behinds, behind_key, j_behind);
+	}
+	ast_free(behind_key);
+
+	for(iter = ast_json_object_iter((struct ast_json*)j_data); iter != NULL; iter = ast_json_object_iter_next((struct ast_json*)j_data, iter)) {
+		ast_json_object_set(ast_json_object_get(j_behind, "data"),
+				ast_json_object_iter_key(iter),
+				ast_json_deep_copy(ast_json_object_iter_value(iter))
+				);
+	}
+
+	// flush
+	if(ast_json_object_size(g_j_behinds) >= g_behind_max) {
+		ret = flush_behind();
+		ast_mutex_unlock(&g_behind_mutex);
+		return ret;
+	}
+
+	ret = schedule_flush_behind();
+	if(ret == false) {
+		// no event loop to flush.
+		ret = flush_behind();
+		ast_mutex_unlock(&g_behind_mutex);
+		return ret;
+	}
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return true;
+}
+
+/**
+ * Apply the pending write-behind updates of the row to the given record.
+ * @param table
+ * @param key_value
+ * @param j_record	record from the database. Updated.
+ */
+void db_apply_behind(const char* table, const char* key_value, struct ast_json* j_record)
+{
+	if((table == NULL) || (key_value == NULL) || (j_record == NULL)) {
+		return;
+	}
+
+	ast_mutex_lock(&g_behind_mutex);
+	apply_behind(table, key_value, j_record);
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return;
+}
+
+/**
+ * Get one row by the key without writing the pending updates.
+ * The pending write-behind updates of the row are applied to the result.
+ * @param table
+ * @param key_value
+ * @param query		query for the row.
+ * @param j_binds
+ * @return
+ */
+struct ast_json* db_get_row_behind(const char* table, const char* key_value, const char* query, struct ast_json* j_binds)
+{
+	db_res_t* db_res;
+	struct ast_json* j_res;
+
+	if((table == NULL) || (key_value == NULL) || (query == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	// hold the lock. the pending updates should not be written between the query and apply.
+	ast_mutex_lock(&g_behind_mutex);
+	db_res = db_query_bind_raw(query, j_binds);
+	if(db_res == NULL) {
+		ast_mutex_unlock(&g_behind_mutex);
+		return NULL;
+	}
+
+	j_res = db_get_record_raw(db_res);
+	db_free(db_res);
+	if(j_res == NULL) {
+		ast_mutex_unlock(&g_behind_mutex);
+		return NULL;
+	}
+	apply_behind(table, key_value, j_res);
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return j_res;
+}
+
+/**
+ * Write the pending write-behind updates of the rows the query depends on.
+ * @param query	NULL for all.
+ */
+void db_sync_behind(const char* query)
+{
+	ast_mutex_lock(&g_behind_mutex);
+	if(query == NULL) {
+		flush_behind();
+	}
+	else {
+		sync_behind(query, NULL);
+	}
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return;
+}
+
+/**
+ * Get write-behind option.
+ * @param j_database
+ * @param name
+ * @param def
+ * @return
+ */
+static int get_behind_option(struct ast_json* j_database, const char* name, const char* def)
+{
+	const char* tmp_const;
+
+	tmp_const = ast_json_string_get(ast_json_object_get(j_database, name));
+	if(tmp_const == NULL) {
+		tmp_const = def;
+		ast_log(LOG_NOTICE, "Could not get correct %s value. Set default. %s[%s]\n", name, name, tmp_const);
+	}
+	ast_log(LOG_NOTICE, "Database write-behind option. %s[%s]\n", name, tmp_const);
+
+	return atoi(tmp_const);
+}
+
+static char* create_behind_key(const char* table, const char* key_value)
+{
+	char* res;
+
+	ast_asprintf(&res, "%s/%s", table, key_value);
+
+	return res;
+}
+
+/**
+ * Return the additional conditions of the update with '?' parameters.
+ * ex) " and in_use = ?"
+ * The values are appended to the j_binds in the same order.
+ * @param j_conds	{column: value}. Could be NULL.
+ * @param j_binds	json array.
+ * @return
+ */
+static char* get_behind_cond_str(const struct ast_json* j_conds, struct ast_json* j_binds)
+{
+	char* res;
+	char* tmp;
+	struct ast_json_iter* iter;
+
+	res = ast_strdup("");
+	for(iter = ast_json_object_iter((struct ast_json*)j_conds); iter != NULL; iter = ast_json_object_iter_next((struct ast_json*)j_conds, iter)) {
+		ast_asprintf(&tmp, "%s and %s = ?", res, ast_json_object_iter_key(iter));
+		ast_free(res);
+		res = tmp;
+		ast_json_array_append(j_binds, ast_json_deep_copy(ast_json_object_iter_value(iter)));
+	}
+
+	return res;
+}
+
+/**
+ * Apply the pending update of the row to the record.
+ * Caller should hold the g_behind_mutex.
+ * @param table
+ * @param key_value
+ * @param j_record
+ */
+static void apply_behind(const char* table, const char* key_value, struct ast_json* j_record)
+{
+	overlay_behind(table, key_value, j_record, NULL);
+	return;
+}
+
+/**
+ * Apply the pending update of the row to the record.
+ * Caller should hold the g_behind_mutex.
+ * @param table
+ * @param key_value
+ * @param j_record
+ * @param where		where clause of the query. Could be NULL.
+ * @return true if the update changed a column of the where clause.
+ */
+static bool overlay_behind(const char* table, const char* key_value, struct ast_json* j_record, const char* where)
+{
+	bool res;
+	char* behind_key;
+	const char* column;
+	struct ast_json* j_data;
+	struct ast_json* j_value;
+	struct ast_json_iter* iter;
+
+	behind_key = create_behind_key(table, key_value);
+	j_data = ast_json_object_get(ast_json_object_get(g_j_behinds, behind_key), "data");
+	ast_free(behind_key);
+
+	res = false;
+	for(iter = ast_json_object_iter(j_data); iter != NULL; iter = ast_json_object_iter_next(j_data, iter)) {
+		column = ast_json_object_iter_key(iter);
+		j_value = ast_json_object_iter_value(iter);
+
+		if((where != NULL) && (res == false)
+				&& (ast_json_equal(ast_json_object_get(j_record, column), j_value) == 0)
+				&& (find_query_word(where, column) != NULL)) {
+			res = true;
+		}
+		ast_json_object_set(j_record, column, ast_json_deep_copy(j_value));
+	}
+
+	return res;
+}
+
+/**
+ * Find the word in the query.
+ * (dl_list is not dl_list_ma)
+ * @param query
+ * @param word
+ * @return the position of the word. NULL if not found.
+ */
+static const char* find_query_word(const char* query, const char* word)
+{
+	const char* pos;
+	size_t len;
+
+	len = strlen(word);
+	if(len == 0) {
+		return NULL;
+	}
+
+	for(pos = strstr(query, word); pos != NULL; pos = strstr(pos + 1, word)) {
+		if((pos != query) && ((isalnum(*(pos - 1)) != 0) || (*(pos - 1) == '_'))) {
+			continue;
+		}
+		if((isalnum(pos[len]) != 0) || (pos[len] == '_')) {
+			continue;
+		}
+		return pos;
+	}
+
+	return NULL;
+}
+
+/**
+ * Return true if the query depends on the pending update.
+ * The query depends on it when the query uses its table and has its key value.
+ * Caller should hold the g_behind_mutex.
+ * @param query
+ * @param j_binds	json array of bind values. Could be NULL.
+ * @param j_behind	pending update.
+ * @return
+ */
+static bool is_behind_row_query(const char* query, struct ast_json* j_binds, struct ast_json* j_behind)
+{
+	const char* value;
+	const char* bind;
+	size_t i;
+
+	if(find_query_word(query, ast_json_string_get(ast_json_object_get(j_behind, "table"))) == NULL) {
+		return false;
+	}
+
+	value = ast_json_string_get(ast_json_object_get(j_behind, "value"));
+	if(strstr(query, value) != NULL) {
+		return true;
+	}
+	for(i = 0; i < ast_json_array_size(j_binds); i++) {
+		bind = ast_json_string_get(ast_json_array_get(j_binds, i));
+		if((bind != NULL) && (strcmp(bind, value) == 0)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Write the pending updates of the rows the query depends on.
+ * The other pending updates are kept. The query results get them by overlay.
+ * Caller should hold the g_behind_mutex.
+ * @param query
+ * @param j_binds	json array of bind values. Could be NULL.
+ */
+static void sync_behind(const char* query, struct ast_json* j_binds)
+{
+	struct ast_json* j_keys;
+	struct ast_json_iter* iter;
+
+	if((g_j_behinds == NULL) || (ast_json_object_size(g_j_behinds) == 0)) {
+		return;
+	}
+
+	j_keys = ast_json_array_create();
+	for(iter = ast_json_object_iter(g_j_behinds); iter != NULL; iter = ast_json_object_iter_next(g_j_behinds, iter)) {
+		if(is_behind_row_query(query, j_binds, ast_json_object_iter_value(iter)) == false) {
+			continue;
+		}
+		ast_json_array_append(j_keys, ast_json_string_create(ast_json_object_iter_key(iter)));
+	}
+
+	if(ast_json_array_size(j_keys) > 0) {
+		flush_behind_keys(j_keys);
+	}
+	AST_JSON_UNREF(j_keys);
+
+	return;
+}
+
+/**
+ * Return the overlay info of the pending updates the query uses.
+ * The records of the query result are overlaid with the pending updates of these tables.
+ * Caller should hold the g_behind_mutex.
+ * @param query
+ * @return {"where": where clause, "tables": [{table, key}, ...]}. NULL if none.
+ */
+static struct ast_json* get_behind_overlays(const char* query)
+{
+	size_t i;
+	bool exist;
+	const char* table;
+	const char* where;
+	struct ast_json* j_res;
+	struct ast_json* j_tables;
+	struct ast_json* j_behind;
+	struct ast_json_iter* iter;
+
+	if((g_j_behinds == NULL) || (ast_json_object_size(g_j_behinds) == 0)) {
+		return NULL;
+	}
+
+	j_res = NULL;
+	for(iter = ast_json_object_iter(g_j_behinds); iter != NULL; iter = ast_json_object_iter_next(g_j_behinds, iter)) {
+		j_behind = ast_json_object_iter_value(iter);
+		table = ast_json_string_get(ast_json_object_get(j_behind, "table"));
+		if(find_query_word(query, table) == NULL) {
+			continue;
+		}
+
+		if(j_res == NULL) {
+			where = find_query_word(query, "where");
+			j_res = ast_json_pack("{s:s, s:o}",
+					"where",	(where != NULL)? where : "",
+					"tables",	ast_json_array_create()
+					);
+		}
+		j_tables = ast_json_object_get(j_res, "tables");
+
+		exist = false;
+		for(i = 0; i < ast_json_array_size(j_tables); i++) {
+			if(strcmp(table, ast_json_string_get(ast_json_object_get(ast_json_array_get(j_tables, i), "table"))) == 0) {
+				exist = true;
+				break;
+			}
+		}
+		if(exist == true) {
+			continue;
+		}
+
+		ast_json_array_append(j_tables, ast_json_pack("{s:s, s:s}",
+				"table",	table,
+				"key",		ast_json_string_get(ast_json_object_get(j_behind, "key"))
+				));
+	}
+
+	return j_res;
+}
+
+/**
+ * Write all of the pending updates in one transaction.
+ * Caller should hold the g_behind_mutex.
+ * @return
+ */
+static bool flush_behind(void)
+{
+	return flush_behind_keys(NULL);
+}
+
+/**
+ * Write the given pending updates in one transaction.
+ * The updates are removed from the pending list only after the commit.
+ * Failed updates are kept and retried in the next flush.
+ * Caller should hold the g_behind_mutex.
+ * @param j_keys	json array of pending update keys. NULL for all.
+ * @return
+ */
+static bool flush_behind_keys(struct ast_json* j_keys)
+{
+	int ret;
+	int retry;
+	size_t i;
+	bool res;
+	char* tmp;
+	char* cond;
+	char* sql;
+	const char* behind_key;
+	struct ast_json* j_behind;
+	struct ast_json* j_binds;
+	struct ast_json* j_targets;
+	struct ast_json* j_done;
+	struct ast_json* j_fail;
+	struct ast_json_iter* iter;
+
+	if((g_j_behinds == NULL) || (ast_json_object_size(g_j_behinds) == 0)) {
+		return true;
+	}
+
+	if(j_keys != NULL) {
+		j_targets = ast_json_ref(j_keys);
+	}
+	else {
+		j_targets = ast_json_array_create();
+		for(iter = ast_json_object_iter(g_j_behinds); iter != NULL; iter = ast_json_object_iter_next(g_j_behinds, iter)) {
+			ast_json_array_append(j_targets, ast_json_string_create(ast_json_object_iter_key(iter)));
+		}
+	}
+
+	ret = db_exec_raw("begin;");
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not begin the write-behind transaction.\n");
+		AST_JSON_UNREF(j_targets);
+		schedule_flush_behind();
+		return false;
+	}
+
+	res = true;
+	j_done = ast_json_array_create();
+	j_fail = ast_json_array_create();
+	for(i = 0; i < ast_json_array_size(j_targets); i++) {
+		behind_key = ast_json_string_get(ast_json_array_get(j_targets, i));
+		j_behind = ast_json_object_get(g_j_behinds, behind_key);
+		if(j_behind == NULL) {
+			continue;
+		}
+
+		j_binds = ast_json_array_create();
+		tmp = db_get_update_bind_str(ast_json_object_get(j_behind, "data"), j_binds);
+		if(tmp == NULL) {
+			// nothing to write.
+			AST_JSON_UNREF(j_binds);
+			ast_json_array_append(j_done, ast_json_string_create(behind_key));
+			continue;
+		}
+		ast_json_array_append(j_binds, ast_json_ref(ast_json_object_get(j_behind, "value")));
+		cond = get_behind_cond_str(ast_json_object_get(j_behind, "conds"), j_binds);
+
+		ast_asprintf(&sql, "update %s set %s where %s = ?%s;",
+				ast_json_string_get(ast_json_object_get(j_behind, "table")),
+				tmp,
+				ast_json_string_get(ast_json_object_get(j_behind, "key")),
+				cond
+				);
+		ast_free(tmp);
+		ast_free(cond);
+
+		ret = db_exec_bind_raw(sql, j_binds);
+		ast_free(sql);
+		AST_JSON_UNREF(j_binds);
+		if(ret == false) {
+			ast_log(LOG_ERROR, "Could not write the pending update. key[%s]\n", behind_key);
+			ast_json_array_append(j_fail, ast_json_string_create(behind_key));
+			res = false;
+			continue;
+		}
+		ast_json_array_append(j_done, ast_json_string_create(behind_key));
+	}
+
+	ret = db_exec_raw("commit;");
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not commit the write-behind transaction. Keep the pending updates. count[%zu]\n",
+				ast_json_array_size(j_targets)
+				);
+		db_exec_raw("rollback;");
+		AST_JSON_UNREF(j_targets);
+		AST_JSON_UNREF(j_done);
+		AST_JSON_UNREF(j_fail);
+		schedule_flush_behind();
+		return false;
+	}
+
+	// remove the written updates.
+	for(i = 0; i < ast_json_array_size(j_done); i++) {
+		ast_json_object_del(g_j_behinds, ast_json_string_get(ast_json_array_get(j_done, i)));
+	}
+	ast_log(LOG_DEBUG, "Wrote pending updates. count[%zu]\n", ast_json_array_size(j_done));
+
+	// count the failed updates. give up after the retry limit.
+	for(i = 0; i < ast_json_array_size(j_fail); i++) {
+		behind_key = ast_json_string_get(ast_json_array_get(j_fail, i));
+		j_behind = ast_json_object_get(g_j_behinds, behind_key);
+		retry = ast_json_integer_get(ast_json_object_get(j_behind, "retry")) + 1;
+		if(retry >= DEF_DB_WRITE_BEHIND_RETRY) {
+			tmp = ast_json_dump_string(ast_json_object_get(j_behind, "data"));
+			ast_log(LOG_ERROR, "Could not write the pending update. Discarded. key[%s], retry[%d], data[%s]\n",
+					behind_key, retry, tmp
+					);
+			ast_json_free(tmp);
+			ast_json_object_del(g_j_behinds, behind_key);
+			continue;
+		}
+		ast_json_object_set(j_behind, "retry", ast_json_integer_create(retry));
+	}
+	AST_JSON_UNREF(j_targets);
+	AST_JSON_UNREF(j_done);
+	AST_JSON_UNREF(j_fail);
+
+	if(ast_json_object_size(g_j_behinds) > 0) {
+		schedule_flush_behind();
+	}
+
+	return res;
+}
+
+/**
+ * Schedule the write-behind flush event.
+ * Caller should hold the g_behind_mutex.
+ * @return false if there is no event loop to flush.
+ */
+static bool schedule_flush_behind(void)
+{
+	int ret;
+	struct timeval tm_delay;
+
+	if(g_behind_scheduled == true) {
+		return true;
+	}
+
+	if(g_base == NULL) {
+		return false;
+	}
+
+	tm_delay.tv_sec = g_behind_delay / 1000;
+	tm_delay.tv_usec = (g_behind_delay % 1000) * 1000;
+	ret = event_base_once(g_base, -1, EV_TIMEOUT, cb_flush_behind, NULL, &tm_delay);
+	if(ret != 0) {
+		return false;
+	}
+	g_behind_scheduled = true;
+
+	return true;
+}
+
+/**
+ * Write-behind flush event.
+ */
+static void cb_flush_behind(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg)
+{
+	ast_mutex_lock(&g_behind_mutex);
+	g_behind_scheduled = false;
+	flush_behind();
+	ast_mutex_unlock(&g_behind_mutex);
+
+	return;
+}
+
 const char* db_translate_function(E_DB_FUNC e_func) {
 	E_DB_TYPE type;
 
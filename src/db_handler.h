@@ -17,6 +17,9 @@
 typedef struct _db_res_t
 {
 	void* res;		///< result set
+	void* cache;	///< owner statement cache. NULL if not cached.
+	void* conn;		///< owner read-only connection. NULL if the default connection.
+	struct ast_json* j_behinds;	///< write-behind tables to overlay on the records. NULL if none.
 } db_res_t;
 
 typedef enum _E_DB_FUNC
@@ -31,6 +34,15 @@ bool			db_exec(const char* query);
 void			db_free(db_res_t* ctx);
 bool	 		db_insert(const char* table, const struct ast_json* j_data);
 char*	   	db_get_update_str(const struct ast_json* j_data);
+
+db_res_t*	db_query_bind(const char* query, struct ast_json* j_binds);
+bool			db_exec_bind(const char* query, struct ast_json* j_binds);
+char*	   	db_get_update_bind_str(const struct ast_json* j_data, struct ast_json* j_binds);
+
+bool			db_update_behind(const char* table, const char* key, const char* key_value, const struct ast_json* j_conds, const struct ast_json* j_data);
+void			db_apply_behind(const char* table, const char* key_value, struct ast_json* j_record);
+struct ast_json*	db_get_row_behind(const char* table, const char* key_value, const char* query, struct ast_json* j_binds);
+void			db_sync_behind(const char* query);
 struct ast_json*	db_get_record(db_res_t* ctx);
 
 const char* db_translate_function(E_DB_FUNC e_func);
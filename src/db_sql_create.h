@@ -32,6 +32,7 @@ static const char* g_db_sql_plan =
 "    service_level   int unsigned default 0,"     // service level. determine how many calls can going out campare to available agents."
 "    early_media     varchar(255) default null,"
 "    codecs          varchar(255) default null,"
+"    originate_backend   int default 0,"	// originate backend(0:ami, 1:core)"
 
 // retry count"
 "    max_retry_cnt_1     int default 5,"  // max retry count for dial number 1"
@@ -118,6 +119,10 @@ static const char* g_db_sql_dial_list =
 "    trycnt_7    int default 0,"      // try count for tel number 7"
 "    trycnt_8    int default 0,"      // try count for tel number 8"
 
+// dial key. maintained on every insert and update.
+"    trycnt_total    int default 0,"  // sum of the try counts."
+"    eligible        int default 1,"  // 0:no more dial, 1:dial-able(has any number and not answered). the retry counts are checked by the plan."
+
 // result info"
 "    res_dial            int default 0 not null,"   // last dial result.(no answer, answer, busy, ...)"
 "    res_dial_detail     text,"
@@ -211,6 +216,10 @@ static const char* g_db_sql_campaign =
 "    dlma    varchar(255),"                       // dial_list_ma uuid"
 "    dest    varchar(255),"                       // destination uuid
 
+// dialing schedule
+"    weight       int  default 1,"    // dialing turns in a round among the started campaigns.
+"    priority     int  default 0,"    // higher priority campaign takes turns first.
+
 // schedule
 "    sc_mode              int      default 0,"	// scheduling mode. 0:off, 1:on
 "    sc_date_start        date,"		// start date(YYYY-MM-DD)
@@ -299,4 +308,26 @@ static const char* g_sql_dl_result =
 ");";
 
 
+// columns added after the table creation.
+// table, column, column definition, data migration sql.
+static const char* g_db_sql_upgrade_columns[][4] = {
+	{"campaign",	"weight",			"int default 1",	NULL},
+	{"campaign",	"priority",			"int default 0",	NULL},
+	{"dl_list",		"trycnt_total",		"int default 0",	"update dl_list set trycnt_total = (trycnt_1 + trycnt_2 + trycnt_3 + trycnt_4 + trycnt_5 + trycnt_6 + trycnt_7 + trycnt_8);"},
+	{"plan",		"originate_backend",	"int default 0",	NULL},
+	{"dl_list",		"eligible",			"int default 1",	"update dl_list set eligible = 0 where res_dial = 4;"},	// 4:AST_CONTROL_ANSWER
+	{NULL, NULL, NULL, NULL},
+};
+
+// indexes
+static const char* g_db_sql_indexes[] = {
+	// next dial-able dl_list seek.
+	"create index if not exists idx_dl_list_dial on dl_list(dlma_uuid, status, eligible, trycnt_total) where in_use = 1;",
+
+	// dl_list count by dlma.
+	"create index if not exists idx_dl_list_dlma on dl_list(dlma_uuid, in_use);",
+
+	NULL,
+};
+
 #endif /* SRC_DB_SQL_CREATE_H_ */
@@ -12,12 +12,15 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
 #include <sqlite3.h>
 
 #include "asterisk/utils.h"
 #include "asterisk/module.h"
 #include "asterisk/json.h"
 #include "asterisk/lock.h"
+#include "asterisk/strings.h"
 
 #include "res_outbound.h"
 #include "db_sqlite3_handler.h"
@@ -27,6 +30,17 @@
 static sqlite3* g_db = NULL;
 
 #define MAX_BIND_BUF 4096
+#define MAX_STMT_CACHE 64
+
+#define DEF_SQLITE3_JOURNAL_MODE		"wal"
+#define DEF_SQLITE3_SYNCHRONOUS			"normal"
+#define DEF_SQLITE3_MMAP_SIZE			"268435456"
+#define DEF_SQLITE3_CACHE_SIZE			"-16000"
+#define DEF_SQLITE3_TEMP_STORE			"memory"
+#define DEF_SQLITE3_WAL_AUTOCHECKPOINT	"1000"	///< sqlite3 default.
+#define DEF_SQLITE3_WAL_AUTOCHECKPOINT_BG	"0"	///< the background checkpoint takes care of it.
+#define DEF_SQLITE3_CHECKPOINT_INTERVAL	"1000"
+#define DEF_SQLITE3_READ_POOL_SIZE		"4"
 #define DELIMITER   0x02
 #define MAX_MEMDB_LOCK_RELEASE_TRY 100
 #define MAX_MEMDB_LOCK_RELEASE_TRY 100
@@ -36,12 +50,63 @@ typedef struct {
 	int sleep_ms;   /* Time to sleep before retry again. */
 } busy_handler_attr;
 
+/**
+ * Prepared statement cache entry.
+ */
+typedef struct _stmt_cache
+{
+	char* query;			///< query string. cache key.
+	int hash;				///< query string hash.
+	sqlite3* db;			///< owner connection. cache key.
+	sqlite3_stmt* stmt;
+	bool in_use;			///< statement is handed out.
+	unsigned long tm_used;	///< last used tick for LRU.
+} stmt_cache;
+
+AST_MUTEX_DEFINE_STATIC(g_stmt_cache_mutex);
+static stmt_cache g_stmt_caches[MAX_STMT_CACHE];
+static unsigned long g_stmt_cache_tick = 0;
+
+// background wal checkpoint
+AST_MUTEX_DEFINE_STATIC(g_checkpoint_mutex);
+static ast_cond_t g_checkpoint_cond;
+static pthread_t g_checkpoint_thread = AST_PTHREADT_NULL;
+static bool g_checkpoint_stop = false;
+static int g_checkpoint_interval = 0;	///< checkpoint interval(ms). 0 is disabled.
+
+// read-only connection pool(wal readers)
+AST_MUTEX_DEFINE_STATIC(g_read_pool_mutex);
+static sqlite3** g_read_pool = NULL;		///< read-only connections.
+static bool* g_read_pool_in_use = NULL;
+static int g_read_pool_size = 0;
+
+static char* g_db_filename = NULL;
+
 
 static bool db_sqlite3_connect(const char* filename);
 //static bool db_sqlite3_lock(void);
 //static bool db_sqlite3_release(void);
 //static void db_sqlite3_msleep(unsigned long milisec);
 static int db_sqlite3_busy_handler(void *data, int retry);
+static bool db_sqlite3_create_tables(void);
+static bool db_sqlite3_upgrade(void);
+static bool db_sqlite3_is_column_exist(const char* table, const char* column);
+static sqlite3_stmt* db_sqlite3_stmt_acquire(sqlite3* db, const char* query, stmt_cache** cache);
+static void db_sqlite3_stmt_release(sqlite3_stmt* stmt, stmt_cache* cache);
+static void db_sqlite3_stmt_cache_clear(void);
+static bool db_sqlite3_bind(sqlite3_stmt* stmt, struct ast_json* j_binds);
+static const char* db_sqlite3_get_option(struct ast_json* j_database, const char* name, const char* def);
+static bool db_sqlite3_set_pragmas(struct ast_json* j_database);
+static bool db_sqlite3_set_pragma(const char* name, const char* value);
+static bool db_sqlite3_is_checkpoint_enabled(struct ast_json* j_database);
+static bool db_sqlite3_start_checkpoint(struct ast_json* j_database);
+static void db_sqlite3_stop_checkpoint(void);
+static void* db_sqlite3_checkpoint_loop(void* data);
+static bool db_sqlite3_init_read_pool(struct ast_json* j_database);
+static void db_sqlite3_term_read_pool(void);
+static sqlite3* db_sqlite3_read_pool_acquire(void);
+static void db_sqlite3_read_pool_release(sqlite3* db);
+static bool db_sqlite3_is_select(const char* query);
 
 bool db_sqlite3_init(void)
 {
@@ -64,6 +129,15 @@ bool db_sqlite3_init(void)
 		ast_log(LOG_ERROR, "Could not initiate sqlite3 database.\n");
 		return false;
 	}
+	ast_free(g_db_filename);
+	g_db_filename = ast_strdup(ast_json_string_get(ast_json_object_get(j_database, "db_sqlite3_data")));
+
+	// pragmas
+	ret = db_sqlite3_set_pragmas(j_database);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not set sqlite3 pragmas.\n");
+		return false;
+	}
 
 	// check table exist(campaign)
 	ast_asprintf(&sql, "SELECT name FROM sqlite_master WHERE type='table' AND name='%s';", "campaign");
@@ -71,13 +145,47 @@ bool db_sqlite3_init(void)
 	ast_free(sql);
 	j_res = db_sqlite3_get_record(db_res);
 	db_sqlite3_free(db_res);
-	if(j_res != NULL) {
-		AST_JSON_UNREF(j_res);
-		return true;
+	if(j_res == NULL) {
+		// create new
+		ast_log(LOG_NOTICE, "Could not find correct table info. Create tables.\n");
+		ret = db_sqlite3_create_tables();
+		if(ret == false) {
+			return false;
+		}
 	}
+	AST_JSON_UNREF(j_res);
 
-	// create new
-	ast_log(LOG_NOTICE, "Could not find correct table info. Create tables.\n");
+	// add missing columns and indexes
+	ret = db_sqlite3_upgrade();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not upgrade database.\n");
+		return false;
+	}
+
+	// background checkpoint
+	ret = db_sqlite3_start_checkpoint(j_database);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not start checkpoint thread.\n");
+		return false;
+	}
+
+	// read-only connections
+	ret = db_sqlite3_init_read_pool(j_database);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate read-only connections.\n");
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Create tables.
+ * @return
+ */
+static bool db_sqlite3_create_tables(void)
+{
+	int ret;
 
 	// plan
 	ret = db_sqlite3_exec(g_db_sql_plan);
@@ -131,6 +239,82 @@ bool db_sqlite3_init(void)
 	return true;
 }
 
+/**
+ * Add missing columns and indexes to the existing database.
+ * @return
+ */
+static bool db_sqlite3_upgrade(void)
+{
+	int ret;
+	int i;
+	char* sql;
+
+	// columns
+	for(i = 0; g_db_sql_upgrade_columns[i][0] != NULL; i++) {
+		ret = db_sqlite3_is_column_exist(g_db_sql_upgrade_columns[i][0], g_db_sql_upgrade_columns[i][1]);
+		if(ret == true) {
+			continue;
+		}
+
+		ast_log(LOG_NOTICE, "Add missing column. table[%s], column[%s]\n", g_db_sql_upgrade_columns[i][0], g_db_sql_upgrade_columns[i][1]);
+		ast_asprintf(&sql, "alter table %s add column %s %s;",
+				g_db_sql_upgrade_columns[i][0],
+				g_db_sql_upgrade_columns[i][1],
+				g_db_sql_upgrade_columns[i][2]
+				);
+		ret = db_sqlite3_exec(sql);
+		ast_free(sql);
+		if(ret == false) {
+			ast_log(LOG_ERROR, "Could not add column. table[%s], column[%s]\n", g_db_sql_upgrade_columns[i][0], g_db_sql_upgrade_columns[i][1]);
+			return false;
+		}
+
+		if(g_db_sql_upgrade_columns[i][3] == NULL) {
+			continue;
+		}
+
+		ret = db_sqlite3_exec(g_db_sql_upgrade_columns[i][3]);
+		if(ret == false) {
+			ast_log(LOG_ERROR, "Could not migrate column data. table[%s], column[%s]\n", g_db_sql_upgrade_columns[i][0], g_db_sql_upgrade_columns[i][1]);
+			return false;
+		}
+	}
+
+	// indexes
+	for(i = 0; g_db_sql_indexes[i] != NULL; i++) {
+		ret = db_sqlite3_exec(g_db_sql_indexes[i]);
+		if(ret == false) {
+			ast_log(LOG_ERROR, "Could not create index. sql[%s]\n", g_db_sql_indexes[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Return true if the given table has the given column.
+ * @param table
+ * @param column
+ * @return
+ */
+static bool db_sqlite3_is_column_exist(const char* table, const char* column)
+{
+	int ret;
+	char* sql;
+	sqlite3_stmt* stmt;
+
+	ast_asprintf(&sql, "select %s from %s limit 0;", column, table);
+	ret = sqlite3_prepare_v2(g_db, sql, -1, &stmt, NULL);
+	ast_free(sql);
+	if(ret != SQLITE_OK) {
+		return false;
+	}
+	sqlite3_finalize(stmt);
+
+	return true;
+}
+
 /**
  Connect to db.
 
@@ -167,6 +351,12 @@ void db_sqlite3_exit(void)
 		return;
 	}
 
+	db_sqlite3_stop_checkpoint();
+
+	// cached statements must be finalized before close.
+	db_sqlite3_stmt_cache_clear();
+	db_sqlite3_term_read_pool();
+
 	ret = sqlite3_close(g_db);
 	if(ret != SQLITE_OK) {
 		ast_log(LOG_WARNING, "Could not close the database correctly. err[%s]\n", sqlite3_errmsg(g_db));
@@ -175,6 +365,9 @@ void db_sqlite3_exit(void)
 
 	ast_log(LOG_NOTICE, "Released database context.\n");
 	g_db = NULL;
+
+	ast_free(g_db_filename);
+	g_db_filename = NULL;
 }
 
 /**
@@ -186,6 +379,8 @@ db_res_t* db_sqlite3_query(const char* query)
 {
 	int ret;
 	sqlite3_stmt* result;
+	sqlite3* db;
+	sqlite3* reader;
 	db_res_t* db_res;
 
 	if(query == NULL) {
@@ -193,18 +388,125 @@ db_res_t* db_sqlite3_query(const char* query)
 		return NULL;
 	}
 
-	ret = sqlite3_prepare_v2(g_db, query, -1, &result, NULL);
+	// pure select goes to the read-only connection.
+	reader = NULL;
+	if(db_sqlite3_is_select(query) == true) {
+		reader = db_sqlite3_read_pool_acquire();
+	}
+	db = (reader != NULL)? reader : g_db;
+
+	ret = sqlite3_prepare_v2(db, query, -1, &result, NULL);
 	if(ret != SQLITE_OK) {
-		ast_log(LOG_ERROR, "Could not prepare query. query[%s], err[%s]\n", query, sqlite3_errmsg(g_db));
+		ast_log(LOG_ERROR, "Could not prepare query. query[%s], err[%s]\n", query, sqlite3_errmsg(db));
+		db_sqlite3_read_pool_release(reader);
 		return NULL;
 	}
 
 	db_res = ast_calloc(1, sizeof(db_res_t));
 	db_res->res = result;
+	db_res->cache = NULL;
+	db_res->conn = reader;
+
+	return db_res;
+}
+
+/**
+ * database query function with bind parameters. (select)
+ * The prepared statement is cached by the query string and connection.
+ * @param query
+ * @param j_binds
+ * @return Success:, Fail:NULL
+ */
+db_res_t* db_sqlite3_query_bind(const char* query, struct ast_json* j_binds)
+{
+	int ret;
+	sqlite3_stmt* stmt;
+	stmt_cache* cache;
+	sqlite3* db;
+	sqlite3* reader;
+	db_res_t* db_res;
+
+	if(query == NULL) {
+		ast_log(LOG_WARNING, "Could not query NULL query.\n");
+		return NULL;
+	}
+
+	// pure select goes to the read-only connection.
+	reader = NULL;
+	if(db_sqlite3_is_select(query) == true) {
+		reader = db_sqlite3_read_pool_acquire();
+	}
+	db = (reader != NULL)? reader : g_db;
+
+	stmt = db_sqlite3_stmt_acquire(db, query, &cache);
+	if(stmt == NULL) {
+		db_sqlite3_read_pool_release(reader);
+		return NULL;
+	}
+
+	ret = db_sqlite3_bind(stmt, j_binds);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not bind parameters. query[%s]\n", query);
+		db_sqlite3_stmt_release(stmt, cache);
+		db_sqlite3_read_pool_release(reader);
+		return NULL;
+	}
+
+	db_res = ast_calloc(1, sizeof(db_res_t));
+	db_res->res = stmt;
+	db_res->cache = cache;
+	db_res->conn = reader;
 
 	return db_res;
 }
 
+/**
+ * database query execute function with bind parameters. (update, delete, insert)
+ * The prepared statement is cached by the query string.
+ * @param query
+ * @param j_binds
+ * @return  success:true, fail:false
+ */
+bool db_sqlite3_exec_bind(const char* query, struct ast_json* j_binds)
+{
+	int ret;
+	sqlite3_stmt* stmt;
+	stmt_cache* cache;
+
+	if(query == NULL) {
+		ast_log(LOG_WARNING, "Could not execute NULL query.\n");
+		return false;
+	}
+
+	stmt = db_sqlite3_stmt_acquire(g_db, query, &cache);
+	if(stmt == NULL) {
+		return false;
+	}
+
+	ret = db_sqlite3_bind(stmt, j_binds);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not bind parameters. query[%s]\n", query);
+		db_sqlite3_stmt_release(stmt, cache);
+		return false;
+	}
+
+	// execute
+	while(1) {
+		ret = sqlite3_step(stmt);
+		if(ret != SQLITE_ROW) {
+			break;
+		}
+	}
+	if(ret != SQLITE_DONE) {
+		ast_log(LOG_ERROR, "Could not execute query. query[%s], err[%s]\n", query, sqlite3_errmsg(g_db));
+		db_sqlite3_stmt_release(stmt, cache);
+		return false;
+	}
+	db_sqlite3_stmt_release(stmt, cache);
+
+	return true;
+}
+
 /**
  * database query execute function. (update, delete, insert)
  * @param query
@@ -214,7 +516,7 @@ bool db_sqlite3_exec(const char* query)
 {
 	int ret;
 	char* err;
-	busy_handler_attr bh_attr;
+	static busy_handler_attr bh_attr;
 
 	if(query == NULL) {
 		ast_log(LOG_WARNING, "Could not execute NULL query.\n");
@@ -256,7 +558,7 @@ struct ast_json* db_sqlite3_get_record(db_res_t* ctx)
 	ret = sqlite3_step(ctx->res);
 	if(ret != SQLITE_ROW) {
 		if(ret != SQLITE_DONE) {
-			ast_log(LOG_ERROR, "Could not patch the result. ret[%d], err[%s]", ret, sqlite3_errmsg(g_db));
+			ast_log(LOG_ERROR, "Could not patch the result. ret[%d], err[%s]", ret, sqlite3_errmsg(sqlite3_db_handle(ctx->res)));
 		}
 		return NULL;
 	}
@@ -319,7 +621,8 @@ void db_sqlite3_free(db_res_t* db_res)
 		return;
 	}
 
-	sqlite3_finalize(db_res->res);
+	db_sqlite3_stmt_release(db_res->res, db_res->cache);
+	db_sqlite3_read_pool_release(db_res->conn);
 	ast_free(db_res);
 
 	return;
@@ -557,6 +860,666 @@ char* db_sqlite3_get_update_str(const struct ast_json* j_data)
 	return res;
 }
 
+/**
+ * Return part of update sql with '?' parameters.
+ * The values are appended to the j_binds in the same order.
+ * @param j_data
+ * @param j_binds
+ * @return
+ */
+char* db_sqlite3_get_update_bind_str(const struct ast_json* j_data, struct ast_json* j_binds)
+{
+	char*	   res;
+	char*	   tmp;
+	struct ast_json*	 j_data_cp;
+	const char* key;
+	struct ast_json_iter *iter;
+
+	if((j_data == NULL) || (j_binds == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	// copy original data.
+	j_data_cp = ast_json_deep_copy(j_data);
+
+	res = NULL;
+	iter = ast_json_object_iter(j_data_cp);
+	while(iter) {
+		key = ast_json_object_iter_key(iter);
+		if(res == NULL) {
+			ast_asprintf(&tmp, " %s = ?", key);
+		}
+		else {
+			ast_asprintf(&tmp, "%s, %s = ?", res, key);
+		}
+		ast_free(res);
+		res = tmp;
+
+		ast_json_array_append(j_binds, ast_json_ref(ast_json_object_iter_value(iter)));
+		iter = ast_json_object_iter_next(j_data_cp, iter);
+	}
+	AST_JSON_UNREF(j_data_cp);
+
+	return res;
+}
+
+/**
+ * Get the prepared statement of the given query on the given connection.
+ * Returns cached one if it's there and not in use.
+ * Otherwise, prepare new one and put it into the cache.(LRU)
+ * @param db		connection to prepare.
+ * @param query
+ * @param cache		owner cache. NULL if the statement is not cached.
+ * @return
+ */
+static sqlite3_stmt* db_sqlite3_stmt_acquire(sqlite3* db, const char* query, stmt_cache** cache)
+{
+	int ret;
+	int i;
+	int hash;
+	bool is_busy;
+	sqlite3_stmt* stmt;
+	stmt_cache* victim;
+
+	*cache = NULL;
+	hash = ast_str_hash(query);
+	is_busy = false;
+
+	// find cached
+	ast_mutex_lock(&g_stmt_cache_mutex);
+	for(i = 0; i < MAX_STMT_CACHE; i++) {
+		if((g_stmt_caches[i].stmt == NULL) || (g_stmt_caches[i].hash != hash) || (g_stmt_caches[i].db != db)) {
+			continue;
+		}
+		if(strcmp(g_stmt_caches[i].query, query) != 0) {
+			continue;
+		}
+
+		if(g_stmt_caches[i].in_use == true) {
+			// used by the other. prepare new one.
+			is_busy = true;
+			continue;
+		}
+
+		g_stmt_caches[i].in_use = true;
+		g_stmt_caches[i].tm_used = ++g_stmt_cache_tick;
+		*cache = &g_stmt_caches[i];
+		ast_mutex_unlock(&g_stmt_cache_mutex);
+
+		return g_stmt_caches[i].stmt;
+	}
+	ast_mutex_unlock(&g_stmt_cache_mutex);
+
+	ret = sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+	if(ret != SQLITE_OK) {
+		ast_log(LOG_ERROR, "Could not prepare query. query[%s], err[%s]\n", query, sqlite3_errmsg(db));
+		return NULL;
+	}
+
+	if(is_busy == true) {
+		// don't cache the same query twice.
+		return stmt;
+	}
+
+	// put into the cache. evict the least recently used one.
+	ast_mutex_lock(&g_stmt_cache_mutex);
+	victim = NULL;
+	for(i = 0; i < MAX_STMT_CACHE; i++) {
+		if(g_stmt_caches[i].in_use == true) {
+			continue;
+		}
+		if(g_stmt_caches[i].stmt == NULL) {
+			victim = &g_stmt_caches[i];
+			break;
+		}
+		if((victim == NULL) || (g_stmt_caches[i].tm_used < victim->tm_used)) {
+			victim = &g_stmt_caches[i];
+		}
+	}
+	if(victim == NULL) {
+		// all in use.
+		ast_mutex_unlock(&g_stmt_cache_mutex);
+		return stmt;
+	}
+
+	if(victim->stmt != NULL) {
+		ast_log(LOG_DEBUG, "Evict cached statement. query[%s]\n", victim->query);
+		sqlite3_finalize(victim->stmt);
+		ast_free(victim->query);
+	}
+	victim->query = ast_strdup(query);
+	victim->hash = hash;
+	victim->db = db;
+	victim->stmt = stmt;
+	victim->in_use = true;
+	victim->tm_used = ++g_stmt_cache_tick;
+	*cache = victim;
+	ast_mutex_unlock(&g_stmt_cache_mutex);
+
+	return stmt;
+}
+
+/**
+ * Release the statement from db_sqlite3_stmt_acquire().
+ * @param stmt
+ * @param cache
+ */
+static void db_sqlite3_stmt_release(sqlite3_stmt* stmt, stmt_cache* cache)
+{
+	if(stmt == NULL) {
+		return;
+	}
+
+	if(cache == NULL) {
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+
+	ast_mutex_lock(&g_stmt_cache_mutex);
+	cache->in_use = false;
+	ast_mutex_unlock(&g_stmt_cache_mutex);
+
+	return;
+}
+
+/**
+ * Finalize all of the cached statements.
+ */
+static void db_sqlite3_stmt_cache_clear(void)
+{
+	int i;
+
+	ast_mutex_lock(&g_stmt_cache_mutex);
+	for(i = 0; i < MAX_STMT_CACHE; i++) {
+		if(g_stmt_caches[i].stmt == NULL) {
+			continue;
+		}
+
+		if(g_stmt_caches[i].in_use == true) {
+			ast_log(LOG_WARNING, "Cached statement is still in use. query[%s]\n", g_stmt_caches[i].query);
+		}
+		sqlite3_finalize(g_stmt_caches[i].stmt);
+		ast_free(g_stmt_caches[i].query);
+		memset(&g_stmt_caches[i], 0x00, sizeof(stmt_cache));
+	}
+	ast_mutex_unlock(&g_stmt_cache_mutex);
+
+	return;
+}
+
+/**
+ * Bind the json array values to the statement.
+ * @param stmt
+ * @param j_binds	json array. Could be NULL.
+ * @return
+ */
+static bool db_sqlite3_bind(sqlite3_stmt* stmt, struct ast_json* j_binds)
+{
+	int ret;
+	int i;
+	int size;
+	struct ast_json* j_val;
+
+	if(j_binds == NULL) {
+		return true;
+	}
+
+	size = ast_json_array_size(j_binds);
+	for(i = 0; i < size; i++) {
+		j_val = ast_json_array_get(j_binds, i);
+		switch(ast_json_typeof(j_val)) {
+			case AST_JSON_STRING: {
+				ret = sqlite3_bind_text(stmt, i + 1, ast_json_string_get(j_val), -1, SQLITE_TRANSIENT);
+			}
+			break;
+
+			case AST_JSON_INTEGER: {
+				ret = sqlite3_bind_int64(stmt, i + 1, ast_json_integer_get(j_val));
+			}
+			break;
+
+			case AST_JSON_REAL: {
+				ret = sqlite3_bind_double(stmt, i + 1, ast_json_real_get(j_val));
+			}
+			break;
+
+			// keep the same value with the db_sqlite3_get_update_str().
+			case AST_JSON_TRUE: {
+				ret = sqlite3_bind_text(stmt, i + 1, "true", -1, SQLITE_STATIC);
+			}
+			break;
+
+			case AST_JSON_FALSE: {
+				ret = sqlite3_bind_text(stmt, i + 1, "false", -1, SQLITE_STATIC);
+			}
+			break;
+
+			case AST_JSON_NULL: {
+				ret = sqlite3_bind_null(stmt, i + 1);
+			}
+			break;
+
+			// object
+			// array
+			default: {
+				ast_log(LOG_WARNING, "Wrong type input. We don't handle this.\n");
+				ret = sqlite3_bind_null(stmt, i + 1);
+			}
+			break;
+		}
+
+		if(ret != SQLITE_OK) {
+			ast_log(LOG_ERROR, "Could not bind the value. index[%d], err[%s]\n", i + 1, sqlite3_errmsg(g_db));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Get sqlite3 option from [database].
+ * @param j_database
+ * @param name
+ * @param def
+ * @return
+ */
+static const char* db_sqlite3_get_option(struct ast_json* j_database, const char* name, const char* def)
+{
+	const char* tmp_const;
+
+	tmp_const = ast_json_string_get(ast_json_object_get(j_database, name));
+	if(tmp_const == NULL) {
+		tmp_const = def;
+		ast_log(LOG_NOTICE, "Could not get correct %s value. Set default. %s[%s]\n", name, name, tmp_const);
+	}
+
+	return tmp_const;
+}
+
+/**
+ * Set the pragmas from the [database] options.
+ * @param j_database
+ * @return
+ */
+static bool db_sqlite3_set_pragmas(struct ast_json* j_database)
+{
+	int ret;
+	const char* tmp_const;
+
+	ret = db_sqlite3_set_pragma("journal_mode", db_sqlite3_get_option(j_database, "db_sqlite3_journal_mode", DEF_SQLITE3_JOURNAL_MODE));
+	if(ret == false) {
+		return false;
+	}
+
+	ret = db_sqlite3_set_pragma("synchronous", db_sqlite3_get_option(j_database, "db_sqlite3_synchronous", DEF_SQLITE3_SYNCHRONOUS));
+	if(ret == false) {
+		return false;
+	}
+
+	ret = db_sqlite3_set_pragma("mmap_size", db_sqlite3_get_option(j_database, "db_sqlite3_mmap_size", DEF_SQLITE3_MMAP_SIZE));
+	if(ret == false) {
+		return false;
+	}
+
+	ret = db_sqlite3_set_pragma("cache_size", db_sqlite3_get_option(j_database, "db_sqlite3_cache_size", DEF_SQLITE3_CACHE_SIZE));
+	if(ret == false) {
+		return false;
+	}
+
+	ret = db_sqlite3_set_pragma("temp_store", db_sqlite3_get_option(j_database, "db_sqlite3_temp_store", DEF_SQLITE3_TEMP_STORE));
+	if(ret == false) {
+		return false;
+	}
+
+	// without the background checkpoint, the wal should be checkpointed by itself.
+	if(db_sqlite3_is_checkpoint_enabled(j_database) == true) {
+		tmp_const = db_sqlite3_get_option(j_database, "db_sqlite3_wal_autocheckpoint", DEF_SQLITE3_WAL_AUTOCHECKPOINT_BG);
+	}
+	else {
+		tmp_const = db_sqlite3_get_option(j_database, "db_sqlite3_wal_autocheckpoint", DEF_SQLITE3_WAL_AUTOCHECKPOINT);
+		if(atoi(tmp_const) <= 0) {
+			ast_log(LOG_WARNING, "The wal auto checkpoint could not be disabled without the background checkpoint. Set default. db_sqlite3_wal_autocheckpoint[%s]\n", DEF_SQLITE3_WAL_AUTOCHECKPOINT);
+			tmp_const = DEF_SQLITE3_WAL_AUTOCHECKPOINT;
+		}
+	}
+	ret = db_sqlite3_set_pragma("wal_autocheckpoint", tmp_const);
+	if(ret == false) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Set pragma.
+ * @param name
+ * @param value	only alpha-numeric and '-' are allowed.
+ * @return
+ */
+static bool db_sqlite3_set_pragma(const char* name, const char* value)
+{
+	int ret;
+	int i;
+	char* sql;
+
+	if((name == NULL) || (value == NULL) || (strlen(value) == 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	for(i = 0; value[i] != '\0'; i++) {
+		if((isalnum(value[i]) == 0) && (value[i] != '-')) {
+			ast_log(LOG_ERROR, "Wrong pragma value. name[%s], value[%s]\n", name, value);
+			return false;
+		}
+	}
+
+	ast_asprintf(&sql, "pragma %s = %s;", name, value);
+	ret = db_sqlite3_exec(sql);
+	ast_free(sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not set pragma. name[%s], value[%s]\n", name, value);
+		return false;
+	}
+	ast_log(LOG_NOTICE, "Set sqlite3 pragma. name[%s], value[%s]\n", name, value);
+
+	return true;
+}
+
+/**
+ * Return true if the background wal checkpoint is enabled.
+ * It needs the wal mode and checkpoint interval.
+ * @param j_database
+ * @return
+ */
+static bool db_sqlite3_is_checkpoint_enabled(struct ast_json* j_database)
+{
+	const char* tmp_const;
+
+	if(atoi(db_sqlite3_get_option(j_database, "db_sqlite3_checkpoint_interval", DEF_SQLITE3_CHECKPOINT_INTERVAL)) <= 0) {
+		return false;
+	}
+
+	tmp_const = db_sqlite3_get_option(j_database, "db_sqlite3_journal_mode", DEF_SQLITE3_JOURNAL_MODE);
+	if(strcasecmp(tmp_const, "wal") != 0) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Start the background wal checkpoint thread.
+ * The checkpoint uses its own connection, so it never runs on the dialer thread.
+ * @param j_database
+ * @return
+ */
+static bool db_sqlite3_start_checkpoint(struct ast_json* j_database)
+{
+	int ret;
+	const char* tmp_const;
+
+	g_checkpoint_interval = atoi(db_sqlite3_get_option(j_database, "db_sqlite3_checkpoint_interval", DEF_SQLITE3_CHECKPOINT_INTERVAL));
+	if(g_checkpoint_interval <= 0) {
+		ast_log(LOG_NOTICE, "Background checkpoint is disabled.\n");
+		return true;
+	}
+
+	tmp_const = db_sqlite3_get_option(j_database, "db_sqlite3_journal_mode", DEF_SQLITE3_JOURNAL_MODE);
+	if(strcasecmp(tmp_const, "wal") != 0) {
+		ast_log(LOG_NOTICE, "Background checkpoint is for wal mode only. journal_mode[%s]\n", tmp_const);
+		return true;
+	}
+
+	if(g_checkpoint_thread != AST_PTHREADT_NULL) {
+		return true;
+	}
+
+	g_checkpoint_stop = false;
+	ast_cond_init(&g_checkpoint_cond, NULL);
+
+	ret = ast_pthread_create_background(&g_checkpoint_thread, NULL, db_sqlite3_checkpoint_loop, NULL);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Unable to launch thread for checkpoint. err[%d:%s]\n", errno, strerror(errno));
+		g_checkpoint_thread = AST_PTHREADT_NULL;
+		ast_cond_destroy(&g_checkpoint_cond);
+		return false;
+	}
+	ast_log(LOG_NOTICE, "Started background checkpoint. interval[%d]\n", g_checkpoint_interval);
+
+	return true;
+}
+
+/**
+ * Stop the background wal checkpoint thread.
+ */
+static void db_sqlite3_stop_checkpoint(void)
+{
+	if(g_checkpoint_thread == AST_PTHREADT_NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_checkpoint_mutex);
+	g_checkpoint_stop = true;
+	ast_cond_signal(&g_checkpoint_cond);
+	ast_mutex_unlock(&g_checkpoint_mutex);
+
+	pthread_join(g_checkpoint_thread, NULL);
+	g_checkpoint_thread = AST_PTHREADT_NULL;
+
+	ast_cond_destroy(&g_checkpoint_cond);
+
+	return;
+}
+
+/**
+ * Background wal checkpoint loop.
+ * Passive checkpoint does not wait for the readers/writers.
+ * @param data
+ * @return
+ */
+static void* db_sqlite3_checkpoint_loop(__attribute__((unused)) void* data)
+{
+	int ret;
+	int cnt_log;
+	int cnt_ckpt;
+	sqlite3* db;
+	struct timeval tv;
+	struct timespec ts;
+
+	ret = sqlite3_open(g_db_filename, &db);
+	if(ret != SQLITE_OK) {
+		ast_log(LOG_ERROR, "Could not open database for checkpoint. err[%s]\n", sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return NULL;
+	}
+
+	ast_mutex_lock(&g_checkpoint_mutex);
+	while(g_checkpoint_stop == false) {
+		tv = ast_tvadd(ast_tvnow(), ast_samp2tv(g_checkpoint_interval, 1000));
+		ts.tv_sec = tv.tv_sec;
+		ts.tv_nsec = tv.tv_usec * 1000;
+		ast_cond_timedwait(&g_checkpoint_cond, &g_checkpoint_mutex, &ts);
+		if(g_checkpoint_stop == true) {
+			break;
+		}
+
+		ret = sqlite3_wal_checkpoint_v2(db, NULL, SQLITE_CHECKPOINT_PASSIVE, &cnt_log, &cnt_ckpt);
+		if((ret != SQLITE_OK) && (ret != SQLITE_BUSY)) {
+			ast_log(LOG_WARNING, "Could not checkpoint. err[%s]\n", sqlite3_errmsg(db));
+			continue;
+		}
+		if(cnt_log > 0) {
+			ast_log(LOG_DEBUG, "Checkpoint. log[%d], checkpointed[%d]\n", cnt_log, cnt_ckpt);
+		}
+	}
+	ast_mutex_unlock(&g_checkpoint_mutex);
+
+	sqlite3_close(db);
+
+	return NULL;
+}
+
+/**
+ * Open the read-only connections.
+ * Works in wal mode only. The readers don't block the writer in wal mode.
+ * @param j_database
+ * @return
+ */
+static bool db_sqlite3_init_read_pool(struct ast_json* j_database)
+{
+	int ret;
+	int i;
+	int size;
+	const char* tmp_const;
+	char* sql;
+	sqlite3* db;
+
+	size = atoi(db_sqlite3_get_option(j_database, "db_sqlite3_read_pool_size", DEF_SQLITE3_READ_POOL_SIZE));
+	if(size <= 0) {
+		ast_log(LOG_NOTICE, "Read-only connection pool is disabled.\n");
+		return true;
+	}
+
+	tmp_const = db_sqlite3_get_option(j_database, "db_sqlite3_journal_mode", DEF_SQLITE3_JOURNAL_MODE);
+	if(strcasecmp(tmp_const, "wal") != 0) {
+		ast_log(LOG_NOTICE, "Read-only connection pool is for wal mode only. journal_mode[%s]\n", tmp_const);
+		return true;
+	}
+
+	ast_asprintf(&sql, "pragma mmap_size = %s; pragma cache_size = %s; pragma temp_store = %s;",
+			db_sqlite3_get_option(j_database, "db_sqlite3_mmap_size", DEF_SQLITE3_MMAP_SIZE),
+			db_sqlite3_get_option(j_database, "db_sqlite3_cache_size", DEF_SQLITE3_CACHE_SIZE),
+			db_sqlite3_get_option(j_database, "db_sqlite3_temp_store", DEF_SQLITE3_TEMP_STORE)
+			);
+
+	ast_mutex_lock(&g_read_pool_mutex);
+	if(g_read_pool != NULL) {
+		ast_mutex_unlock(&g_read_pool_mutex);
+		ast_free(sql);
+		return true;
+	}
+
+	g_read_pool = ast_calloc(size, sizeof(sqlite3*));
+	g_read_pool_in_use = ast_calloc(size, sizeof(bool));
+	g_read_pool_size = 0;
+	for(i = 0; i < size; i++) {
+		ret = sqlite3_open_v2(g_db_filename, &db, SQLITE_OPEN_READONLY, NULL);
+		if(ret != SQLITE_OK) {
+			ast_log(LOG_ERROR, "Could not open read-only connection. err[%s]\n", sqlite3_errmsg(db));
+			sqlite3_close(db);
+			break;
+		}
+		sqlite3_busy_timeout(db, 1000);
+
+		// same memory settings with the writer. the values were checked already.
+		sqlite3_exec(db, sql, NULL, NULL, NULL);
+
+		g_read_pool[g_read_pool_size] = db;
+		g_read_pool_size++;
+	}
+	ast_mutex_unlock(&g_read_pool_mutex);
+	ast_free(sql);
+	ast_log(LOG_NOTICE, "Opened read-only connections. size[%d]\n", g_read_pool_size);
+
+	return true;
+}
+
+/**
+ * Close the read-only connections.
+ */
+static void db_sqlite3_term_read_pool(void)
+{
+	int i;
+
+	ast_mutex_lock(&g_read_pool_mutex);
+	for(i = 0; i < g_read_pool_size; i++) {
+		if(g_read_pool_in_use[i] == true) {
+			ast_log(LOG_WARNING, "Read-only connection is still in use. index[%d]\n", i);
+		}
+		sqlite3_close(g_read_pool[i]);
+	}
+	ast_free(g_read_pool);
+	ast_free(g_read_pool_in_use);
+	g_read_pool = NULL;
+	g_read_pool_in_use = NULL;
+	g_read_pool_size = 0;
+	ast_mutex_unlock(&g_read_pool_mutex);
+
+	return;
+}
+
+/**
+ * Get an idle read-only connection.
+ * @return	NULL if there's no idle one. Use the writer connection then.
+ */
+static sqlite3* db_sqlite3_read_pool_acquire(void)
+{
+	int i;
+	sqlite3* db;
+
+	db = NULL;
+	ast_mutex_lock(&g_read_pool_mutex);
+	for(i = 0; i < g_read_pool_size; i++) {
+		if(g_read_pool_in_use[i] == true) {
+			continue;
+		}
+		g_read_pool_in_use[i] = true;
+		db = g_read_pool[i];
+		break;
+	}
+	ast_mutex_unlock(&g_read_pool_mutex);
+
+	return db;
+}
+
+/**
+ * Give back the read-only connection.
+ * @param db
+ */
+static void db_sqlite3_read_pool_release(sqlite3* db)
+{
+	int i;
+
+	if(db == NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_read_pool_mutex);
+	for(i = 0; i < g_read_pool_size; i++) {
+		if(g_read_pool[i] == db) {
+			g_read_pool_in_use[i] = false;
+			break;
+		}
+	}
+	ast_mutex_unlock(&g_read_pool_mutex);
+
+	return;
+}
+
+/**
+ * Return true if the query is a pure select.
+ * @param query
+ * @return
+ */
+static bool db_sqlite3_is_select(const char* query)
+{
+	while(isspace(*query) != 0) {
+		query++;
+	}
+
+	if(strncasecmp(query, "select", strlen("select")) != 0) {
+		return false;
+	}
+
+	return true;
+}
+
 ///**
 // * Do the database lock.
 // * Keep try MAX_DB_ACCESS_TRY.
@@ -24,6 +24,9 @@ bool			db_sqlite3_exec(const char* query);
 void			db_sqlite3_free(db_res_t* ctx);
 bool			db_sqlite3_insert(const char* table, const struct ast_json* j_data);
 char*	   	db_sqlite3_get_update_str(const struct ast_json* j_data);
+db_res_t*	db_sqlite3_query_bind(const char* query, struct ast_json* j_binds);
+bool			db_sqlite3_exec_bind(const char* query, struct ast_json* j_binds);
+char*	   	db_sqlite3_get_update_bind_str(const struct ast_json* j_data, struct ast_json* j_binds);
 struct ast_json*	db_sqlite3_get_record(db_res_t* ctx);
 
 
@@ -11,6 +11,10 @@
 #include "asterisk/logger.h"
 #include "asterisk/utils.h"
 #include "asterisk/uuid.h"
+#include "asterisk/lock.h"
+#include "asterisk/devicestate.h"
+
+#include <time.h>
 
 #include "db_handler.h"
 #include "cli_handler.h"
@@ -19,6 +23,23 @@
 #include "ami_handler.h"
 #include "dl_handler.h"
 #include "destination_handler.h"
+#include "res_outbound.h"
+
+#define DEF_DESTINATION_QUEUE_CACHE_MAX_AGE	"60"
+
+/**
+ * Capacity stat of the cached queue.
+ */
+struct queue_cache_stat {
+	int avail;		///< available members. logged in, not paused and not in use.
+	int loggedin;	///< logged in members.
+	int callers;	///< waiting callers.
+	int perf;		///< service level performance(%).
+};
+
+AST_MUTEX_DEFINE_STATIC(g_queue_cache_mutex);
+static struct ast_json* g_j_queue_cache = NULL;	///< queue cache. {"<queue>": {"members": {"<interface>": {"status": n, "paused": n}}, "callers": n, "perf": n, "tm_seed": n}, ...}
+static int g_queue_cache_max_age = 0;			///< queue_cache_max_age(sec). 0 seeds every time.
 
 static struct ast_json* get_destination_deleted(const char* uuid);
 
@@ -26,10 +47,64 @@ static int get_avail_cnt_exten(struct ast_json* j_dest);
 static int get_avail_cnt_app(struct ast_json* j_dest);
 static int get_avail_cnt_app_park(void);
 static int get_avail_cnt_app_queue(const char* name);
-static int get_avail_cnt_app_queue_service_perf(const char* name);
 
-static struct ast_json* get_app_queue_param(const char* name);
-struct ast_json* get_app_queue_summary(const char* name);
+static bool queue_cache_seed(const char* name);
+static bool queue_cache_get_stat(const char* name, struct queue_cache_stat* stat);
+static void queue_cache_calc_stat(struct ast_json* j_queue, struct queue_cache_stat* stat);
+static void queue_cache_evt_member_update(struct ast_json* j_evt);
+static void queue_cache_evt_member_removed(struct ast_json* j_evt);
+
+/**
+ * Initiate the destination handler.
+ * Registers the queue member event handlers of the queue cache.
+ * @return
+ */
+bool init_destination_handler(void)
+{
+	const char* tmp_const;
+	int ret;
+
+	// queue_cache_max_age
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "queue_cache_max_age"));
+	if((tmp_const == NULL) || (atoi(tmp_const) < 0)) {
+		tmp_const = DEF_DESTINATION_QUEUE_CACHE_MAX_AGE;
+		ast_log(LOG_NOTICE, "Could not get correct queue_cache_max_age value. Set default. queue_cache_max_age[%s]\n", tmp_const);
+	}
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	g_queue_cache_max_age = atoi(tmp_const);
+	if(g_j_queue_cache != NULL) {
+		AST_JSON_UNREF(g_j_queue_cache);
+	}
+	g_j_queue_cache = ast_json_object_create();
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	ret = ami_evt_register_handler("QueueMemberStatus", queue_cache_evt_member_update);
+	ret &= ami_evt_register_handler("QueueMemberAdded", queue_cache_evt_member_update);
+	ret &= ami_evt_register_handler("QueueMemberPause", queue_cache_evt_member_update);
+	ret &= ami_evt_register_handler("QueueMemberRemoved", queue_cache_evt_member_removed);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not register queue member event handlers.\n");
+		return false;
+	}
+
+	return true;
+}
+
+void term_destination_handler(void)
+{
+	ami_evt_register_handler("QueueMemberStatus", NULL);
+	ami_evt_register_handler("QueueMemberAdded", NULL);
+	ami_evt_register_handler("QueueMemberPause", NULL);
+	ami_evt_register_handler("QueueMemberRemoved", NULL);
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	AST_JSON_UNREF(g_j_queue_cache);
+	g_j_queue_cache = NULL;
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	return;
+}
 
 /**
  * Create destination.
@@ -370,71 +445,42 @@ static int get_avail_cnt_app(struct ast_json* j_dest)
 	return ret;
 }
 
-static int get_avail_cnt_app_queue_service_perf(const char* name)
-{
-	struct ast_json* j_tmp;
-	double service_perf;
-
-	if(name == NULL) {
-		ast_log(LOG_WARNING, "Wrong input parameter.\n");
-		return 0;
-	}
-
-	// get queue param
-	j_tmp = get_app_queue_param(name);
-	if(j_tmp == NULL) {
-		ast_log(LOG_ERROR, "Could not get queue_param info. queue_name[%s]\n", name);
-		return 0;
-	}
-
-	service_perf = atof(ast_json_string_get(ast_json_object_get(j_tmp, "ServicelevelPerf")));
-	if(service_perf == 0) {
-		service_perf = 100;
-	}
-	AST_JSON_UNREF(j_tmp);
-
-	return service_perf;
-}
-
+/**
+ * Available count of the queue.
+ * Read from the queue cache. The cache is seeded by QueueStatus when the queue is not cached or stale.
+ * \param name
+ * \return
+ */
 static int get_avail_cnt_app_queue(const char* name)
 {
-	struct ast_json* j_tmp;
-	const char* tmp_const;
+	struct queue_cache_stat stat;
 	int ret;
-	int perf;
-	int avail;
-	int loggedin;
 
 	if(name == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return 0;
 	}
 
-	// get queue summary info.
-	j_tmp = get_app_queue_summary(name);
-	if(j_tmp == NULL) {
-		ast_log(LOG_ERROR, "Could not get queue_summary info. queue_name[%s]\n", name);
+	ret = queue_cache_get_stat(name, &stat);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not get queue info. queue_name[%s]\n", name);
 		return 0;
 	}
 
-	// get available, loggedin
-	tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "Available"));
-	avail = atoi(tmp_const);
-
-	tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "LoggedIn"));
-	loggedin = atoi(tmp_const);
-	AST_JSON_UNREF(j_tmp);
-
-	if(loggedin < 10) {
-		ast_log(LOG_VERBOSE, "Not many people logged in. Ignore perf calculate. loggenin[%d], avail[%d]\n", loggedin, avail);
-		return avail;
+	// the waiting callers take the available members first.
+	stat.avail -= stat.callers;
+	if(stat.avail < 0) {
+		stat.avail = 0;
 	}
 
-	// get perf
-	perf = get_avail_cnt_app_queue_service_perf(name);
+	if(stat.loggedin < 10) {
+		ast_log(LOG_VERBOSE, "Not many people logged in. Ignore perf calculate. loggenin[%d], avail[%d]\n", stat.loggedin, stat.avail);
+		return stat.avail;
+	}
 
-	ret = avail * perf / 100;
-	ast_log(LOG_DEBUG, "Application queue available count. name[%s], available[%d], performance[%d]\n", name, avail, perf);
+	ret = stat.avail * stat.perf / 100;
+	ast_log(LOG_DEBUG, "Application queue available count. name[%s], available[%d], performance[%d], callers[%d]\n",
+			name, stat.avail, stat.perf, stat.callers);
 	return ret;
 }
 
@@ -449,106 +495,281 @@ static int get_avail_cnt_app_park(void)
 
 
 /**
- * Get Queue param only.
+ * Seed the queue cache with the QueueStatus.
+ * Replaces the cached queue. Blocking. Called without the cache lock.
  * @param name
  * @return
  */
-static struct ast_json* get_app_queue_param(const char* name)
+static bool queue_cache_seed(const char* name)
 {
 	struct ast_json* j_ami_res;
-	struct ast_json* j_param;
+	struct ast_json* j_queue;
+	struct ast_json* j_members;
 	struct ast_json* j_tmp;
+	const char* event;
+	const char* tmp_const;
+	double perf;
 	size_t size;
+	int found;
 	int i;
-	const char* tmp_const;
 
-	if(name == NULL) {
-		return NULL;
-	}
-	ast_log(LOG_DEBUG, "Getting queue param info. queue_name[%s]\n", name);
+	ast_log(LOG_DEBUG, "Seeding queue cache. queue_name[%s]\n", name);
 
 	j_ami_res = ami_cmd_queue_status(name);
 	if(j_ami_res == NULL) {
 		ast_log(LOG_NOTICE, "Could not get queue status. name[%s]\n", name);
-		return NULL;
+		return false;
 	}
 
-	// get result.
-	i = 0;
-	j_param = NULL;
+	found = false;
+	perf = 0;
+	j_members = ast_json_object_create();
+	j_queue = ast_json_pack("{s:i, s:i}",
+			"callers",	0,
+			"tm_seed",	(int)time(NULL)
+			);
 	size = ast_json_array_size(j_ami_res);
 	for(i = 0; i < size; i++) {
 		j_tmp = ast_json_array_get(j_ami_res, i);
 
-		// Event check
-		tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "Event"));
-		if(tmp_const == NULL) {
+		// compare the queue name
+		tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "Queue"));
+		if((tmp_const == NULL) || (strcmp(tmp_const, name) != 0)) {
 			continue;
 		}
-		if(strcmp(tmp_const, "QueueParams") != 0) {
+
+		event = ast_json_string_get(ast_json_object_get(j_tmp, "Event"));
+		if(event == NULL) {
 			continue;
 		}
 
-		// compare the queue name
-		tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "Queue"));
-		if(tmp_const == NULL) {
-			continue;
+		if(strcmp(event, "QueueParams") == 0) {
+			found = true;
+			perf = atof(ast_json_string_get(ast_json_object_get(j_tmp, "ServicelevelPerf")) ? : "0");
+			ast_json_object_set(j_queue, "callers", ast_json_integer_create(atoi(ast_json_string_get(ast_json_object_get(j_tmp, "Calls")) ? : "0")));
 		}
-		if(strcmp(tmp_const, name) == 0) {
-			j_param = ast_json_deep_copy(j_tmp);
-			break;
+		else if(strcmp(event, "QueueMember") == 0) {
+			tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "StateInterface"));
+			if(ast_strlen_zero(tmp_const)) {
+				tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "Location"));
+			}
+			if(ast_strlen_zero(tmp_const)) {
+				continue;
+			}
+			ast_json_object_set(j_members, tmp_const, ast_json_pack("{s:i, s:i}",
+					"status",	atoi(ast_json_string_get(ast_json_object_get(j_tmp, "Status")) ? : "0"),
+					"paused",	atoi(ast_json_string_get(ast_json_object_get(j_tmp, "Paused")) ? : "0")
+					));
 		}
 	}
 	AST_JSON_UNREF(j_ami_res);
-	if(j_param == NULL) {
+
+	if(found == false) {
 		ast_log(LOG_NOTICE, "Could not get queue param. name[%s]\n", name);
-		return NULL;
+		AST_JSON_UNREF(j_members);
+		AST_JSON_UNREF(j_queue);
+		return false;
+	}
+
+	// no service level perf yet
+	if(perf == 0) {
+		perf = 100;
+	}
+	ast_json_object_set(j_queue, "perf", ast_json_integer_create((int)perf));
+	ast_json_object_set(j_queue, "members", j_members);
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	ast_json_object_set(g_j_queue_cache, name, j_queue);
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	return true;
+}
+
+/**
+ * Calculate the stat of the cached queue.
+ * Same counting with the QueueSummary.
+ * Must be called with the cache lock.
+ * @param j_queue
+ * @param stat
+ */
+static void queue_cache_calc_stat(struct ast_json* j_queue, struct queue_cache_stat* stat)
+{
+	struct ast_json_iter* j_iter;
+	struct ast_json* j_member;
+	int status;
+
+	memset(stat, 0x00, sizeof(*stat));
+	stat->perf = ast_json_integer_get(ast_json_object_get(j_queue, "perf"));
+	stat->callers = ast_json_integer_get(ast_json_object_get(j_queue, "callers"));
+
+	for(j_iter = ast_json_object_iter(ast_json_object_get(j_queue, "members"));
+			j_iter != NULL;
+			j_iter = ast_json_object_iter_next(ast_json_object_get(j_queue, "members"), j_iter))
+	{
+		j_member = ast_json_object_iter_value(j_iter);
+		status = ast_json_integer_get(ast_json_object_get(j_member, "status"));
+		if((status == AST_DEVICE_UNAVAILABLE) || (status == AST_DEVICE_INVALID)) {
+			continue;
+		}
+		stat->loggedin++;
+
+		if(ast_json_integer_get(ast_json_object_get(j_member, "paused")) != 0) {
+			continue;
+		}
+		if((status == AST_DEVICE_NOT_INUSE) || (status == AST_DEVICE_UNKNOWN)) {
+			stat->avail++;
+		}
 	}
 
-	return j_param;
+	return;
 }
 
-struct ast_json* get_app_queue_summary(const char* name)
+/**
+ * Get the stat of the queue from the queue cache.
+ * Seeds the queue if it's not cached or older than queue_cache_max_age.
+ * If the seed of the stale queue fails, the stale one is used. The member events keep it updated.
+ * @param name
+ * @param stat
+ * @return
+ */
+static bool queue_cache_get_stat(const char* name, struct queue_cache_stat* stat)
 {
-	struct ast_json* j_ami_res;
 	struct ast_json* j_queue;
-	struct ast_json* j_tmp;
-	size_t size;
-	int i;
+	int stale;
+	int ret;
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	j_queue = ast_json_object_get(g_j_queue_cache, name);
+	stale = (j_queue == NULL)
+			|| (time(NULL) - ast_json_integer_get(ast_json_object_get(j_queue, "tm_seed")) >= g_queue_cache_max_age);
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	if(stale == true) {
+		ret = queue_cache_seed(name);
+		if(ret == false) {
+			ast_log(LOG_NOTICE, "Could not seed the queue cache. Use the cached one if exists. queue_name[%s]\n", name);
+		}
+	}
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	j_queue = ast_json_object_get(g_j_queue_cache, name);
+	if(j_queue == NULL) {
+		ast_mutex_unlock(&g_queue_cache_mutex);
+		return false;
+	}
+	queue_cache_calc_stat(j_queue, stat);
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	return true;
+}
+
+/**
+ * Update the member of the cached queue.
+ * QueueMemberStatus, QueueMemberAdded, QueueMemberPause.
+ * The queues not cached yet are ignored. They are seeded when needed.
+ * Runs on the event worker.
+ * @param j_evt
+ */
+static void queue_cache_evt_member_update(struct ast_json* j_evt)
+{
+	struct ast_json* j_members;
+	struct ast_json* j_member;
+	const char* queue;
+	const char* interface;
 	const char* tmp_const;
 
-	if(name == NULL) {
-		return NULL;
+	queue = ast_json_string_get(ast_json_object_get(j_evt, "queue"));
+	interface = ast_json_string_get(ast_json_object_get(j_evt, "stateinterface"));
+	if(ast_strlen_zero(interface)) {
+		interface = ast_json_string_get(ast_json_object_get(j_evt, "interface"));
+	}
+	if((queue == NULL) || ast_strlen_zero(interface)) {
+		return;
 	}
 
-	j_ami_res = ami_cmd_queue_summary(name);
-	if(j_ami_res == NULL) {
-		ast_log(LOG_NOTICE, "Could not get queue summary. name[%s]\n", name);
-		return NULL;
+	ast_mutex_lock(&g_queue_cache_mutex);
+	j_members = ast_json_object_get(ast_json_object_get(g_j_queue_cache, queue), "members");
+	if(j_members == NULL) {
+		ast_mutex_unlock(&g_queue_cache_mutex);
+		return;
 	}
 
-	// get result.
-	i = 0;
-	j_queue = NULL;
-	size = ast_json_array_size(j_ami_res);
-	for(i = 0; i < size; i++) {
-		j_tmp = ast_json_array_get(j_ami_res, i);
-		tmp_const = ast_json_string_get(ast_json_object_get(j_tmp, "Queue"));
-		if(tmp_const == NULL) {
-			continue;
-		}
-		if(strcmp(tmp_const, name) == 0) {
-			j_queue = ast_json_deep_copy(j_tmp);
-			break;
-		}
+	j_member = ast_json_object_get(j_members, interface);
+	if(j_member == NULL) {
+		j_member = ast_json_pack("{s:i, s:i}", "status", AST_DEVICE_UNKNOWN, "paused", 0);
+		ast_json_object_set(j_members, interface, j_member);
 	}
-	AST_JSON_UNREF(j_ami_res);
-	if(j_queue == NULL) {
-		ast_log(LOG_NOTICE, "Could not get queue summary. name[%s]\n", name);
-		return NULL;
+
+	// QueueMemberPause has no status.
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "status"));
+	if(tmp_const != NULL) {
+		ast_json_object_set(j_member, "status", ast_json_integer_create(atoi(tmp_const)));
+	}
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "paused"));
+	if(tmp_const != NULL) {
+		ast_json_object_set(j_member, "paused", ast_json_integer_create(atoi(tmp_const)));
+	}
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	// member could be available
+	wakeup_outbound_dialing();
+
+	return;
+}
+
+/**
+ * Remove the member of the cached queue.
+ * QueueMemberRemoved.
+ * Runs on the event worker.
+ * @param j_evt
+ */
+static void queue_cache_evt_member_removed(struct ast_json* j_evt)
+{
+	struct ast_json* j_members;
+	const char* queue;
+	const char* interface;
+
+	queue = ast_json_string_get(ast_json_object_get(j_evt, "queue"));
+	interface = ast_json_string_get(ast_json_object_get(j_evt, "stateinterface"));
+	if(ast_strlen_zero(interface)) {
+		interface = ast_json_string_get(ast_json_object_get(j_evt, "interface"));
+	}
+	if((queue == NULL) || ast_strlen_zero(interface)) {
+		return;
+	}
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	j_members = ast_json_object_get(ast_json_object_get(g_j_queue_cache, queue), "members");
+	if(j_members != NULL) {
+		ast_json_object_del(j_members, interface);
+	}
+	ast_mutex_unlock(&g_queue_cache_mutex);
+
+	return;
+}
+
+/**
+ * Update the waiting callers count of the cached queue.
+ * Given by the QueueCallerJoin/QueueCallerLeave of the dialings.
+ * @param name
+ * @param count
+ */
+void destination_queue_update_callers(const char* name, int count)
+{
+	struct ast_json* j_queue;
+
+	if(name == NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_queue_cache_mutex);
+	j_queue = ast_json_object_get(g_j_queue_cache, name);
+	if(j_queue != NULL) {
+		ast_json_object_set(j_queue, "callers", ast_json_integer_create((count > 0)? count : 0));
 	}
+	ast_mutex_unlock(&g_queue_cache_mutex);
 
-	return j_queue;
+	return;
 }
 
 static struct ast_json* create_destination_exten(struct ast_json* j_dest)
@@ -27,7 +27,11 @@ struct ast_json* get_destination(const char* uuid);
 struct ast_json* get_destinations_all(void);
 bool update_destination(const struct ast_json* j_dest);
 
+bool init_destination_handler(void);
+void term_destination_handler(void);
+
 int get_destination_available_count(struct ast_json* j_dest);
+void destination_queue_update_callers(const char* name, int count);
 struct ast_json* create_dial_destination_info(struct ast_json* j_dest);
 
 #endif /* SRC_DESTINATION_HANDLER_H_ */
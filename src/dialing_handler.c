@@ -8,23 +8,110 @@
 #include "asterisk.h"
 #include "asterisk/utils.h"
 #include "asterisk/astobj2.h"
+#include "asterisk/strings.h"
 
 #include <stdbool.h>
+#include <limits.h>
 
 #include "dialing_handler.h"
 #include "event_handler.h"
 #include "cli_handler.h"
 #include "utils.h"
 #include "res_outbound.h"
+#include "ami_handler.h"
 
-AST_MUTEX_DEFINE_STATIC(g_rb_dialing_mutex);
+AST_MUTEX_DEFINE_STATIC(g_rb_dialing_count_mutex);
+AST_MUTEX_DEFINE_STATIC(g_rb_dialing_snapshot_mutex);
+AST_MUTEX_DEFINE_STATIC(g_rb_dialing_wheel_mutex);
+AST_MUTEX_DEFINE_STATIC(g_rb_dialing_originate_mutex);
 
 static int rb_dialing_cmp_cb(void* obj, void* arg, int flags);
 static int rb_dialing_sort_cb(const void* o_left, const void* o_right, int flags);
+static int rb_dialing_name_hash_cb(const void* obj, int flags);
+static int rb_dialing_name_cmp_cb(void* obj, void* arg, int flags);
 static void rb_dialing_destructor(void* obj);
 static bool rb_dialing_update(rb_dialing* dialing);
+static void rb_dialing_count_update(rb_dialing* dialing, int diff);
+static void rb_dialing_count_update_key(const char* type, const char* key, int diff);
+static int rb_dialing_count_get(const char* type, const char* key);
+static struct ao2_container* rb_dialing_get_shard(const char* uuid);
+static int rb_dialing_intern_hash_cb(const void* obj, int flags);
+static int rb_dialing_intern_cmp_cb(void* obj, void* arg, int flags);
+static const char* rb_dialing_intern(const char* str);
+static void rb_dialing_intern_release(const char* str);
+static struct ast_json* rb_dialing_get_snapshot(const char* type, struct ast_json* j_info);
+static void rb_dialing_release_snapshots(rb_dialing* dialing);
+static void rb_dialing_init_history(void);
+static E_DIALING_EVENT_T rb_dialing_get_event_type(const char* name);
+static void rb_dialing_complete(rb_dialing* dialing);
+static void rb_dialing_init_watchdog(void);
+static uint64_t rb_dialing_get_wheel_tick(void);
+static void rb_dialing_wheel_insert(rb_dialing* dialing);
+static void rb_dialing_wheel_unlink(rb_dialing* dialing);
+static void rb_dialing_wheel_advance(struct ao2_container** expired);
+static void rb_dialing_watchdog_set(rb_dialing* dialing, E_DIALING_DEADLINE_T deadline, int timeout);
+static void rb_dialing_watchdog_clear(rb_dialing* dialing);
+static bool rb_dialing_reap(rb_dialing* dialing);
+static void rb_dialing_init_originate(void);
+static void rb_dialing_originate_done(rb_dialing* dialing, const char* result);
+static struct ast_json* rb_dialing_originate_stat_get(const char* trunk_name);
+static void rb_dialing_originate_stat_add(struct ast_json* j_obj, const char* key, int diff);
+
+#define DEF_DIALING_NAME_BUCKETS	1031
+#define DEF_DIALING_SHARDS			16
+#define DEF_DIALING_INTERN_BUCKETS	127
+#define DEF_HISTORY_EVENTS_MAX		"32"
+#define DEF_HISTORY_EVENTS_FILTER	""
+#define DEF_DIALING_TIMEOUT_ORIGINATE	"60"
+#define DEF_DIALING_TIMEOUT_CALL		"14400"
+#define DEF_DIALING_ORIGINATE_WINDOW	"0"
+#define DEF_WHEEL_L0_SIZE			256		///< level 0 slots. 1 tick per slot.
+#define DEF_WHEEL_L1_SIZE			64		///< level 1 slots. DEF_WHEEL_L0_SIZE ticks per slot.
 
-static struct ao2_container* g_rb_dialings = NULL;  ///< dialing container
+/**
+ * History event table.
+ * code_key/detail_key are the event headers kept in the compact record.
+ */
+static const struct {
+	E_DIALING_EVENT_T type;
+	const char* name;
+	const char* code_key;
+	const char* detail_key;
+} g_dialing_events[] = {
+	{E_DIALING_EVT_NEWCHANNEL,			"Newchannel",			NULL,		"channelstatedesc"},
+	{E_DIALING_EVT_NEWEXTEN,			"Newexten",				"priority",	"application"},
+	{E_DIALING_EVT_NEWSTATE,			"Newstate",				NULL,		"channelstatedesc"},
+	{E_DIALING_EVT_QUEUECALLERJOIN,		"QueueCallerJoin",		"position",	"queue"},
+	{E_DIALING_EVT_QUEUECALLERLEAVE,	"QueueCallerLeave",		"position",	"queue"},
+	{E_DIALING_EVT_ORIGINATERESPONSE,	"OriginateResponse",	"reason",	"response"},
+	{E_DIALING_EVT_AGENTCALLED,			"AgentCalled",			NULL,		"membername"},
+	{E_DIALING_EVT_AGENTCONNECT,		"AgentConnect",			"holdtime",	"membername"},
+	{E_DIALING_EVT_AGENTCOMPLETE,		"AgentComplete",		"talktime",	"reason"},
+	{E_DIALING_EVT_DIALBEGIN,			"DialBegin",			NULL,		"dialstring"},
+	{E_DIALING_EVT_DIALEND,				"DialEnd",				NULL,		"dialstatus"},
+	{E_DIALING_EVT_HANGUP,				"Hangup",				"cause",	"cause-txt"},
+	{E_DIALING_EVT_BRIDGEENTER,			"BridgeEnter",			"bridgenumchannels",	"bridgeuniqueid"},
+	{E_DIALING_EVT_VARSET,				"VarSet",				NULL,		"value"},
+};
+
+static struct ao2_container* g_rb_dialings[DEF_DIALING_SHARDS];  ///< dialing containers. sharded by uuid.
+static struct ao2_container* g_rb_dialing_names = NULL;  ///< dialing container indexed by channel name
+static struct ao2_container* g_rb_dialing_interns = NULL;  ///< interned uuid strings of the dialings
+static struct ao2_container* g_rb_dialing_completes = NULL;  ///< completion queue. hangup/error dialings. FIFO.
+static struct ast_json* g_j_dialing_snapshots = NULL;  ///< the latest info snapshots. {"camp": {"<uuid>": {...}, ...}, "plan": {...}, "dlma": {...}, "dest": {...}}
+static int g_history_events_enable = 0;		///< history_events_enable
+static int g_history_events_max = 0;			///< history_events_max. capacity of the history ring.
+static unsigned int g_history_events_filter = 0;	///< history_events_filter. bit mask of E_DIALING_EVENT_T.
+static int g_dialing_timeout_originate = 0;	///< dialing_timeout_originate(ms). 0 is disabled.
+static int g_dialing_timeout_call = 0;			///< dialing_timeout_call(ms). 0 is disabled.
+static rb_dialing* g_wheel_l0[DEF_WHEEL_L0_SIZE];	///< watchdog timing wheel level 0
+static rb_dialing* g_wheel_l1[DEF_WHEEL_L1_SIZE];	///< watchdog timing wheel level 1
+static uint64_t g_wheel_tick = 0;				///< current tick of the timing wheel
+static int g_watchdog_reaped[E_DIALING_DEADLINE_MAX];	///< reaped dialing count of each deadline type
+static struct ast_json* g_j_dialing_counts = NULL;  ///< in-flight dialing counts. {"camp": {"<uuid>": cnt, ...}, "plan": {...}, "dlma": {...}, "dest": {...}, "trunk": {...}}
+static int g_originate_window = 0;			///< originate_window. max outstanding originates. 0 is unlimited.
+static int g_originate_outstanding = 0;		///< outstanding originates. submitted, no response yet.
+static struct ast_json* g_j_originate_stats = NULL;	///< originate stats of each trunk. {"<trunk>": {"submitted": n, "success": n, "failure": n, "lost": n, "outstanding": n, "latency_total": ms, "latency_max": ms, "latency_hist": [...]}, ...}
 
 /**
  * Initiate rb_diailing.
@@ -32,11 +119,62 @@ static struct ao2_container* g_rb_dialings = NULL;  ///< dialing container
  */
 int init_rb_dialing(void)
 {
-	g_rb_dialings = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT, rb_dialing_sort_cb, rb_dialing_cmp_cb);
-	if(g_rb_dialings == NULL) {
-		ast_log(LOG_ERROR, "Could not create rbtree.\n");
+	int i;
+
+	for(i = 0; i < DEF_DIALING_SHARDS; i++) {
+		g_rb_dialings[i] = ao2_container_alloc_rbtree(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT, rb_dialing_sort_cb, rb_dialing_cmp_cb);
+		if(g_rb_dialings[i] == NULL) {
+			ast_log(LOG_ERROR, "Could not create rbtree.\n");
+			return false;
+		}
+	}
+
+	g_rb_dialing_names = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_ALLOW, DEF_DIALING_NAME_BUCKETS, rb_dialing_name_hash_cb, NULL, rb_dialing_name_cmp_cb);
+	if(g_rb_dialing_names == NULL) {
+		ast_log(LOG_ERROR, "Could not create name hash.\n");
+		return false;
+	}
+
+	g_rb_dialing_interns = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT, DEF_DIALING_INTERN_BUCKETS, rb_dialing_intern_hash_cb, NULL, rb_dialing_intern_cmp_cb);
+	if(g_rb_dialing_interns == NULL) {
+		ast_log(LOG_ERROR, "Could not create intern hash.\n");
+		return false;
+	}
+
+	g_rb_dialing_completes = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_MUTEX, 0, NULL, NULL);
+	if(g_rb_dialing_completes == NULL) {
+		ast_log(LOG_ERROR, "Could not create completion queue.\n");
 		return false;
 	}
+
+	rb_dialing_init_history();
+	rb_dialing_init_watchdog();
+	rb_dialing_init_originate();
+
+	ast_mutex_lock(&g_rb_dialing_snapshot_mutex);
+	if(g_j_dialing_snapshots != NULL) {
+		AST_JSON_UNREF(g_j_dialing_snapshots);
+	}
+	g_j_dialing_snapshots = ast_json_pack("{s:o, s:o, s:o, s:o}",
+			"camp",		ast_json_object_create(),
+			"plan",		ast_json_object_create(),
+			"dlma",		ast_json_object_create(),
+			"dest",		ast_json_object_create()
+			);
+	ast_mutex_unlock(&g_rb_dialing_snapshot_mutex);
+
+	ast_mutex_lock(&g_rb_dialing_count_mutex);
+	if(g_j_dialing_counts != NULL) {
+		AST_JSON_UNREF(g_j_dialing_counts);
+	}
+	g_j_dialing_counts = ast_json_pack("{s:o, s:o, s:o, s:o, s:o}",
+			"camp",		ast_json_object_create(),
+			"plan",		ast_json_object_create(),
+			"dlma",		ast_json_object_create(),
+			"dest",		ast_json_object_create(),
+			"trunk",	ast_json_object_create()
+			);
+	ast_mutex_unlock(&g_rb_dialing_count_mutex);
    ast_log(LOG_NOTICE, "Initiated dialing handler.\n");
 
 	return true;
@@ -61,14 +199,6 @@ static int rb_dialing_sort_cb(const void* o_left, const void* o_right, int flags
 
 		return strcmp(dialing_left->uuid, key);
 	}
-	else if(flags & OBJ_SEARCH_PARTIAL_KEY) {
-		key = (char*)o_right;
-
-		if((dialing_left->name == NULL) || (key == NULL)) {
-			return 0;
-		}
-		return strcmp(dialing_left->name, key);
-	}
 	else {
 		const rb_dialing* dialing_right;
 
@@ -103,19 +233,6 @@ static int rb_dialing_cmp_cb(void* obj, void* arg, int flags)
 		}
 		return 0;
 	}
-	else if(flags & OBJ_SEARCH_PARTIAL_KEY) {
-		key = (const char*)arg;
-
-		// channel name
-		if((dialing->name == NULL) || (key == NULL)) {
-			return 0;
-		}
-
-		if(strcmp(dialing->name, key) == 0) {
-			return CMP_MATCH;
-		}
-		return 0;
-	}
 	else {
 		// channel id
 		rb_dialing* dialing_right;
@@ -128,6 +245,343 @@ static int rb_dialing_cmp_cb(void* obj, void* arg, int flags)
 	}
 }
 
+/**
+ * Return the dialing container of the given uuid.
+ * Each container has its own lock, so the dialings of the different shards don't contend.
+ * @param uuid
+ * @return
+ */
+static struct ao2_container* rb_dialing_get_shard(const char* uuid)
+{
+	return g_rb_dialings[ast_str_hash(uuid) % DEF_DIALING_SHARDS];
+}
+
+/**
+ * Hash callback for the channel name index.
+ * @param obj
+ * @param flags
+ * @return
+ */
+static int rb_dialing_name_hash_cb(const void* obj, int flags)
+{
+	const rb_dialing* dialing;
+	const char* key;
+
+	if(flags & OBJ_SEARCH_KEY) {
+		key = (const char*)obj;
+	}
+	else {
+		dialing = (const rb_dialing*)obj;
+		key = dialing->name;
+	}
+
+	if(key == NULL) {
+		return 0;
+	}
+
+	return ast_str_hash(key);
+}
+
+/**
+ * Compare callback for the channel name index.
+ * @param obj
+ * @param arg
+ * @param flags
+ * @return
+ */
+static int rb_dialing_name_cmp_cb(void* obj, void* arg, int flags)
+{
+	rb_dialing* dialing;
+	const char* key;
+
+	dialing = (rb_dialing*)obj;
+
+	if(flags & OBJ_SEARCH_KEY) {
+		key = (const char*)arg;
+	}
+	else {
+		key = ((rb_dialing*)arg)->name;
+	}
+
+	if((dialing->name == NULL) || (key == NULL)) {
+		return 0;
+	}
+
+	if(strcmp(dialing->name, key) == 0) {
+		return CMP_MATCH;
+	}
+	return 0;
+}
+
+/**
+ * Hash callback for the interned strings.
+ * @param obj
+ * @param flags
+ * @return
+ */
+static int rb_dialing_intern_hash_cb(const void* obj, __attribute__((unused)) int flags)
+{
+	return ast_str_hash((const char*)obj);
+}
+
+/**
+ * Compare callback for the interned strings.
+ * @param obj
+ * @param arg
+ * @param flags
+ * @return
+ */
+static int rb_dialing_intern_cmp_cb(void* obj, void* arg, __attribute__((unused)) int flags)
+{
+	if(strcmp((const char*)obj, (const char*)arg) == 0) {
+		return CMP_MATCH;
+	}
+	return 0;
+}
+
+/**
+ * Return the interned string of the given string.
+ * The same uuids(campaign, plan, ...) are shared by the dialings.
+ * Must be released by rb_dialing_intern_release().
+ * @param str
+ * @return
+ */
+static const char* rb_dialing_intern(const char* str)
+{
+	char* res;
+
+	if(str == NULL) {
+		return NULL;
+	}
+
+	ao2_lock(g_rb_dialing_interns);
+	res = ao2_find(g_rb_dialing_interns, str, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if(res == NULL) {
+		res = ao2_alloc_options(strlen(str) + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK);
+		if(res != NULL) {
+			strcpy(res, str);
+			ao2_link_flags(g_rb_dialing_interns, res, OBJ_NOLOCK);
+		}
+	}
+	ao2_unlock(g_rb_dialing_interns);
+
+	return res;
+}
+
+/**
+ * Release the interned string.
+ * Removes the string from the intern container when nobody uses it.
+ * @param str
+ */
+static void rb_dialing_intern_release(const char* str)
+{
+	if(str == NULL) {
+		return;
+	}
+
+	ao2_lock(g_rb_dialing_interns);
+	if(ao2_ref((void*)str, 0) == 2) {
+		// only the container has it.
+		ao2_unlink_flags(g_rb_dialing_interns, (void*)str, OBJ_NOLOCK);
+	}
+	ao2_ref((void*)str, -1);
+	ao2_unlock(g_rb_dialing_interns);
+
+	return;
+}
+
+/**
+ * Initiate history event options.
+ */
+static void rb_dialing_init_history(void)
+{
+	const char* tmp_const;
+	char* tmp;
+	char* buf;
+	char* name;
+	E_DIALING_EVENT_T type;
+
+	// history_events_enable
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "history_events_enable"));
+	g_history_events_enable = (tmp_const != NULL)? atoi(tmp_const) : 0;
+
+	// history_events_max
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "history_events_max"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_HISTORY_EVENTS_MAX;
+		ast_log(LOG_NOTICE, "Could not get correct history_events_max value. Set default. history_events_max[%s]\n", tmp_const);
+	}
+	g_history_events_max = atoi(tmp_const);
+	if(g_history_events_max <= 0) {
+		g_history_events_enable = 0;
+	}
+
+	// history_events_filter
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "history_events_filter"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_HISTORY_EVENTS_FILTER;
+		ast_log(LOG_NOTICE, "Could not get correct history_events_filter value. Set default. history_events_filter[%s]\n", tmp_const);
+	}
+
+	g_history_events_filter = 0;
+	tmp = ast_strdup(tmp_const);
+	buf = tmp;
+	while((name = strsep(&buf, ",")) != NULL) {
+		name = ast_strip(name);
+		if(strlen(name) == 0) {
+			continue;
+		}
+
+		type = rb_dialing_get_event_type(name);
+		if(type == E_DIALING_EVT_UNKNOWN) {
+			ast_log(LOG_WARNING, "Unsupported history event. name[%s]\n", name);
+			continue;
+		}
+		g_history_events_filter |= (1 << type);
+	}
+	ast_free(tmp);
+
+	// no filter. all events.
+	if(g_history_events_filter == 0) {
+		g_history_events_filter = ~0;
+	}
+
+	return;
+}
+
+/**
+ * Initiate the watchdog options and the timing wheel.
+ */
+static void rb_dialing_init_watchdog(void)
+{
+	const char* tmp_const;
+
+	// dialing_timeout_originate
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "dialing_timeout_originate"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_DIALING_TIMEOUT_ORIGINATE;
+		ast_log(LOG_NOTICE, "Could not get correct dialing_timeout_originate value. Set default. dialing_timeout_originate[%s]\n", tmp_const);
+	}
+	g_dialing_timeout_originate = atoi(tmp_const) * 1000;
+
+	// dialing_timeout_call
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "dialing_timeout_call"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_DIALING_TIMEOUT_CALL;
+		ast_log(LOG_NOTICE, "Could not get correct dialing_timeout_call value. Set default. dialing_timeout_call[%s]\n", tmp_const);
+	}
+	g_dialing_timeout_call = atoi(tmp_const) * 1000;
+
+	ast_mutex_lock(&g_rb_dialing_wheel_mutex);
+	memset(g_wheel_l0, 0, sizeof(g_wheel_l0));
+	memset(g_wheel_l1, 0, sizeof(g_wheel_l1));
+	memset(g_watchdog_reaped, 0, sizeof(g_watchdog_reaped));
+	g_wheel_tick = rb_dialing_get_wheel_tick();
+	ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+
+	return;
+}
+
+/**
+ * Initiate the originate window and the originate stats.
+ */
+static void rb_dialing_init_originate(void)
+{
+	const char* tmp_const;
+
+	// originate_window
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "originate_window"));
+	if((tmp_const == NULL) || (atoi(tmp_const) < 0)) {
+		tmp_const = DEF_DIALING_ORIGINATE_WINDOW;
+		ast_log(LOG_NOTICE, "Could not get correct originate_window value. Set default. originate_window[%s]\n", tmp_const);
+	}
+
+	ast_mutex_lock(&g_rb_dialing_originate_mutex);
+	g_originate_window = atoi(tmp_const);
+	g_originate_outstanding = 0;
+	if(g_j_originate_stats != NULL) {
+		AST_JSON_UNREF(g_j_originate_stats);
+	}
+	g_j_originate_stats = ast_json_object_create();
+	ast_mutex_unlock(&g_rb_dialing_originate_mutex);
+
+	return;
+}
+
+/**
+ * Return the history event type of the given event name.
+ * @param name
+ * @return
+ */
+static E_DIALING_EVENT_T rb_dialing_get_event_type(const char* name)
+{
+	unsigned int i;
+
+	if(name == NULL) {
+		return E_DIALING_EVT_UNKNOWN;
+	}
+
+	for(i = 0; i < ARRAY_LEN(g_dialing_events); i++) {
+		if(strcasecmp(g_dialing_events[i].name, name) == 0) {
+			return g_dialing_events[i].type;
+		}
+	}
+
+	return E_DIALING_EVT_UNKNOWN;
+}
+
+/**
+ * Return the shared snapshot of the given info.
+ * The snapshot is versioned by the tm_update of the info. If the info has been changed,
+ * a new snapshot is created and the dialings of the old one keep it until they are destroyed.
+ * The returned snapshot is immutable. Must be unreferenced by the caller.
+ * @param type
+ * @param j_info
+ * @return
+ */
+static struct ast_json* rb_dialing_get_snapshot(const char* type, struct ast_json* j_info)
+{
+	struct ast_json* j_snapshots;
+	struct ast_json* j_snapshot;
+	const char* uuid;
+	const char* version;
+	const char* tmp_const;
+
+	uuid = ast_json_string_get(ast_json_object_get(j_info, "uuid"));
+	if(uuid == NULL) {
+		return ast_json_deep_copy(j_info);
+	}
+	version = ast_json_string_get(ast_json_object_get(j_info, "tm_update"));
+
+	ast_mutex_lock(&g_rb_dialing_snapshot_mutex);
+
+	j_snapshots = ast_json_object_get(g_j_dialing_snapshots, type);
+	j_snapshot = ast_json_object_get(j_snapshots, uuid);
+	if(j_snapshot != NULL) {
+		tmp_const = ast_json_string_get(ast_json_object_get(j_snapshot, "tm_update"));
+		if((version != NULL) && (tmp_const != NULL) && (strcmp(version, tmp_const) == 0)) {
+			j_snapshot = ast_json_ref(j_snapshot);
+			ast_mutex_unlock(&g_rb_dialing_snapshot_mutex);
+			return j_snapshot;
+		}
+		if((version == NULL) && (tmp_const == NULL) && (ast_json_equal(j_snapshot, j_info) == 1)) {
+			j_snapshot = ast_json_ref(j_snapshot);
+			ast_mutex_unlock(&g_rb_dialing_snapshot_mutex);
+			return j_snapshot;
+		}
+	}
+
+	// new version
+	j_snapshot = ast_json_deep_copy(j_info);
+	if(j_snapshots != NULL) {
+		ast_json_object_set(j_snapshots, uuid, ast_json_ref(j_snapshot));
+	}
+
+	ast_mutex_unlock(&g_rb_dialing_snapshot_mutex);
+
+	return j_snapshot;
+}
+
 /**
  * Create dialing obj.
  * @param j_camp
@@ -162,6 +616,10 @@ rb_dialing* rb_dialing_create(
 
 	// create rb object
 	dialing = ao2_alloc(sizeof(rb_dialing), rb_dialing_destructor);
+	if(dialing == NULL) {
+		ast_log(LOG_ERROR, "Could not allocate the dialing. uuid[%s]\n", dialing_uuid);
+		return NULL;
+	}
 
 	// init status
 	dialing->status = E_DIALING_NONE;
@@ -169,7 +627,18 @@ rb_dialing* rb_dialing_create(
 	// init json info
 	dialing->uuid = ast_strdup(dialing_uuid);
 	dialing->name = NULL;   // not set here. Will be set when receiving the AMI NewChannel message.
-	dialing->j_events = ast_json_array_create();
+	dialing->in_flight = false;
+	dialing->completed = false;
+	dialing->originate_pending = false;
+	dialing->originate_outstanding = false;
+	dialing->wheel_prev = NULL;
+	dialing->wheel_next = NULL;
+	dialing->wheel_slot = NULL;
+	dialing->wheel_expire = 0;
+	dialing->deadline = E_DIALING_DEADLINE_NONE;
+	dialing->events = NULL;	// allocated when the first history event comes.
+	dialing->events_head = 0;
+	dialing->events_count = 0;
 	dialing->j_dialing = ast_json_object_create();
 	dialing->j_event = ast_json_object_create();
 
@@ -182,17 +651,33 @@ rb_dialing* rb_dialing_create(
 	ast_json_object_set(dialing->j_dialing, "dl_list_uuid", ast_json_ref(ast_json_object_get(j_dial, "uuid")));
 
 	// set info
-	ast_json_object_set(dialing->j_dialing, "info_camp", ast_json_deep_copy(j_camp));
-	ast_json_object_set(dialing->j_dialing, "info_plan", ast_json_deep_copy(j_plan));
-	ast_json_object_set(dialing->j_dialing, "info_dlma", ast_json_deep_copy(j_dlma));
-	ast_json_object_set(dialing->j_dialing, "info_dest", ast_json_deep_copy(j_dest));
-	ast_json_object_set(dialing->j_dialing, "info_dl_list", ast_json_deep_copy(j_dl_list));
-	ast_json_object_set(dialing->j_dialing, "info_dial", ast_json_deep_copy(j_dial));
+	// the dl_list and dial info are for this dialing only. Keep the reference.
+	dialing->j_info_camp = rb_dialing_get_snapshot("camp", j_camp);
+	dialing->j_info_plan = rb_dialing_get_snapshot("plan", j_plan);
+	dialing->j_info_dlma = rb_dialing_get_snapshot("dlma", j_dlma);
+	dialing->j_info_dest = rb_dialing_get_snapshot("dest", j_dest);
+	dialing->j_info_dl_list = ast_json_ref(j_dl_list);
+	dialing->j_info_dial = ast_json_ref(j_dial);
 
 
 	// dial info
 	// dial_channel
 	ast_json_object_update(dialing->j_dialing, j_dial);
+
+	// hot fields
+	dialing->camp_uuid = rb_dialing_intern(ast_json_string_get(ast_json_object_get(j_camp, "uuid")));
+	dialing->plan_uuid = rb_dialing_intern(ast_json_string_get(ast_json_object_get(j_plan, "uuid")));
+	dialing->dlma_uuid = rb_dialing_intern(ast_json_string_get(ast_json_object_get(j_dlma, "uuid")));
+	dialing->dest_uuid = rb_dialing_intern(ast_json_string_get(ast_json_object_get(j_dest, "uuid")));
+	dialing->trunk_name = rb_dialing_intern(ast_json_string_get(ast_json_object_get(j_plan, "trunk_name")) ? : "");
+	dialing->dl_list_uuid = ast_strdup(ast_json_string_get(ast_json_object_get(j_dial, "uuid")));
+	dialing->dial_index = ast_json_integer_get(ast_json_object_get(j_dial, "dial_index"));
+	dialing->dial_trycnt = ast_json_integer_get(ast_json_object_get(j_dial, "dial_trycnt"));
+	dialing->dial_timeout = ast_json_integer_get(ast_json_object_get(j_dial, "dial_timeout"));
+	dialing->res_dial = 0;
+	dialing->res_hangup = 0;
+	dialing->res_hangup_detail = NULL;
+
 	ast_log(LOG_DEBUG, "Check value. dial_channel[%s], dial_addr[%s], dial_index[%"PRIdMAX"], dial_trycnt[%"PRIdMAX"], dial_timeout[%"PRIdMAX"], dial_type[%"PRIdMAX"], dial_exten[%s], dial_application[%s]\n",
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dial_channel"))? : "",
 			ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dial_addr"))? : "",
@@ -212,34 +697,59 @@ rb_dialing* rb_dialing_create(
 	ast_json_object_set(dialing->j_dialing, "tm_dialing", ast_json_string_create(tmp));
 	ast_free(tmp);
 
-	clock_gettime(CLOCK_REALTIME, &dialing->timeptr_update);
+	clock_gettime(CLOCK_REALTIME, &dialing->timeptr_create);
+	dialing->timeptr_update = dialing->timeptr_create;
 
 	// insert into rb
-	ast_mutex_lock(&g_rb_dialing_mutex);
-	if(ao2_link(g_rb_dialings, dialing) == 0) {
+	ao2_lock(dialing);
+	if(ao2_link(rb_dialing_get_shard(dialing->uuid), dialing) == 0) {
 		ast_log(LOG_DEBUG, "Could not register the dialing. uuid[%s]\n", dialing->uuid);
-		rb_dialing_destructor(dialing);
-		ast_mutex_unlock(&g_rb_dialing_mutex);
+		ao2_unlock(dialing);
+		ao2_ref(dialing, -1);
 		return NULL;
 	}
 
+	// count in-flight
+	dialing->in_flight = true;
+	rb_dialing_count_update(dialing, 1);
+
+	// watchdog for the originate response
+	if(g_dialing_timeout_originate > 0) {
+		rb_dialing_watchdog_set(dialing, E_DIALING_DEADLINE_ORIGINATE, dialing->dial_timeout + g_dialing_timeout_originate);
+	}
+
+	ao2_unlock(dialing);
+
 	// send event to all
+	// not under the dialing lock. the manager event could block.
 	send_manager_evt_out_dialing_create(dialing);
 
-	ast_mutex_unlock(&g_rb_dialing_mutex);
-
 	return dialing;
 }
 
 void rb_dialing_destory(rb_dialing* dialing)
 {
-	ast_mutex_lock(&g_rb_dialing_mutex);
-
 	ast_log(LOG_DEBUG, "Destroying dialing.\n");
-	ao2_unlink(g_rb_dialings, dialing);
-	ao2_ref(dialing, -1);
 
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	ao2_lock(dialing);
+	if(dialing->in_flight == false) {
+		// already destroyed
+		ao2_unlock(dialing);
+		return;
+	}
+	dialing->in_flight = false;
+	rb_dialing_count_update(dialing, -1);
+	rb_dialing_release_snapshots(dialing);
+	rb_dialing_watchdog_clear(dialing);
+	rb_dialing_originate_done(dialing, "lost");
+
+	if(dialing->name != NULL) {
+		ao2_unlink(g_rb_dialing_names, dialing);
+	}
+	ao2_unlink(rb_dialing_get_shard(dialing->uuid), dialing);
+	ao2_unlock(dialing);
+
+	ao2_ref(dialing, -1);
 
 	return;
 }
@@ -255,19 +765,33 @@ static void rb_dialing_destructor(void* obj)
 
 	if(dialing->uuid != NULL)		   ast_free(dialing->uuid);
 	if(dialing->name != NULL)		   ast_free(dialing->name);
+	if(dialing->dl_list_uuid != NULL)	ast_free(dialing->dl_list_uuid);
+	if(dialing->res_hangup_detail != NULL)	ast_free(dialing->res_hangup_detail);
 	if(dialing->j_dialing != NULL)	  AST_JSON_UNREF(dialing->j_dialing);
 	if(dialing->j_event != NULL)	  AST_JSON_UNREF(dialing->j_event);
-	if(dialing->j_events != NULL)	  AST_JSON_UNREF(dialing->j_events);
+	if(dialing->events != NULL)		 ast_free(dialing->events);
+	if(dialing->j_info_camp != NULL)	AST_JSON_UNREF(dialing->j_info_camp);
+	if(dialing->j_info_plan != NULL)	AST_JSON_UNREF(dialing->j_info_plan);
+	if(dialing->j_info_dlma != NULL)	AST_JSON_UNREF(dialing->j_info_dlma);
+	if(dialing->j_info_dest != NULL)	AST_JSON_UNREF(dialing->j_info_dest);
+	if(dialing->j_info_dl_list != NULL)	AST_JSON_UNREF(dialing->j_info_dl_list);
+	if(dialing->j_info_dial != NULL)	AST_JSON_UNREF(dialing->j_info_dial);
 	if(dialing->tm_create != NULL)  ast_free(dialing->tm_create);
 	if(dialing->tm_update != NULL)  ast_free(dialing->tm_update);
 	if(dialing->tm_delete != NULL)  ast_free(dialing->tm_delete);
 
+	rb_dialing_intern_release(dialing->camp_uuid);
+	rb_dialing_intern_release(dialing->plan_uuid);
+	rb_dialing_intern_release(dialing->dlma_uuid);
+	rb_dialing_intern_release(dialing->dest_uuid);
+	rb_dialing_intern_release(dialing->trunk_name);
+
 	ast_log(LOG_DEBUG, "Called destroyer.\n");
 }
 
 /**
- * There's no mutex lock here.
- * locking is caller's responsibility.
+ * There's no lock here.
+ * The dialing lock is caller's responsibility.
  * @param dialing
  * @return
  */
@@ -295,67 +819,177 @@ bool rb_dialing_update_name(rb_dialing* dialing, const char* name)
 		return false;
 	}
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
+	ao2_lock(dialing);
 
+	// re-index by the new name
+	if(dialing->name != NULL) {
+		ao2_unlink(g_rb_dialing_names, dialing);
+		ast_free(dialing->name);
+	}
 	dialing->name = ast_strdup(name);
+	ao2_link(g_rb_dialing_names, dialing);
 
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	ao2_unlock(dialing);
 
 	return true;
 }
 
+/**
+ * Append the event to the history events.
+ * Keeps the compact record only. The oldest one is overwritten when the history is full.
+ * @param dialing
+ * @param j_evt
+ * @return
+ */
 bool rb_dialing_update_events_append(rb_dialing* dialing, struct ast_json* j_evt)
 {
+	dialing_event event;
 	const char* tmp_const;
-	int ret;
+	unsigned int i;
 
 	if((dialing == NULL) || (j_evt == NULL)) {
 		return false;
 	}
 
-	// debug only.
-	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "history_events_enable"));
-	if(tmp_const == NULL) {
+	if(g_history_events_enable != 1) {
 		return true;
 	}
 
-	ret = atoi(tmp_const);
-	if(ret != 1) {
+	event.type = rb_dialing_get_event_type(ast_json_string_get(ast_json_object_get(j_evt, "event")));
+	if((g_history_events_filter & (1 << event.type)) == 0) {
 		return true;
 	}
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
+	// create record
+	clock_gettime(CLOCK_REALTIME, &event.tm_event);
+	tmp_const = ast_json_string_get(ast_json_object_get(j_evt, "channelstate"));
+	event.channelstate = (tmp_const != NULL)? atoi(tmp_const) : -1;
+	event.code = 0;
+	event.detail[0] = '\0';
+	for(i = 0; i < ARRAY_LEN(g_dialing_events); i++) {
+		if(g_dialing_events[i].type != event.type) {
+			continue;
+		}
+
+		if(g_dialing_events[i].code_key != NULL) {
+			tmp_const = ast_json_string_get(ast_json_object_get(j_evt, g_dialing_events[i].code_key));
+			event.code = (tmp_const != NULL)? atoi(tmp_const) : 0;
+		}
+		tmp_const = ast_json_string_get(ast_json_object_get(j_evt, g_dialing_events[i].detail_key));
+		ast_copy_string(event.detail, tmp_const ? : "", sizeof(event.detail));
+		break;
+	}
+
+	ao2_lock(dialing);
+
+	if(dialing->events == NULL) {
+		dialing->events = ast_calloc(g_history_events_max, sizeof(dialing_event));
+		if(dialing->events == NULL) {
+			ao2_unlock(dialing);
+			return false;
+		}
+	}
 
-	ast_json_array_append(dialing->j_events, ast_json_ref(j_evt));
+	dialing->events[dialing->events_head] = event;
+	dialing->events_head = (dialing->events_head + 1) % g_history_events_max;
+	if(dialing->events_count < g_history_events_max) {
+		dialing->events_count++;
+	}
 
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	ao2_unlock(dialing);
 
 	return true;
 }
 
-
 /**
- * Update dialing res
+ * Return the history events json array.
+ * Expands the compact records, oldest first.
  * @param dialing
- * @param j_res
  * @return
  */
-bool rb_dialing_update_dialing_update(rb_dialing* dialing, struct ast_json* j_res)
+struct ast_json* rb_dialing_get_events_json(rb_dialing* dialing)
 {
-	int ret;
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+	dialing_event* event;
+	char* timestamp;
+	char* tmp;
+	unsigned int i;
+	int idx;
+	int start;
 
-	if((dialing == NULL) || (j_res == NULL)) {
-		return false;
-	}
+	if(dialing == NULL) {
+		return NULL;
+	}
+
+	j_res = ast_json_array_create();
+
+	ao2_lock(dialing);
+	start = dialing->events_head - dialing->events_count;
+	if(start < 0) {
+		start += g_history_events_max;
+	}
+	for(idx = 0; idx < dialing->events_count; idx++) {
+		event = &dialing->events[(start + idx) % g_history_events_max];
+
+		timestamp = get_utc_timestamp_using_timespec(event->tm_event);
+		j_tmp = ast_json_pack("{s:s, s:s}",
+				"event",	"Unknown",
+				"tm_event",	timestamp ? : ""
+				);
+		ast_free(timestamp);
+
+		if(event->channelstate >= 0) {
+			ast_asprintf(&tmp, "%d", event->channelstate);
+			ast_json_object_set(j_tmp, "channelstate", ast_json_string_create(tmp));
+			ast_free(tmp);
+		}
+
+		for(i = 0; i < ARRAY_LEN(g_dialing_events); i++) {
+			if(g_dialing_events[i].type != event->type) {
+				continue;
+			}
+
+			ast_json_object_set(j_tmp, "event", ast_json_string_create(g_dialing_events[i].name));
+			if(g_dialing_events[i].code_key != NULL) {
+				ast_asprintf(&tmp, "%d", event->code);
+				ast_json_object_set(j_tmp, g_dialing_events[i].code_key, ast_json_string_create(tmp));
+				ast_free(tmp);
+			}
+			ast_json_object_set(j_tmp, g_dialing_events[i].detail_key, ast_json_string_create(event->detail));
+			break;
+		}
+
+		ast_json_array_append(j_res, j_tmp);
+	}
+	ao2_unlock(dialing);
+
+	return j_res;
+}
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
+
+/**
+ * Update dialing res
+ * @param dialing
+ * @param j_res
+ * @return
+ */
+bool rb_dialing_update_dialing_update(rb_dialing* dialing, struct ast_json* j_res)
+{
+	int ret;
+
+	if((dialing == NULL) || (j_res == NULL)) {
+		return false;
+	}
+
+	ao2_lock(dialing);
 
 	ast_json_object_update(dialing->j_dialing, j_res);
 
 	// send update event AMI
 	ret = rb_dialing_update(dialing);
 
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	ao2_unlock(dialing);
 	if(ret != true) {
 		return false;
 	}
@@ -376,11 +1010,11 @@ bool rb_dialing_update_current_update(rb_dialing* dialing, struct ast_json* j_ev
 		return false;
 	}
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
+	ao2_lock(dialing);
 
 	ast_json_object_update(dialing->j_event, j_evt);
 
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	ao2_unlock(dialing);
 
 	return true;
 }
@@ -397,34 +1031,549 @@ bool rb_dialing_update_event_substitute(rb_dialing* dialing, struct ast_json* j_
 		return false;
 	}
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
+	ao2_lock(dialing);
+
+	if(dialing->j_event != NULL) {
+		AST_JSON_UNREF(dialing->j_event);
+	}
+
+	dialing->j_event = ast_json_deep_copy(j_evt);
+
+	ao2_unlock(dialing);
+
+	return true;
+}
+
+/**
+ * Update dialing result.
+ * The AMI update event is sent by the next rb_dialing_update_dialing_update().
+ * @param dialing
+ * @param res_dial
+ * @return
+ */
+bool rb_dialing_update_res_dial(rb_dialing* dialing, int res_dial)
+{
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+
+	dialing->res_dial = res_dial;
+
+	ao2_unlock(dialing);
+
+	return true;
+}
+
+/**
+ * Update originate pending flag.
+ * The dialing originated by the core has no OriginateResponse event.
+ * The pending flag is taken by the first answer or hangup event instead.
+ * @param dialing
+ * @param pending
+ * @return
+ */
+bool rb_dialing_update_originate_pending(rb_dialing* dialing, bool pending)
+{
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+
+	dialing->originate_pending = pending;
+
+	ao2_unlock(dialing);
+
+	return true;
+}
+
+/**
+ * Take the originate pending flag.
+ * Returns true only once, if the pending flag was set.
+ * @param dialing
+ * @return
+ */
+bool rb_dialing_take_originate_pending(rb_dialing* dialing)
+{
+	bool ret;
+
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+
+	ret = dialing->originate_pending;
+	dialing->originate_pending = false;
+
+	ao2_unlock(dialing);
+
+	return ret;
+}
+
+/**
+ * Update hangup result.
+ * The AMI update event is sent by the next rb_dialing_update_dialing_update().
+ * @param dialing
+ * @param res_hangup
+ * @param detail
+ * @return
+ */
+bool rb_dialing_update_res_hangup(rb_dialing* dialing, int res_hangup, const char* detail)
+{
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+
+	dialing->res_hangup = res_hangup;
+	if(dialing->res_hangup_detail != NULL) {
+		ast_free(dialing->res_hangup_detail);
+	}
+	dialing->res_hangup_detail = (detail != NULL)? ast_strdup(detail) : NULL;
+
+	ao2_unlock(dialing);
+
+	return true;
+}
+
+/**
+ * Update dialing status.
+ * Pushes the dialing to the completion queue when it reaches hangup or error.
+ * @param dialing
+ * @param status
+ * @return
+ */
+bool rb_dialing_update_status(rb_dialing* dialing, E_DIALING_STATUS_T status)
+{
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+
+	dialing->status = status;
+
+	if((status == E_DIALING_HANGUP) || (status == E_DIALING_ERROR)) {
+		rb_dialing_complete(dialing);
+	}
+	else if((status == E_DIALING_ORIGINATE_RESPONSE) && (dialing->completed == false)) {
+		// watchdog for the call duration
+		rb_dialing_watchdog_set(dialing, E_DIALING_DEADLINE_CALL, g_dialing_timeout_call);
+	}
+
+	ao2_unlock(dialing);
+
+	return true;
+}
+
+/**
+ * Push the dialing to the completion queue and stop the watchdog.
+ * Pushes only once.
+ * There's no lock here.
+ * The dialing lock is caller's responsibility.
+ * @param dialing
+ */
+static void rb_dialing_complete(rb_dialing* dialing)
+{
+	rb_dialing_watchdog_clear(dialing);
+
+	if(dialing->completed == true) {
+		return;
+	}
+
+	dialing->completed = true;
+	ao2_link(g_rb_dialing_completes, dialing);
+
+	return;
+}
+
+/**
+ * Pop the oldest completed(hangup/error) dialing from the completion queue.
+ * The already destroyed dialings are skipped.
+ * Returns the reference. The caller must release it with ao2_ref(dialing, -1).
+ * @return
+ */
+rb_dialing* rb_dialing_pop_completed(void)
+{
+	rb_dialing* dialing;
+
+	while(1) {
+		dialing = ao2_callback(g_rb_dialing_completes, OBJ_UNLINK, NULL, NULL);
+		if(dialing == NULL) {
+			return NULL;
+		}
+
+		ao2_lock(dialing);
+		if(dialing->in_flight == true) {
+			ao2_unlock(dialing);
+			return dialing;
+		}
+		ao2_unlock(dialing);
+
+		ao2_ref(dialing, -1);
+	}
+
+	return NULL;
+}
+
+/**
+ * Push the dialing back to the completion queue.
+ * Used when the finalizing was failed. It will be retried later.
+ * @param dialing
+ * @return
+ */
+bool rb_dialing_push_completed(rb_dialing* dialing)
+{
+	int ret;
+
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ret = ao2_link(g_rb_dialing_completes, dialing);
+	if(ret == 0) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Return the current tick of the watchdog.
+ * @return
+ */
+static uint64_t rb_dialing_get_wheel_tick(void)
+{
+	struct timespec timeptr;
+
+	clock_gettime(CLOCK_MONOTONIC, &timeptr);
+
+	return (((uint64_t)timeptr.tv_sec * 1000) + (timeptr.tv_nsec / 1000000)) / DEF_DIALING_WATCHDOG_TICK;
+}
+
+/**
+ * Insert the dialing into the timing wheel slot of its deadline.
+ * The deadlines beyond the wheel are parked at the farthest slot and re-inserted by the cascade.
+ * There's no lock here.
+ * The wheel lock is caller's responsibility.
+ * @param dialing
+ */
+static void rb_dialing_wheel_insert(rb_dialing* dialing)
+{
+	rb_dialing** slot;
+	uint64_t expire;
+	uint64_t delta;
+
+	expire = dialing->wheel_expire;
+	if(expire <= g_wheel_tick) {
+		expire = g_wheel_tick + 1;
+	}
+	delta = expire - g_wheel_tick;
+
+	if(delta < DEF_WHEEL_L0_SIZE) {
+		slot = &g_wheel_l0[expire % DEF_WHEEL_L0_SIZE];
+	}
+	else {
+		if(delta >= (uint64_t)DEF_WHEEL_L0_SIZE * (DEF_WHEEL_L1_SIZE - 1)) {
+			expire = g_wheel_tick + ((uint64_t)DEF_WHEEL_L0_SIZE * (DEF_WHEEL_L1_SIZE - 1));
+		}
+		slot = &g_wheel_l1[(expire / DEF_WHEEL_L0_SIZE) % DEF_WHEEL_L1_SIZE];
+	}
+
+	dialing->wheel_prev = NULL;
+	dialing->wheel_next = *slot;
+	if(*slot != NULL) {
+		(*slot)->wheel_prev = dialing;
+	}
+	*slot = dialing;
+	dialing->wheel_slot = slot;
+
+	return;
+}
+
+/**
+ * Unlink the dialing from the timing wheel.
+ * There's no lock here.
+ * The wheel lock is caller's responsibility.
+ * @param dialing
+ */
+static void rb_dialing_wheel_unlink(rb_dialing* dialing)
+{
+	if(dialing->wheel_slot == NULL) {
+		return;
+	}
+
+	if(dialing->wheel_prev != NULL) {
+		dialing->wheel_prev->wheel_next = dialing->wheel_next;
+	}
+	else {
+		*dialing->wheel_slot = dialing->wheel_next;
+	}
+	if(dialing->wheel_next != NULL) {
+		dialing->wheel_next->wheel_prev = dialing->wheel_prev;
+	}
+
+	dialing->wheel_slot = NULL;
+	dialing->wheel_prev = NULL;
+	dialing->wheel_next = NULL;
+
+	return;
+}
+
+/**
+ * Advance the timing wheel one tick.
+ * Cascades the level 1 slot when the level 0 wraps, then takes out the expired dialings of the current slot.
+ * The wheel references of the expired dialings are moved to the expired container.
+ * There's no lock here.
+ * The wheel lock is caller's responsibility.
+ * @param expired
+ */
+static void rb_dialing_wheel_advance(struct ao2_container** expired)
+{
+	rb_dialing* dialing;
+	rb_dialing* next;
+	int idx;
+
+	g_wheel_tick++;
+	idx = g_wheel_tick % DEF_WHEEL_L0_SIZE;
+
+	// cascade
+	if(idx == 0) {
+		dialing = g_wheel_l1[(g_wheel_tick / DEF_WHEEL_L0_SIZE) % DEF_WHEEL_L1_SIZE];
+		g_wheel_l1[(g_wheel_tick / DEF_WHEEL_L0_SIZE) % DEF_WHEEL_L1_SIZE] = NULL;
+		while(dialing != NULL) {
+			next = dialing->wheel_next;
+			rb_dialing_wheel_insert(dialing);
+			dialing = next;
+		}
+	}
+
+	dialing = g_wheel_l0[idx];
+	g_wheel_l0[idx] = NULL;
+	while(dialing != NULL) {
+		next = dialing->wheel_next;
+		if(dialing->wheel_expire > g_wheel_tick) {
+			rb_dialing_wheel_insert(dialing);
+			dialing = next;
+			continue;
+		}
+
+		dialing->wheel_slot = NULL;
+		dialing->wheel_prev = NULL;
+		dialing->wheel_next = NULL;
+
+		if(*expired == NULL) {
+			*expired = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL);
+		}
+		if(*expired != NULL) {
+			ao2_link(*expired, dialing);
+		}
+		ao2_ref(dialing, -1);
+
+		dialing = next;
+	}
+
+	return;
+}
+
+/**
+ * Set the watchdog deadline of the dialing.
+ * The timing wheel keeps the reference of the dialing.
+ * @param dialing
+ * @param deadline
+ * @param timeout		timeout(ms). 0 clears the watchdog.
+ */
+static void rb_dialing_watchdog_set(rb_dialing* dialing, E_DIALING_DEADLINE_T deadline, int timeout)
+{
+	if(timeout <= 0) {
+		rb_dialing_watchdog_clear(dialing);
+		return;
+	}
+
+	ast_mutex_lock(&g_rb_dialing_wheel_mutex);
+
+	if(dialing->wheel_slot == NULL) {
+		ao2_ref(dialing, +1);
+	}
+	else {
+		rb_dialing_wheel_unlink(dialing);
+	}
+
+	dialing->deadline = deadline;
+	dialing->wheel_expire = g_wheel_tick + ((timeout + DEF_DIALING_WATCHDOG_TICK - 1) / DEF_DIALING_WATCHDOG_TICK);
+	rb_dialing_wheel_insert(dialing);
+
+	ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+
+	return;
+}
+
+/**
+ * Clear the watchdog deadline of the dialing.
+ * @param dialing
+ */
+static void rb_dialing_watchdog_clear(rb_dialing* dialing)
+{
+	ast_mutex_lock(&g_rb_dialing_wheel_mutex);
+	if(dialing->wheel_slot == NULL) {
+		ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+		return;
+	}
+	rb_dialing_wheel_unlink(dialing);
+	dialing->deadline = E_DIALING_DEADLINE_NONE;
+	ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+
+	ao2_ref(dialing, -1);
+
+	return;
+}
+
+/**
+ * Force finalize the expired dialing.
+ * Sets the watchdog result, hangs up the channel and pushes it to the completion queue.
+ * @param dialing
+ * @return	false if the dialing was completed or re-armed in the meantime.
+ */
+static bool rb_dialing_reap(rb_dialing* dialing)
+{
+	E_DIALING_DEADLINE_T deadline;
+	struct ast_json* j_res;
+	char* name;
+
+	ao2_lock(dialing);
+
+	if((dialing->in_flight == false) || (dialing->completed == true)) {
+		ao2_unlock(dialing);
+		return false;
+	}
+
+	ast_mutex_lock(&g_rb_dialing_wheel_mutex);
+	if(dialing->wheel_slot != NULL) {
+		// re-armed
+		ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+		ao2_unlock(dialing);
+		return false;
+	}
+	deadline = dialing->deadline;
+	dialing->deadline = E_DIALING_DEADLINE_NONE;
+	g_watchdog_reaped[deadline]++;
+	ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+
+	ast_log(LOG_WARNING, "Reaping the expired dialing. uuid[%s], name[%s], status[%d], deadline[%d]\n",
+			dialing->uuid, dialing->name ? : "", dialing->status, deadline
+			);
+
+	dialing->res_dial = DEF_DIALING_RES_DIAL_WATCHDOG;
+	if(dialing->res_hangup_detail != NULL) {
+		ast_free(dialing->res_hangup_detail);
+	}
+	dialing->res_hangup_detail = ast_strdup((deadline == E_DIALING_DEADLINE_CALL)? "Watchdog call timeout" : "Watchdog originate timeout");
+	name = (dialing->name != NULL)? ast_strdup(dialing->name) : NULL;
+
+	dialing->status = E_DIALING_ERROR;
+	rb_dialing_complete(dialing);
+	rb_dialing_update(dialing);
+
+	ao2_unlock(dialing);
+
+	// the channel could be still alive.
+	if(name != NULL) {
+		j_res = ami_cmd_hangup(name, AST_CAUSE_NORMAL_CLEARING);
+		AST_JSON_UNREF(j_res);
+		ast_free(name);
+	}
+
+	return true;
+}
+
+/**
+ * Run the watchdog.
+ * Advances the timing wheel up to now and reaps the expired dialings.
+ * The reaped dialings are in the completion queue.
+ * @return	reaped count
+ */
+int rb_dialing_watchdog_tick(void)
+{
+	struct ao2_container* expired;
+	rb_dialing* dialing;
+	uint64_t now;
+	int count;
+	int ret;
+
+	expired = NULL;
+	now = rb_dialing_get_wheel_tick();
+
+	ast_mutex_lock(&g_rb_dialing_wheel_mutex);
+	while(g_wheel_tick < now) {
+		rb_dialing_wheel_advance(&expired);
+	}
+	ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
+
+	if(expired == NULL) {
+		return 0;
+	}
+
+	count = 0;
+	while(1) {
+		dialing = ao2_callback(expired, OBJ_UNLINK, NULL, NULL);
+		if(dialing == NULL) {
+			break;
+		}
+
+		ret = rb_dialing_reap(dialing);
+		if(ret == true) {
+			count++;
+		}
+		ao2_ref(dialing, -1);
+	}
+	ao2_ref(expired, -1);
+
+	return count;
+}
+
+/**
+ * Return the reaped dialing count of the given deadline type.
+ * @param deadline
+ * @return
+ */
+int rb_dialing_get_watchdog_reaped(E_DIALING_DEADLINE_T deadline)
+{
+	int ret;
 
-	if(dialing->j_event != NULL) {
-		AST_JSON_UNREF(dialing->j_event);
+	if((deadline < 0) || (deadline >= E_DIALING_DEADLINE_MAX)) {
+		return 0;
 	}
 
-	dialing->j_event = ast_json_deep_copy(j_evt);
-
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	ast_mutex_lock(&g_rb_dialing_wheel_mutex);
+	ret = g_watchdog_reaped[deadline];
+	ast_mutex_unlock(&g_rb_dialing_wheel_mutex);
 
-	return true;
+	return ret;
 }
 
-bool rb_dialing_update_status(rb_dialing* dialing, E_DIALING_STATUS_T status)
+/**
+ * Return the count of the dialings in the completion queue.
+ * @return
+ */
+int rb_dialing_get_completed_count(void)
 {
-	if(dialing == NULL) {
-		return false;
+	if(g_rb_dialing_completes == NULL) {
+		return 0;
 	}
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
-
-	dialing->status = status;
-
-	ast_mutex_unlock(&g_rb_dialing_mutex);
-
-	return true;
+	return ao2_container_count(g_rb_dialing_completes);
 }
 
+/**
+ * Find the dialing by the channel name.
+ * Returns the reference. The caller must release it with ao2_ref(dialing, -1).
+ * @param name
+ * @return
+ */
 rb_dialing* rb_dialing_find_chan_name(const char* name)
 {
 	rb_dialing* dialing;
@@ -434,18 +1583,20 @@ rb_dialing* rb_dialing_find_chan_name(const char* name)
 	}
 
 	ast_log(LOG_DEBUG, "rb_dialing_find_chan_name. name[%s]\n", name);
-	ast_mutex_lock(&g_rb_dialing_mutex);
-	dialing = ao2_find(g_rb_dialings, name, OBJ_SEARCH_PARTIAL_KEY);
+	dialing = ao2_find(g_rb_dialing_names, name, OBJ_SEARCH_KEY);
 	if(dialing == NULL) {
-		ast_mutex_unlock(&g_rb_dialing_mutex);
 		return NULL;
 	}
-	ao2_ref(dialing, -1);
-	ast_mutex_unlock(&g_rb_dialing_mutex);
 
 	return dialing;
 }
 
+/**
+ * Find the dialing by the channel uniqueid.
+ * Returns the reference. The caller must release it with ao2_ref(dialing, -1).
+ * @param uuid
+ * @return
+ */
 rb_dialing* rb_dialing_find_chan_uuid(const char* uuid)
 {
 	rb_dialing* dialing;
@@ -455,14 +1606,10 @@ rb_dialing* rb_dialing_find_chan_uuid(const char* uuid)
 	}
 
 	ast_log(LOG_DEBUG, "rb_dialing_find_chan_uuid. uuid[%s]\n", uuid);
-	ast_mutex_lock(&g_rb_dialing_mutex);
-	dialing = ao2_find(g_rb_dialings, uuid, OBJ_SEARCH_KEY);
+	dialing = ao2_find(rb_dialing_get_shard(uuid), uuid, OBJ_SEARCH_KEY);
 	if(dialing == NULL) {
-		ast_mutex_unlock(&g_rb_dialing_mutex);
 		return NULL;
 	}
-	ao2_ref(dialing, -1);
-	ast_mutex_unlock(&g_rb_dialing_mutex);
 
 	return dialing;
 }
@@ -479,17 +1626,33 @@ bool rb_dialing_is_exist_uuid(const char* uuid)
 	if(dialing == NULL) {
 		return false;
 	}
+	ao2_ref(dialing, -1);
 
 	return true;
 }
 
+/**
+ * Initiate the dialing iterator.
+ * Iterates the snapshot of the all shards. So the shards are not locked while iterating.
+ * The snapshot holds the dialings until the iterator is destroyed.
+ * @return
+ */
 struct ao2_iterator rb_dialing_iter_init(void)
 {
 	struct ao2_iterator iter;
+	struct ao2_container* snapshot;
+	int i;
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
-	iter = ao2_iterator_init(g_rb_dialings, 0);
-	ast_mutex_unlock(&g_rb_dialing_mutex);
+	snapshot = ao2_container_alloc_list(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, NULL, NULL);
+	if(snapshot != NULL) {
+		for(i = 0; i < DEF_DIALING_SHARDS; i++) {
+			ao2_container_dup(snapshot, g_rb_dialings[i], 0);
+		}
+	}
+
+	// the iterator keeps the snapshot reference.
+	iter = ao2_iterator_init(snapshot, AO2_ITERATOR_DONTLOCK);
+	ao2_cleanup(snapshot);
 
 	return iter;
 }
@@ -504,14 +1667,11 @@ rb_dialing* rb_dialing_iter_next(struct ao2_iterator *iter)
 {
 	rb_dialing* dialing;
 
-	ast_mutex_lock(&g_rb_dialing_mutex);
 	dialing = ao2_iterator_next(iter);
 	if(dialing == NULL) {
-		ast_mutex_unlock(&g_rb_dialing_mutex);
 		return NULL;
 	}
 	ao2_ref(dialing, -1);
-	ast_mutex_unlock(&g_rb_dialing_mutex);
 
 	return dialing;
 }
@@ -531,7 +1691,7 @@ struct ast_json* rb_dialing_get_all_for_cli(void)
 			break;
 		}
 
-		j_tmp = ast_json_deep_copy(dialing->j_dialing);
+		j_tmp = rb_dialing_get_dialing_json(dialing);
 		ast_json_object_set(j_tmp, "status", ast_json_integer_create(dialing->status));
 		ast_json_array_append(j_res, j_tmp);
 	}
@@ -544,12 +1704,15 @@ struct ast_json* rb_dialing_get_info_for_cli(const char* uuid)
 {
 	rb_dialing* dialing;
 	struct ast_json* j_res;
+	struct ast_json* j_dialing;
 
 	dialing = rb_dialing_find_chan_uuid(uuid);
 	if(dialing == NULL) {
-		return false;
+		return NULL;
 	}
 
+	// the event worker updates the dialing. copy it under the lock.
+	ao2_lock(dialing);
 	j_res = ast_json_pack("{"
 			"s:s, s:i, s:s, "
 			"s:s, s:s, s:s"
@@ -562,65 +1725,475 @@ struct ast_json* rb_dialing_get_info_for_cli(const char* uuid)
 			"tm_update",	dialing->tm_update? : "",
 			"tm_delete",	dialing->tm_delete? : ""
 			);
-	ast_json_object_set(j_res, "j_dialing", ast_json_ref(dialing->j_dialing));
-	ast_json_object_set(j_res, "j_event", ast_json_ref(dialing->j_event));
+	ast_json_object_set(j_res, "j_event", ast_json_deep_copy(dialing->j_event));
+	ao2_unlock(dialing);
+
+	j_dialing = rb_dialing_get_dialing_json(dialing);
+	rb_dialing_set_info_json(dialing, j_dialing);
+	ast_json_object_set(j_res, "j_dialing", j_dialing);
+	ao2_ref(dialing, -1);
 
 	return j_res;
 }
 
 /**
- * Get count of dialings
+ * Return the dialing info(result) json.
+ * Combines the dialing info and the hot fields.
+ * @param dialing
  * @return
  */
-int rb_dialing_get_count(void)
+struct ast_json* rb_dialing_get_dialing_json(rb_dialing* dialing)
 {
-	int ret;
+	struct ast_json* j_res;
 
-	if(g_rb_dialings == NULL) {
-		return 0;
+	if(dialing == NULL) {
+		return NULL;
+	}
+
+	ao2_lock(dialing);
+	j_res = ast_json_deep_copy(dialing->j_dialing);
+	ast_json_object_set(j_res, "res_dial", ast_json_integer_create(dialing->res_dial));
+	ast_json_object_set(j_res, "res_hangup", ast_json_integer_create(dialing->res_hangup));
+	if(dialing->res_hangup_detail != NULL) {
+		ast_json_object_set(j_res, "res_hangup_detail", ast_json_string_create(dialing->res_hangup_detail));
 	}
+	ao2_unlock(dialing);
 
-	ret = ao2_container_count(g_rb_dialings);
+	return j_res;
+}
 
-	return ret;
+/**
+ * Add the info of the dialing(info_camp, info_plan, ...) to the given json.
+ * The infos are copied from the shared snapshots.
+ * @param dialing
+ * @param j_res	Updated.
+ */
+void rb_dialing_set_info_json(rb_dialing* dialing, struct ast_json* j_res)
+{
+	if((dialing == NULL) || (j_res == NULL)) {
+		return;
+	}
+
+	ast_json_object_set(j_res, "info_camp", ast_json_deep_copy(dialing->j_info_camp));
+	ast_json_object_set(j_res, "info_plan", ast_json_deep_copy(dialing->j_info_plan));
+	ast_json_object_set(j_res, "info_dlma", ast_json_deep_copy(dialing->j_info_dlma));
+	ast_json_object_set(j_res, "info_dest", ast_json_deep_copy(dialing->j_info_dest));
+	ast_json_object_set(j_res, "info_dl_list", ast_json_deep_copy(dialing->j_info_dl_list));
+	ast_json_object_set(j_res, "info_dial", ast_json_deep_copy(dialing->j_info_dial));
+
+	return;
 }
 
 /**
- * Return the count of the dialings of the campaign.
- * @param camp_uuid
+ * Return the originate stat of the given trunk.
+ * Creates if not exists.
+ * There's no mutex lock here.
+ * locking is caller's responsibility.
+ * @param trunk_name
  * @return
  */
-int rb_dialing_get_count_by_camp_uuid(const char* camp_uuid)
+static struct ast_json* rb_dialing_originate_stat_get(const char* trunk_name)
 {
-	struct ao2_iterator iter;
-	rb_dialing* dialing;
-	const char* tmp_const;
-	int count;
+	struct ast_json* j_stat;
+	struct ast_json* j_hist;
+	int i;
 
-	if(camp_uuid == NULL) {
-		ast_log(LOG_WARNING, "Invalid parameter.");
-		return -1;
+	j_stat = ast_json_object_get(g_j_originate_stats, trunk_name ? : "");
+	if(j_stat != NULL) {
+		return j_stat;
 	}
 
-	count = 0;
-	iter = rb_dialing_iter_init();
-	while(1) {
-		dialing = rb_dialing_iter_next(&iter);
-		if(dialing == NULL) {
-			break;
+	j_hist = ast_json_array_create();
+	for(i = 0; i < DEF_DIALING_ORIGINATE_HIST_CNT; i++) {
+		ast_json_array_append(j_hist, ast_json_integer_create(0));
+	}
+	j_stat = ast_json_pack("{s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:o}",
+			"submitted",		0,
+			"success",			0,
+			"failure",			0,
+			"lost",				0,
+			"outstanding",		0,
+			"latency_total",	0,
+			"latency_max",		0,
+			"latency_hist",		j_hist
+			);
+	ast_json_object_set(g_j_originate_stats, trunk_name ? : "", j_stat);
+
+	return j_stat;
+}
+
+/**
+ * Increase the integer value of the given key.
+ * @param j_obj
+ * @param key
+ * @param diff
+ */
+static void rb_dialing_originate_stat_add(struct ast_json* j_obj, const char* key, int diff)
+{
+	struct ast_json* j_val;
+
+	j_val = ast_json_object_get(j_obj, key);
+	if(j_val == NULL) {
+		return;
+	}
+	ast_json_integer_set(j_val, ast_json_integer_get(j_val) + diff);
+	return;
+}
+
+/**
+ * Mark the dialing as originate submitted.
+ * Must be called before the originate request. The response could come first.
+ * @param dialing
+ * @return
+ */
+bool rb_dialing_originate_submit(rb_dialing* dialing)
+{
+	struct ast_json* j_stat;
+
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+	if(dialing->originate_outstanding == true) {
+		ao2_unlock(dialing);
+		return true;
+	}
+	dialing->originate_outstanding = true;
+	clock_gettime(CLOCK_MONOTONIC, &dialing->timeptr_originate);
+
+	ast_mutex_lock(&g_rb_dialing_originate_mutex);
+	g_originate_outstanding++;
+	j_stat = rb_dialing_originate_stat_get(dialing->trunk_name);
+	rb_dialing_originate_stat_add(j_stat, "submitted", 1);
+	rb_dialing_originate_stat_add(j_stat, "outstanding", 1);
+	ast_mutex_unlock(&g_rb_dialing_originate_mutex);
+
+	ao2_unlock(dialing);
+
+	return true;
+}
+
+/**
+ * Complete the outstanding originate of the dialing.
+ * There's no dialing lock here.
+ * The dialing lock is caller's responsibility.
+ * @param dialing
+ * @param result	success, failure, lost
+ */
+static void rb_dialing_originate_done(rb_dialing* dialing, const char* result)
+{
+	struct ast_json* j_stat;
+	struct ast_json* j_hist;
+	struct timespec timeptr;
+	int64_t latency;
+	int idx;
+	bool full;
+
+	if(dialing->originate_outstanding == false) {
+		return;
+	}
+	dialing->originate_outstanding = false;
+
+	clock_gettime(CLOCK_MONOTONIC, &timeptr);
+	latency = ((int64_t)(timeptr.tv_sec - dialing->timeptr_originate.tv_sec) * 1000)
+			+ ((timeptr.tv_nsec - dialing->timeptr_originate.tv_nsec) / 1000000);
+
+	if(latency < 100)			idx = 0;
+	else if(latency < 1000)		idx = 1;
+	else if(latency < 5000)		idx = 2;
+	else if(latency < 15000)	idx = 3;
+	else if(latency < 30000)	idx = 4;
+	else						idx = 5;
+
+	ast_mutex_lock(&g_rb_dialing_originate_mutex);
+	full = ((g_originate_window > 0) && (g_originate_outstanding >= g_originate_window));
+	g_originate_outstanding--;
+
+	j_stat = rb_dialing_originate_stat_get(dialing->trunk_name);
+	rb_dialing_originate_stat_add(j_stat, result, 1);
+	rb_dialing_originate_stat_add(j_stat, "outstanding", -1);
+
+	// the lost one has no response. no latency.
+	if(strcmp(result, "lost") != 0) {
+		rb_dialing_originate_stat_add(j_stat, "latency_total", (int)latency);
+		if(latency > ast_json_integer_get(ast_json_object_get(j_stat, "latency_max"))) {
+			ast_json_integer_set(ast_json_object_get(j_stat, "latency_max"), latency);
+		}
+		j_hist = ast_json_object_get(j_stat, "latency_hist");
+		ast_json_integer_set(ast_json_array_get(j_hist, idx), ast_json_integer_get(ast_json_array_get(j_hist, idx)) + 1);
+	}
+	ast_mutex_unlock(&g_rb_dialing_originate_mutex);
+
+	// the window has been opened.
+	if(full == true) {
+		wakeup_outbound_dialing();
+	}
+
+	return;
+}
+
+/**
+ * Complete the outstanding originate of the dialing with the response.
+ * Returns false if the dialing has no outstanding originate.
+ * @param dialing
+ * @param success
+ * @return
+ */
+bool rb_dialing_originate_response(rb_dialing* dialing, bool success)
+{
+	bool ret;
+
+	if(dialing == NULL) {
+		return false;
+	}
+
+	ao2_lock(dialing);
+	ret = dialing->originate_outstanding;
+	rb_dialing_originate_done(dialing, (success == true) ? "success" : "failure");
+	ao2_unlock(dialing);
+
+	return ret;
+}
+
+/**
+ * Return the available count of the originate window.
+ * Returns INT_MAX if the window is unlimited.
+ * @return
+ */
+int rb_dialing_get_originate_window_avail(void)
+{
+	int ret;
+
+	ast_mutex_lock(&g_rb_dialing_originate_mutex);
+	if(g_originate_window <= 0) {
+		ret = INT_MAX;
+	}
+	else {
+		ret = g_originate_window - g_originate_outstanding;
+		if(ret < 0) {
+			ret = 0;
 		}
+	}
+	ast_mutex_unlock(&g_rb_dialing_originate_mutex);
+
+	return ret;
+}
+
+/**
+ * Return the count of the outstanding originates.
+ * @return
+ */
+int rb_dialing_get_originate_outstanding(void)
+{
+	int ret;
+
+	ast_mutex_lock(&g_rb_dialing_originate_mutex);
+	ret = g_originate_outstanding;
+	ast_mutex_unlock(&g_rb_dialing_originate_mutex);
+
+	return ret;
+}
+
+/**
+ * Return the originate stats.
+ * {"window": n, "outstanding": n, "trunks": {"<trunk>": {...}, ...}}
+ * @return
+ */
+struct ast_json* rb_dialing_get_originate_stats(void)
+{
+	struct ast_json* j_res;
+
+	ast_mutex_lock(&g_rb_dialing_originate_mutex);
+	j_res = ast_json_pack("{s:i, s:i, s:o}",
+			"window",		g_originate_window,
+			"outstanding",	g_originate_outstanding,
+			"trunks",		ast_json_deep_copy(g_j_originate_stats)
+			);
+	ast_mutex_unlock(&g_rb_dialing_originate_mutex);
+
+	return j_res;
+}
 
-		tmp_const = ast_json_string_get(ast_json_object_get(dialing->j_dialing, "camp_uuid"));
-		if(tmp_const == NULL) {
+/**
+ * Remove the shared snapshots of the given dialing from the cache
+ * if there's no other in-flight dialing of them.
+ * The dialing keeps its own references until it is freed.
+ * Must be called after the in-flight counts are updated.
+ * @param dialing
+ */
+static void rb_dialing_release_snapshots(rb_dialing* dialing)
+{
+	const char* types[] = {"camp", "plan", "dlma", "dest"};
+	const char* uuids[4];
+	int i;
+
+	uuids[0] = dialing->camp_uuid;
+	uuids[1] = dialing->plan_uuid;
+	uuids[2] = dialing->dlma_uuid;
+	uuids[3] = dialing->dest_uuid;
+
+	ast_mutex_lock(&g_rb_dialing_count_mutex);
+	ast_mutex_lock(&g_rb_dialing_snapshot_mutex);
+	for(i = 0; i < ARRAY_LEN(types); i++) {
+		if(uuids[i] == NULL) {
 			continue;
 		}
+		if(ast_json_object_get(ast_json_object_get(g_j_dialing_counts, types[i]), uuids[i]) != NULL) {
+			// still in use.
+			continue;
+		}
+		ast_json_object_del(ast_json_object_get(g_j_dialing_snapshots, types[i]), uuids[i]);
+	}
+	ast_mutex_unlock(&g_rb_dialing_snapshot_mutex);
+	ast_mutex_unlock(&g_rb_dialing_count_mutex);
+
+	return;
+}
+
+/**
+ * Get count of dialings
+ * @return
+ */
+int rb_dialing_get_count(void)
+{
+	int ret;
+	int i;
 
-		if(strcmp(tmp_const, camp_uuid) != 0) {
+	ret = 0;
+	for(i = 0; i < DEF_DIALING_SHARDS; i++) {
+		if(g_rb_dialings[i] == NULL) {
 			continue;
 		}
-		count++;
+		ret += ao2_container_count(g_rb_dialings[i]);
+	}
+
+	return ret;
+}
+
+/**
+ * Update the in-flight counts of the given dialing.
+ * The keys are taken from the dialing hot fields.
+ * @param dialing
+ * @param diff
+ */
+static void rb_dialing_count_update(rb_dialing* dialing, int diff)
+{
+	ast_mutex_lock(&g_rb_dialing_count_mutex);
+
+	rb_dialing_count_update_key("camp", dialing->camp_uuid, diff);
+	rb_dialing_count_update_key("plan", dialing->plan_uuid, diff);
+	rb_dialing_count_update_key("dlma", dialing->dlma_uuid, diff);
+	rb_dialing_count_update_key("dest", dialing->dest_uuid, diff);
+	rb_dialing_count_update_key("trunk", dialing->trunk_name, diff);
+
+	ast_mutex_unlock(&g_rb_dialing_count_mutex);
+
+	return;
+}
+
+/**
+ * Update the in-flight count of the given key.
+ * The key is removed when the count reaches 0.
+ * There's no mutex lock here.
+ * locking is caller's responsibility.
+ * @param type
+ * @param key
+ * @param diff
+ */
+static void rb_dialing_count_update_key(const char* type, const char* key, int diff)
+{
+	struct ast_json* j_counts;
+	struct ast_json* j_count;
+	int count;
+
+	if((key == NULL) || (strlen(key) == 0)) {
+		return;
+	}
+
+	j_counts = ast_json_object_get(g_j_dialing_counts, type);
+	if(j_counts == NULL) {
+		return;
+	}
+
+	j_count = ast_json_object_get(j_counts, key);
+	if(j_count == NULL) {
+		if(diff <= 0) {
+			ast_log(LOG_WARNING, "Could not find the dialing count. type[%s], key[%s]\n", type, key);
+			return;
+		}
+		ast_json_object_set(j_counts, key, ast_json_integer_create(diff));
+		return;
+	}
+
+	count = ast_json_integer_get(j_count) + diff;
+	if(count <= 0) {
+		ast_json_object_del(j_counts, key);
+		return;
+	}
+	ast_json_integer_set(j_count, count);
+
+	return;
+}
+
+/**
+ * Return the in-flight count of the given key.
+ * @param type
+ * @param key
+ * @return
+ */
+static int rb_dialing_count_get(const char* type, const char* key)
+{
+	int count;
+
+	if(key == NULL) {
+		ast_log(LOG_WARNING, "Invalid parameter.\n");
+		return -1;
 	}
-	rb_dialing_iter_destroy(&iter);
+
+	ast_mutex_lock(&g_rb_dialing_count_mutex);
+	count = ast_json_integer_get(ast_json_object_get(ast_json_object_get(g_j_dialing_counts, type), key));
+	ast_mutex_unlock(&g_rb_dialing_count_mutex);
 
 	return count;
 }
+
+/**
+ * Return the count of the dialings of the campaign.
+ * @param camp_uuid
+ * @return
+ */
+int rb_dialing_get_count_by_camp_uuid(const char* camp_uuid)
+{
+	return rb_dialing_count_get("camp", camp_uuid);
+}
+
+/**
+ * Return the count of the dialings of the plan.
+ * @param plan_uuid
+ * @return
+ */
+int rb_dialing_get_count_by_plan_uuid(const char* plan_uuid)
+{
+	return rb_dialing_count_get("plan", plan_uuid);
+}
+
+/**
+ * Return the count of the dialings of the destination.
+ * @param dest_uuid
+ * @return
+ */
+int rb_dialing_get_count_by_dest_uuid(const char* dest_uuid)
+{
+	return rb_dialing_count_get("dest", dest_uuid);
+}
+
+/**
+ * Return the count of the dialings of the trunk.
+ * @param trunk_name
+ * @return
+ */
+int rb_dialing_get_count_by_trunk_name(const char* trunk_name)
+{
+	return rb_dialing_count_get("trunk", trunk_name);
+}
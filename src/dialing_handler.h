@@ -11,6 +11,7 @@
 #include "asterisk/json.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef enum _E_DIALING_STATUS_T
 {
@@ -25,25 +26,112 @@ typedef enum _E_DIALING_STATUS_T
 	E_DIALING_ERROR				 = 10,   ///< error
 } E_DIALING_STATUS_T;
 
+#define DEF_DIALING_RES_DIAL_WATCHDOG	-1	///< res_dial of the dialing reaped by the watchdog.
+#define DEF_DIALING_WATCHDOG_TICK		100	///< watchdog tick(ms).
+#define DEF_DIALING_ORIGINATE_HIST_CNT	6	///< originate latency histogram buckets. <100ms, <1s, <5s, <15s, <30s, >=30s
+
+typedef enum _E_DIALING_DEADLINE_T
+{
+	E_DIALING_DEADLINE_NONE		 = 0,
+	E_DIALING_DEADLINE_ORIGINATE,	///< waiting the originate response. plan's dial_timeout + dialing_timeout_originate.
+	E_DIALING_DEADLINE_CALL,		 ///< max call duration. dialing_timeout_call.
+
+	E_DIALING_DEADLINE_MAX,
+} E_DIALING_DEADLINE_T;
+
+typedef enum _E_DIALING_EVENT_T
+{
+	E_DIALING_EVT_UNKNOWN	   = 0,
+	E_DIALING_EVT_NEWCHANNEL,
+	E_DIALING_EVT_NEWEXTEN,
+	E_DIALING_EVT_NEWSTATE,
+	E_DIALING_EVT_QUEUECALLERJOIN,
+	E_DIALING_EVT_QUEUECALLERLEAVE,
+	E_DIALING_EVT_ORIGINATERESPONSE,
+	E_DIALING_EVT_AGENTCALLED,
+	E_DIALING_EVT_AGENTCONNECT,
+	E_DIALING_EVT_AGENTCOMPLETE,
+	E_DIALING_EVT_DIALBEGIN,
+	E_DIALING_EVT_DIALEND,
+	E_DIALING_EVT_HANGUP,
+	E_DIALING_EVT_BRIDGEENTER,
+	E_DIALING_EVT_VARSET,
+
+	E_DIALING_EVT_MAX,
+} E_DIALING_EVENT_T;
+
+#define DEF_DIALING_EVENT_DETAIL_LEN	48
+
+/**
+ * Compact history event record.
+ */
+typedef struct _dialing_event{
+	E_DIALING_EVENT_T type;		 ///< event type
+	struct timespec tm_event;	   ///< event received time
+	int channelstate;			   ///< channel state. -1 if not given.
+	int code;					   ///< event code(cause, reason, ...). See the event table.
+	char detail[DEF_DIALING_EVENT_DETAIL_LEN];	///< event detail(cause-txt, dialstatus, ...). See the event table.
+} dialing_event;
+
 typedef struct _rb_dialing{
 	char* uuid;				 ///< dialing uuid(channel's unique id)
 	char* name;				 ///< dialing name(channel's name)
+	bool in_flight;			 ///< counted in the in-flight counts
+	bool completed;			 ///< pushed to the completion queue
+	bool dl_list_updated;	 ///< finalizing. the dl_list has been updated, the result is not written yet.
+	bool originate_pending;	 ///< originated by the core. waiting the answer/hangup instead of the OriginateResponse.
+	bool originate_outstanding;	///< originate submitted. waiting the response. counted in the originate window.
+	struct timespec timeptr_originate;	///< timestamp of the originate submit
 	E_DIALING_STATUS_T status;  ///< dialing status
 
+	// hot fields. the uuids are interned(shared between the dialings).
+	const char* camp_uuid;		///< campaign uuid
+	const char* plan_uuid;		///< plan uuid
+	const char* dlma_uuid;		///< dlma uuid
+	const char* dest_uuid;		///< destination uuid
+	const char* trunk_name;	   ///< trunk name of the plan
+	char* dl_list_uuid;		   ///< dl_list uuid
+	int dial_index;			   ///< dial number index
+	int dial_trycnt;			  ///< dial try count of the dial number
+	int dial_timeout;			 ///< dial timeout(ms)
+	int res_dial;				 ///< dial result
+	int res_hangup;			   ///< hangup cause
+	char* res_hangup_detail;	  ///< hangup cause text
+
 	char* tm_create;
 	char* tm_update;
 	char* tm_delete;
+	struct timespec timeptr_create; ///< timestamp of create
 	struct timespec timeptr_update; ///< timestamp for timeout
 
+	// watchdog
+	struct _rb_dialing* wheel_prev;	///< timing wheel link
+	struct _rb_dialing* wheel_next;	///< timing wheel link
+	struct _rb_dialing** wheel_slot;   ///< timing wheel slot. NULL if not in the wheel.
+	uint64_t wheel_expire;			 ///< watchdog deadline(tick)
+	E_DIALING_DEADLINE_T deadline;	 ///< watchdog deadline type
+
 	struct ast_json* j_dialing;	///< dialing info(result).
+
+	// info snapshots. shared and immutable. Do not change.
+	struct ast_json* j_info_camp;		///< campaign info
+	struct ast_json* j_info_plan;		///< plan info
+	struct ast_json* j_info_dlma;		///< dlma info
+	struct ast_json* j_info_dest;		///< destination info
+	struct ast_json* j_info_dl_list;	///< dl_list info
+	struct ast_json* j_info_dial;		///< dial info
+
 	struct ast_json* j_event;	///< current channel status info(the latest event)
-	struct ast_json* j_events;		///< event info(json array).
+	dialing_event* events;		///< history events(ring).
+	int events_head;			  ///< next write position of the events
+	int events_count;			 ///< count of the events
 } rb_dialing;
 
 int init_rb_dialing(void);
 rb_dialing* rb_dialing_create(const char* dialing_uuid, struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest, struct ast_json* j_dl_list, struct ast_json* j_dial);
 void rb_dialing_destory(rb_dialing* dialing);
 
+// the found dialing is referenced. release it with ao2_ref(dialing, -1).
 rb_dialing* rb_dialing_find_chan_name(const char* chan);
 rb_dialing* rb_dialing_find_chan_uuid(const char* chan);
 bool rb_dialing_is_exist_uuid(const char* uuid);
@@ -61,9 +149,33 @@ bool rb_dialing_update_events_append(rb_dialing* dialing, struct ast_json* j_evt
 bool rb_dialing_update_dialing_update(rb_dialing* dialing, struct ast_json* j_dialing);
 bool rb_dialing_update_current_update(rb_dialing* dialing, struct ast_json* j_evt);
 bool rb_dialing_update_event_substitute(rb_dialing* dialing, struct ast_json* j_evt);
+bool rb_dialing_update_res_dial(rb_dialing* dialing, int res_dial);
+bool rb_dialing_update_res_hangup(rb_dialing* dialing, int res_hangup, const char* detail);
+bool rb_dialing_update_originate_pending(rb_dialing* dialing, bool pending);
+bool rb_dialing_take_originate_pending(rb_dialing* dialing);
+
+bool rb_dialing_originate_submit(rb_dialing* dialing);
+bool rb_dialing_originate_response(rb_dialing* dialing, bool success);
+int rb_dialing_get_originate_window_avail(void);
+int rb_dialing_get_originate_outstanding(void);
+struct ast_json* rb_dialing_get_originate_stats(void);
+
+struct ast_json* rb_dialing_get_dialing_json(rb_dialing* dialing);
+void rb_dialing_set_info_json(rb_dialing* dialing, struct ast_json* j_res);
+struct ast_json* rb_dialing_get_events_json(rb_dialing* dialing);
+
+rb_dialing* rb_dialing_pop_completed(void);
+bool rb_dialing_push_completed(rb_dialing* dialing);
+int rb_dialing_get_completed_count(void);
+
+int rb_dialing_watchdog_tick(void);
+int rb_dialing_get_watchdog_reaped(E_DIALING_DEADLINE_T deadline);
 
 int rb_dialing_get_count(void);
 int rb_dialing_get_count_by_camp_uuid(const char* camp_uuid);
+int rb_dialing_get_count_by_plan_uuid(const char* plan_uuid);
+int rb_dialing_get_count_by_dest_uuid(const char* dest_uuid);
+int rb_dialing_get_count_by_trunk_name(const char* trunk_name);
 
 
 #endif /* SRC_DIALING_HANDLER_H_ */
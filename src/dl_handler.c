@@ -22,6 +22,35 @@
 #include "res_outbound.h"
 
 #include <stdbool.h>
+#include <event2/event.h>
+
+#define DEF_DL_PREFETCH_SIZE		"100"
+#define DEF_DL_PREFETCH_LOW_WATER	"20"
+
+/**
+ * Prefetched dialable dl_list ring for each dlma/plan.
+ */
+typedef struct _dl_prefetch
+{
+	char* dlma_uuid;
+	char* plan_uuid;
+	struct ast_json* j_dlma;	///< dlma info for refill. referenced, not copied. read only.
+	struct ast_json* j_plan;	///< plan info for refill. referenced, not copied. read only.
+
+	struct ast_json** dls;	///< ring of dl_list. Invalidated slot is NULL.
+	struct ast_json* j_idx;	///< index of the ring. {"<dl_uuid>": slot, ...}
+	int size;		///< ring size
+	int head;		///< next hand out position
+	int count;		///< remain slots(including invalidated slot)
+
+	int generation;		///< increased when any dl_list in the ring invalidated.
+	bool refill_pending;	///< refill event scheduled.
+
+	struct _dl_prefetch* next;
+} dl_prefetch;
+
+AST_MUTEX_DEFINE_STATIC(g_dl_prefetch_mutex);
+static dl_prefetch* g_dl_prefetches = NULL;	///< prefetch list
 
 static char* create_chan_addr_for_dial(struct ast_json* j_plan, struct ast_json* j_dl_list, int dial_num_point);
 static char* get_dial_number(struct ast_json* j_dlist, const int cnt);
@@ -29,11 +58,24 @@ static char* create_view_name(const char* uuid);
 static bool create_dlma_view(const char* uuid, const char* view_name);
 static struct ast_json* create_dial_dl_info(struct ast_json* j_dl_list, struct ast_json* j_plan);
 static bool check_more_dl_list(struct ast_json* j_dlma, struct ast_json* j_plan);
-static bool is_over_retry_delay(struct ast_json* j_dlma, struct ast_json* j_dl, struct ast_json* j_plan);
-static struct ast_json* get_dl_available(struct ast_json* j_dlma, struct ast_json* j_plan);
+static struct ast_json* get_dl_availables(struct ast_json* j_dlma, struct ast_json* j_plan, int count);
+
+static int get_dl_prefetch_option(const char* name, const char* def);
+static dl_prefetch* find_dl_prefetch(const char* dlma_uuid, const char* plan_uuid);
+static struct ast_json* pop_dl_prefetch(dl_prefetch* prefetch);
+static void clear_dl_prefetch_ring(dl_prefetch* prefetch);
+static bool refill_dl_prefetch(const char* dlma_uuid, const char* plan_uuid);
+static void cb_dl_prefetch_refill(__attribute__((unused)) int fd, __attribute__((unused)) short event, void *arg);
+static void invalidate_dl_prefetch(const char* dl_uuid);
+static void remove_dl_prefetch(const char* dlma_uuid);
+static bool is_dl_list_key(const char* key);
 
 /**
  * Get dl_list for predictive dialing.
+ * Hands out the dl_list from the prefetched ring.
+ * If the ring goes below the low water mark, refill it in the event loop.
+ * The refill is deferred until the current dialing is done. It still runs in the
+ * dialer thread, so the handed out dl_lists are updated before the refill query.
  * \param j_dlma
  * \param j_plan
  * \return
@@ -41,29 +83,357 @@ static struct ast_json* get_dl_available(struct ast_json* j_dlma, struct ast_jso
 struct ast_json* get_dl_available_predictive(struct ast_json* j_dlma, struct ast_json* j_plan)
 {
 	struct ast_json* j_dl;
+	dl_prefetch* prefetch;
+	const char* dlma_uuid;
+	const char* plan_uuid;
+	struct timeval tm_now;
+	char* tmp;
+	int low_water;
 	int ret;
 
 	if((j_dlma == NULL) || (j_plan == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameters.\n");
 		return NULL;
 	}
-
-	// get available dl.
-	j_dl = get_dl_available(j_dlma, j_plan);
-	if(j_dl == NULL) {
+	dlma_uuid = ast_json_string_get(ast_json_object_get(j_dlma, "uuid"));
+	plan_uuid = ast_json_string_get(ast_json_object_get(j_plan, "uuid"));
+	if((dlma_uuid == NULL) || (plan_uuid == NULL)) {
+		ast_log(LOG_WARNING, "Could not get dlma/plan uuid.\n");
 		return NULL;
 	}
 
-	// check retry delay
-	ret = is_over_retry_delay(j_dlma, j_dl, j_plan);
-	if(ret == false) {
-		AST_JSON_UNREF(j_dl);
-		return NULL;
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	prefetch = find_dl_prefetch(dlma_uuid, plan_uuid);
+	if(prefetch == NULL) {
+		prefetch = ast_calloc(1, sizeof(dl_prefetch));
+		prefetch->dlma_uuid = ast_strdup(dlma_uuid);
+		prefetch->plan_uuid = ast_strdup(plan_uuid);
+		prefetch->next = g_dl_prefetches;
+		g_dl_prefetches = prefetch;
 	}
 
+	// keep the latest info for refill.
+	// the infos are not changed after the creation, so the reference is enough.
+	if(prefetch->j_dlma != j_dlma) {
+		AST_JSON_UNREF(prefetch->j_dlma);
+		prefetch->j_dlma = ast_json_ref(j_dlma);
+	}
+	if(prefetch->j_plan != j_plan) {
+		AST_JSON_UNREF(prefetch->j_plan);
+		prefetch->j_plan = ast_json_ref(j_plan);
+	}
+
+	j_dl = pop_dl_prefetch(prefetch);
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+
+	if(j_dl == NULL) {
+		// ring is empty. refill now.
+		ret = refill_dl_prefetch(dlma_uuid, plan_uuid);
+		if(ret == false) {
+			return NULL;
+		}
+
+		ast_mutex_lock(&g_dl_prefetch_mutex);
+		prefetch = find_dl_prefetch(dlma_uuid, plan_uuid);
+		j_dl = (prefetch != NULL)? pop_dl_prefetch(prefetch) : NULL;
+		ast_mutex_unlock(&g_dl_prefetch_mutex);
+		return j_dl;
+	}
+
+	// check low water mark
+	low_water = get_dl_prefetch_option("dl_prefetch_low_water", DEF_DL_PREFETCH_LOW_WATER);
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	prefetch = find_dl_prefetch(dlma_uuid, plan_uuid);
+	if((prefetch != NULL) && (prefetch->count < low_water) && (prefetch->refill_pending == false) && (g_base != NULL)) {
+		tm_now.tv_sec = 0;
+		tm_now.tv_usec = 0;
+		tmp = ast_strdup(prefetch->dlma_uuid);
+		ret = event_base_once(g_base, -1, EV_TIMEOUT, cb_dl_prefetch_refill, tmp, &tm_now);
+		if(ret != 0) {
+			// the ring is refilled when it is empty.
+			ast_log(LOG_WARNING, "Could not schedule the prefetch refill. dlma_uuid[%s]\n", dlma_uuid);
+			ast_free(tmp);
+		}
+		else {
+			prefetch->refill_pending = true;
+		}
+	}
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+
 	return j_dl;
 }
 
+/**
+ * Get prefetch option value from the general section.
+ * @param name
+ * @param def
+ * @return
+ */
+static int get_dl_prefetch_option(const char* name, const char* def)
+{
+	const char* tmp_const;
+
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), name));
+	if(tmp_const == NULL) {
+		tmp_const = def;
+	}
+
+	return atoi(tmp_const);
+}
+
+/**
+ * Find prefetch of given dlma/plan.
+ * Caller should hold g_dl_prefetch_mutex.
+ * If plan_uuid is NULL, returns the first matched dlma's one.
+ * @param dlma_uuid
+ * @param plan_uuid
+ * @return
+ */
+static dl_prefetch* find_dl_prefetch(const char* dlma_uuid, const char* plan_uuid)
+{
+	dl_prefetch* prefetch;
+
+	for(prefetch = g_dl_prefetches; prefetch != NULL; prefetch = prefetch->next) {
+		if(strcmp(prefetch->dlma_uuid, dlma_uuid) != 0) {
+			continue;
+		}
+		if((plan_uuid != NULL) && (strcmp(prefetch->plan_uuid, plan_uuid) != 0)) {
+			continue;
+		}
+		return prefetch;
+	}
+
+	return NULL;
+}
+
+/**
+ * Hand out the next dl_list from the ring.
+ * Caller should hold g_dl_prefetch_mutex.
+ * @param prefetch
+ * @return
+ */
+static struct ast_json* pop_dl_prefetch(dl_prefetch* prefetch)
+{
+	struct ast_json* j_dl;
+
+	while(prefetch->count > 0) {
+		j_dl = prefetch->dls[prefetch->head];
+		prefetch->dls[prefetch->head] = NULL;
+		prefetch->head = (prefetch->head + 1) % prefetch->size;
+		prefetch->count--;
+
+		if(j_dl != NULL) {
+			ast_json_object_del(prefetch->j_idx, ast_json_string_get(ast_json_object_get(j_dl, "uuid")) ? : "");
+			return j_dl;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Release all of dl_list in the ring.
+ * Caller should hold g_dl_prefetch_mutex.
+ * @param prefetch
+ */
+static void clear_dl_prefetch_ring(dl_prefetch* prefetch)
+{
+	int i;
+
+	for(i = 0; i < prefetch->size; i++) {
+		AST_JSON_UNREF(prefetch->dls[i]);
+	}
+	ast_free(prefetch->dls);
+	prefetch->dls = NULL;
+	AST_JSON_UNREF(prefetch->j_idx);
+	prefetch->j_idx = NULL;
+	prefetch->size = 0;
+	prefetch->head = 0;
+	prefetch->count = 0;
+
+	return;
+}
+
+/**
+ * Refill the prefetch ring of given dlma/plan with the next dial-able dl_lists.
+ * @param dlma_uuid
+ * @param plan_uuid
+ * @return
+ */
+static bool refill_dl_prefetch(const char* dlma_uuid, const char* plan_uuid)
+{
+	dl_prefetch* prefetch;
+	struct ast_json* j_dlma;
+	struct ast_json* j_plan;
+	struct ast_json* j_dls;
+	const char* tmp_const;
+	int generation;
+	int size;
+	int i;
+
+	// get refill info
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	prefetch = find_dl_prefetch(dlma_uuid, plan_uuid);
+	if((prefetch == NULL) || (prefetch->j_dlma == NULL) || (prefetch->j_plan == NULL)) {
+		ast_mutex_unlock(&g_dl_prefetch_mutex);
+		return false;
+	}
+	j_dlma = ast_json_ref(prefetch->j_dlma);
+	j_plan = ast_json_ref(prefetch->j_plan);
+	generation = prefetch->generation;
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+
+	size = get_dl_prefetch_option("dl_prefetch_size", DEF_DL_PREFETCH_SIZE);
+	if(size <= 0) {
+		size = 1;
+	}
+
+	j_dls = get_dl_availables(j_dlma, j_plan, size);
+	AST_JSON_UNREF(j_dlma);
+	AST_JSON_UNREF(j_plan);
+	if(j_dls == NULL) {
+		return false;
+	}
+
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	prefetch = find_dl_prefetch(dlma_uuid, plan_uuid);
+	if((prefetch == NULL) || (prefetch->generation != generation)) {
+		// invalidated while querying. try next time.
+		ast_mutex_unlock(&g_dl_prefetch_mutex);
+		AST_JSON_UNREF(j_dls);
+		return false;
+	}
+
+	// the ring is replaced with the new result.
+	// the remain dl_lists are idle, so the new result has them too.
+	clear_dl_prefetch_ring(prefetch);
+	prefetch->dls = ast_calloc(size, sizeof(struct ast_json*));
+	prefetch->j_idx = ast_json_object_create();
+	prefetch->size = size;
+	prefetch->count = ast_json_array_size(j_dls);
+	for(i = 0; i < prefetch->count; i++) {
+		prefetch->dls[i] = ast_json_ref(ast_json_array_get(j_dls, i));
+		tmp_const = ast_json_string_get(ast_json_object_get(prefetch->dls[i], "uuid"));
+		if(tmp_const != NULL) {
+			ast_json_object_set(prefetch->j_idx, tmp_const, ast_json_integer_create(i));
+		}
+	}
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+	AST_JSON_UNREF(j_dls);
+
+	ast_log(LOG_DEBUG, "Refilled dl_list prefetch. dlma_uuid[%s], plan_uuid[%s], count[%d]\n", dlma_uuid, plan_uuid, i);
+	return true;
+}
+
+/**
+ * Refill event callback for the prefetch.
+ * @param fd
+ * @param event
+ * @param arg	dlma uuid. Released here.
+ */
+static void cb_dl_prefetch_refill(__attribute__((unused)) int fd, __attribute__((unused)) short event, void *arg)
+{
+	dl_prefetch* prefetch;
+	char* dlma_uuid;
+	char* plan_uuid;
+
+	dlma_uuid = arg;
+
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	while(1) {
+		// find pending refill of this dlma.
+		for(prefetch = g_dl_prefetches; prefetch != NULL; prefetch = prefetch->next) {
+			if((prefetch->refill_pending == true) && (strcmp(prefetch->dlma_uuid, dlma_uuid) == 0)) {
+				break;
+			}
+		}
+		if(prefetch == NULL) {
+			break;
+		}
+		prefetch->refill_pending = false;
+		plan_uuid = ast_strdup(prefetch->plan_uuid);
+		ast_mutex_unlock(&g_dl_prefetch_mutex);
+
+		refill_dl_prefetch(dlma_uuid, plan_uuid);
+		ast_free(plan_uuid);
+
+		ast_mutex_lock(&g_dl_prefetch_mutex);
+	}
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+
+	ast_free(dlma_uuid);
+	return;
+}
+
+/**
+ * Invalidate the given dl_list from all of the prefetch rings.
+ * Looks up the ring index, so the cost doesn't depend on the ring size.
+ * @param dl_uuid
+ */
+static void invalidate_dl_prefetch(const char* dl_uuid)
+{
+	dl_prefetch* prefetch;
+	struct ast_json* j_slot;
+	int idx;
+
+	if(dl_uuid == NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	for(prefetch = g_dl_prefetches; prefetch != NULL; prefetch = prefetch->next) {
+		j_slot = ast_json_object_get(prefetch->j_idx, dl_uuid);
+		if(j_slot == NULL) {
+			continue;
+		}
+		idx = ast_json_integer_get(j_slot);
+		ast_json_object_del(prefetch->j_idx, dl_uuid);
+		if((idx < 0) || (idx >= prefetch->size)) {
+			continue;
+		}
+		AST_JSON_UNREF(prefetch->dls[idx]);
+		prefetch->generation++;
+	}
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+
+	return;
+}
+
+/**
+ * Remove all of the prefetch of given dlma.
+ * @param dlma_uuid
+ */
+static void remove_dl_prefetch(const char* dlma_uuid)
+{
+	dl_prefetch** pos;
+	dl_prefetch* prefetch;
+
+	if(dlma_uuid == NULL) {
+		return;
+	}
+
+	ast_mutex_lock(&g_dl_prefetch_mutex);
+	pos = &g_dl_prefetches;
+	while(*pos != NULL) {
+		prefetch = *pos;
+		if(strcmp(prefetch->dlma_uuid, dlma_uuid) != 0) {
+			pos = &prefetch->next;
+			continue;
+		}
+
+		*pos = prefetch->next;
+		clear_dl_prefetch_ring(prefetch);
+		AST_JSON_UNREF(prefetch->j_dlma);
+		AST_JSON_UNREF(prefetch->j_plan);
+		ast_free(prefetch->dlma_uuid);
+		ast_free(prefetch->plan_uuid);
+		ast_free(prefetch);
+	}
+	ast_mutex_unlock(&g_dl_prefetch_mutex);
+
+	return;
+}
+
 static bool check_more_dl_list(struct ast_json* j_dlma, struct ast_json* j_plan)
 {
 	struct ast_json* j_res;
@@ -136,6 +506,105 @@ void clear_dl_list_dialing(const char* uuid)
 	return;
 }
 
+/**
+ * Set the dial key(trycnt_total, eligible) to the given dl_list update.
+ * The key is evaluated with the dl_list after the update.
+ * The dl_list is eligible if it has any number and is not answered.
+ * The retry counts depend on the plan, so they are checked by the dialing plan's query.
+ * The trycnt_total is set only if the update has any try count.
+ * @param j_dl_update	dl_list update info. Must have uuid.
+ * @param j_dl_list		dl_list info before the update. If it's NULL, get it from the database.
+ */
+void set_dl_list_dial_key(struct ast_json* j_dl_update, struct ast_json* j_dl_list)
+{
+	int i;
+	int trycnt_total;
+	int dial_num_point;
+	int res_dial;
+	bool trycnt_changed;
+	char* tmp;
+	struct ast_json* j_dl;
+	struct ast_json_iter* iter;
+
+	if(j_dl_update == NULL) {
+		return;
+	}
+
+	// get dl_list after update
+	if(j_dl_list != NULL) {
+		j_dl = ast_json_deep_copy(j_dl_list);
+	}
+	else {
+		j_dl = get_dl_list(ast_json_string_get(ast_json_object_get(j_dl_update, "uuid")));
+	}
+	if(j_dl == NULL) {
+		ast_log(LOG_WARNING, "Could not get dl_list info for dial key. uuid[%s]\n",
+				ast_json_string_get(ast_json_object_get(j_dl_update, "uuid"))
+				);
+		return;
+	}
+
+	trycnt_changed = false;
+	for(iter = ast_json_object_iter(j_dl_update); iter != NULL; iter = ast_json_object_iter_next(j_dl_update, iter)) {
+		if(is_dl_list_key(ast_json_object_iter_key(iter)) == false) {
+			continue;
+		}
+		if(strncmp(ast_json_object_iter_key(iter), "trycnt_", strlen("trycnt_")) == 0) {
+			trycnt_changed = true;
+		}
+		ast_json_object_set(j_dl, ast_json_object_iter_key(iter), ast_json_ref(ast_json_object_iter_value(iter)));
+	}
+
+	// trycnt_total
+	if(trycnt_changed == true) {
+		trycnt_total = 0;
+		for(i = 1; i < 9; i++) {
+			ast_asprintf(&tmp, "trycnt_%d", i);
+			trycnt_total += ast_json_integer_get(ast_json_object_get(j_dl, tmp));
+			ast_free(tmp);
+		}
+		ast_json_object_set(j_dl_update, "trycnt_total", ast_json_integer_create(trycnt_total));
+	}
+
+	// eligible
+	for(dial_num_point = -1, i = 1; i < 9; i++) {
+		ast_asprintf(&tmp, "number_%d", i);
+		if(ast_json_string_get(ast_json_object_get(j_dl, tmp)) != NULL) {
+			dial_num_point = i;
+		}
+		ast_free(tmp);
+		if(dial_num_point > 0) {
+			break;
+		}
+	}
+	res_dial = ast_json_integer_get(ast_json_object_get(j_dl, "res_dial"));
+	ast_json_object_set(j_dl_update, "eligible", ast_json_integer_create(((dial_num_point > 0) && (res_dial != AST_CONTROL_ANSWER))? 1 : 0));
+
+	AST_JSON_UNREF(j_dl);
+
+	return;
+}
+
+/**
+ * Return true if the given key is dl_list's dial key source column.
+ * @param key
+ * @return
+ */
+static bool is_dl_list_key(const char* key)
+{
+	if(key == NULL) {
+		return false;
+	}
+
+	if((strncmp(key, "trycnt_", strlen("trycnt_")) == 0)
+			|| (strncmp(key, "number_", strlen("number_")) == 0)
+			|| (strcmp(key, "res_dial") == 0)) {
+		return true;
+	}
+
+	return false;
+}
+
 /**
  * Update dl list info.
  * @param j_dlinfo
@@ -143,12 +612,11 @@ void clear_dl_list_dialing(const char* uuid)
  */
 bool update_dl_list(struct ast_json* j_dl)
 {
-	char* sql;
 	int ret;
-	char* tmp;
 	char* uuid;
 	const char* tmp_const;
 	struct ast_json* j_tmp;
+	struct ast_json_iter* iter;
 
 	if(j_dl == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
@@ -168,24 +636,25 @@ bool update_dl_list(struct ast_json* j_dl)
 	}
 	uuid = ast_strdup(tmp_const);
 
-	tmp = db_get_update_str(j_tmp);
-	if(tmp == NULL) {
-		ast_log(LOG_ERROR, "Could not get update sql.\n");
-		ast_free(uuid);
-		AST_JSON_UNREF(j_tmp);
-		return false;
+	// the dial key source is changed without the dial key. tries reset, number change, ...
+	if(ast_json_object_get(j_tmp, "eligible") == NULL) {
+		for(iter = ast_json_object_iter(j_tmp); iter != NULL; iter = ast_json_object_iter_next(j_tmp, iter)) {
+			if(is_dl_list_key(ast_json_object_iter_key(iter)) == true) {
+				set_dl_list_dial_key(j_tmp, NULL);
+				break;
+			}
+		}
 	}
-	AST_JSON_UNREF(j_tmp);
 
-	ast_asprintf(&sql, "update dl_list set %s where uuid = \"%s\";\n",
-			tmp, uuid
-			);
-	ast_free(tmp);
+	ast_json_object_del(j_tmp, "uuid");
+	invalidate_dl_prefetch(uuid);
 
-	ret = db_exec(sql);
-	ast_free(sql);
+	// written in the write-behind transaction.
+	ret = db_update_behind("dl_list", "uuid", uuid, NULL, j_tmp);
+	AST_JSON_UNREF(j_tmp);
 	if(ret == false) {
-		ast_log(LOG_ERROR, "Could not update dl_list info.");
+		ast_log(LOG_ERROR, "Could not update dl_list info.\n");
+		ast_free(uuid);
 		return false;
 	}
 
@@ -488,6 +957,7 @@ bool delete_dlma(const char* uuid)
 		ast_log(LOG_WARNING, "Could not delete dlma. uuid[%s]\n", uuid);
 		return false;
 	}
+	remove_dl_prefetch(uuid);
 
 	// send notification
 	send_manager_evt_out_dlma_delete(uuid);
@@ -625,20 +1095,17 @@ struct ast_json* get_dl_lists_by_count(int count)
 
 struct ast_json* get_dl_list(const char* uuid)
 {
-	char* sql;
-	db_res_t* db_res;
 	struct ast_json* j_res;
+	struct ast_json* j_binds;
 
 	if(uuid == NULL) {
 		return NULL;
 	}
 
-	ast_asprintf(&sql, "select * from dl_list where in_use=%d and uuid=\"%s\"", E_DL_USE_OK, uuid);
-	db_res = db_query(sql);
-	ast_free(sql);
-
-	j_res = db_get_record(db_res);
-	db_free(db_res);
+	// apply the pending updates.
+	j_binds = ast_json_pack("[i, s]", E_DL_USE_OK, uuid);
+	j_res = db_get_row_behind("dl_list", uuid, "select * from dl_list where in_use=? and uuid=?;", j_binds);
+	AST_JSON_UNREF(j_binds);
 
 	return j_res;
 }
@@ -1047,7 +1514,7 @@ struct ast_json* create_json_for_dl_result(rb_dialing* dialing)
 	const char* tmp_const;
 
 
-	j_res = ast_json_deep_copy(dialing->j_dialing);
+	j_res = rb_dialing_get_dialing_json(dialing);
 
 	ast_log(LOG_DEBUG, "Check value. dialing_uuid[%s], camp_uuid[%s], plan_uuid[%s], dlma_uuid[%s], dl_list_uuid[%s]\n",
 			ast_json_string_get(ast_json_object_get(j_res, "dialing_uuid")),
@@ -1061,24 +1528,15 @@ struct ast_json* create_json_for_dl_result(rb_dialing* dialing)
 	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "result_info_enable"));
 	if((tmp_const != NULL) && (atoi(tmp_const) == 1)) {
 		// write info
-		// already copied it.
-	}
-	else {
-		// otherwise, remove
-		ast_json_object_del(j_res, "info_camp");
-		ast_json_object_del(j_res, "info_dial");
-		ast_json_object_del(j_res, "info_plan");
-		ast_json_object_del(j_res, "info_dest");
-		ast_json_object_del(j_res, "info_dlma");
-		ast_json_object_del(j_res, "info_dl_list");
-		ast_json_object_del(j_res, "info_events");
+		// the dialing has the shared snapshots. copy it here only.
+		rb_dialing_set_info_json(dialing, j_res);
 	}
 
 	// check history options.
 	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "result_history_events_enable"));
 	if((tmp_const != NULL) && (atoi(tmp_const) == 1)) {
 		// write info
-		ast_json_object_set(j_res, "history_events", ast_json_ref(dialing->j_events));
+		ast_json_object_set(j_res, "history_events", rb_dialing_get_events_json(dialing));
 	}
 
 	return j_res;
@@ -1143,6 +1601,9 @@ char* create_dl_list(struct ast_json* j_dl)
 	ast_json_object_set(j_tmp, "tm_create", ast_json_string_create(tmp));
 	ast_free(tmp);
 
+	// dial key
+	set_dl_list_dial_key(j_tmp, j_tmp);
+
 	ast_log(LOG_NOTICE, "Create dl_list. dl_uuid[%s], dlma_uuid[%s], name[%s]\n",
 			ast_json_string_get(ast_json_object_get(j_tmp, "uuid")),
 			ast_json_string_get(ast_json_object_get(j_tmp, "dlma_uuid")),
@@ -1199,6 +1660,7 @@ bool delete_dl_list(const char* uuid)
 		ast_log(LOG_WARNING, "Could not delete dl_list. uuid[%s]\n", uuid);
 		return false;
 	}
+	invalidate_dl_prefetch(uuid);
 
 	// send notification
 	send_manager_evt_out_dl_list_delete(uuid);
@@ -1320,87 +1782,49 @@ bool is_endable_dl_list(struct ast_json* j_dlma, struct ast_json* j_plan)
 }
 
 /**
- * Check is the given dl is older than given plan's retry delay time.
+ * Get available dl_lists from database.
+ * Returns dial-able dl_lists which are over the plan's retry delay time.
  * @param j_dlma
- * @param j_dl
  * @param j_plan
+ * @param count	max count
  * @return
  */
-static bool is_over_retry_delay(struct ast_json* j_dlma, struct ast_json* j_dl, struct ast_json* j_plan)
-{
-	struct ast_json* j_tmp;
-	const char* tm_last_hangup;
-	int retry_delay;
-	char* sql;
-	db_res_t* db_res;
-
-	if((j_dlma == NULL) || (j_dl == NULL) || (j_plan == NULL)) {
-		ast_log(LOG_WARNING, "Wrong input parameters.\n");
-		return false;
-	}
-
-	// check last hangup timestamp.
-	// if there's no tm_last_hangup, then it's first try.
-	tm_last_hangup = ast_json_string_get(ast_json_object_get(j_dl, "tm_last_hangup"));
-	if((tm_last_hangup == NULL) || (strlen(tm_last_hangup) == 0)) {
-		return true;
-	}
-
-	retry_delay = ast_json_integer_get(ast_json_object_get(j_plan, "retry_delay"));
-
-	ast_asprintf(&sql, "select * from '%s' where uuid = '%s' and ((strftime('%%s', 'now') - strftime('%%s', tm_last_hangup)) > %d);",
-			ast_json_string_get(ast_json_object_get(j_dlma, "dl_table")),
-			ast_json_string_get(ast_json_object_get(j_dl, "uuid")),
-			retry_delay
-			);
-
-	db_res = db_query(sql);
-	ast_free(sql);
-
-	if(db_res == NULL) {
-		return false;
-	}
-
-	j_tmp = db_get_record(db_res);
-	db_free(db_res);
-	if(j_tmp == NULL) {
-		return false;
-	}
-	AST_JSON_UNREF(j_tmp);
-
-	return true;
-}
-
-/**
- * Get available dl_list from database.
- * @param j_dlma
- * @param j_plan
- * @return
- */
-static struct ast_json* get_dl_available(struct ast_json* j_dlma, struct ast_json* j_plan)
+static struct ast_json* get_dl_availables(struct ast_json* j_dlma, struct ast_json* j_plan, int count)
 {
 	char* sql;
 	db_res_t* db_res;
 	struct ast_json* j_res;
-
-	ast_asprintf(&sql, "select *, "
-			"(trycnt_1 + trycnt_2 + trycnt_3 + trycnt_4 + trycnt_5 + trycnt_6 + trycnt_7 + trycnt_8) as trycnt"
-			" from `%s` where ("
-			"(number_1 is not null and trycnt_1 < %"PRIdMAX")"
-			" or (number_2 is not null and trycnt_2 < %"PRIdMAX")"
-			" or (number_3 is not null and trycnt_3 < %"PRIdMAX")"
-			" or (number_4 is not null and trycnt_4 < %"PRIdMAX")"
-			" or (number_5 is not null and trycnt_5 < %"PRIdMAX")"
-			" or (number_6 is not null and trycnt_6 < %"PRIdMAX")"
-			" or (number_7 is not null and trycnt_7 < %"PRIdMAX")"
-			" or (number_8 is not null and trycnt_8 < %"PRIdMAX")"
+	struct ast_json* j_tmp;
+	struct ast_json* j_binds;
+
+	// the constants are kept in the query to use the partial index.
+	// the query string is same for all dlmas, so the statement is cached.
+	ast_asprintf(&sql, "select *, trycnt_total as trycnt"
+			" from dl_list where dlma_uuid = ? and ("
+			"(number_1 is not null and trycnt_1 < ?)"
+			" or (number_2 is not null and trycnt_2 < ?)"
+			" or (number_3 is not null and trycnt_3 < ?)"
+			" or (number_4 is not null and trycnt_4 < ?)"
+			" or (number_5 is not null and trycnt_5 < ?)"
+			" or (number_6 is not null and trycnt_6 < ?)"
+			" or (number_7 is not null and trycnt_7 < ?)"
+			" or (number_8 is not null and trycnt_8 < ?)"
 			")"
 			" and res_dial != %d"
 			" and status = %d"
-			" order by trycnt asc"
-			" limit 1"
+			" and eligible = 1"
+			" and in_use = %d"
+			" and (tm_last_hangup is null or tm_last_hangup = '' or ((strftime('%%s', 'now') - strftime('%%s', tm_last_hangup)) > ?))"
+			" order by trycnt_total asc"
+			" limit ?"
 			";",
-			ast_json_string_get(ast_json_object_get(j_dlma, "dl_table")),
+			AST_CONTROL_ANSWER,
+			E_DL_IDLE,
+			E_DL_USE_OK
+			);
+
+	j_binds = ast_json_pack("[s, I, I, I, I, I, I, I, I, I, i]",
+			ast_json_string_get(ast_json_object_get(j_dlma, "uuid")),
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_1")),
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_2")),
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_3")),
@@ -1409,22 +1833,32 @@ static struct ast_json* get_dl_available(struct ast_json* j_dlma, struct ast_jso
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_6")),
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_7")),
 			ast_json_integer_get(ast_json_object_get(j_plan, "max_retry_cnt_8")),
-			AST_CONTROL_ANSWER,
-			E_DL_IDLE
+			ast_json_integer_get(ast_json_object_get(j_plan, "retry_delay")),
+			count
 			);
+	if(j_binds == NULL) {
+		ast_log(LOG_ERROR, "Could not create bind parameters.\n");
+		ast_free(sql);
+		return NULL;
+	}
 
-	db_res = db_query(sql);
+	db_res = db_query_bind(sql, j_binds);
 	ast_free(sql);
+	AST_JSON_UNREF(j_binds);
 	if(db_res == NULL) {
 		ast_log(LOG_ERROR, "Could not get dial list info.");
 		return NULL;
 	}
 
-	j_res = db_get_record(db_res);
-	db_free(db_res);
-	if(j_res == NULL) {
-		return NULL;
+	j_res = ast_json_array_create();
+	while(1) {
+		j_tmp = db_get_record(db_res);
+		if(j_tmp == NULL) {
+			break;
+		}
+		ast_json_array_append(j_res, j_tmp);
 	}
+	db_free(db_res);
 
 	return j_res;
 }
@@ -1440,29 +1874,29 @@ bool update_dl_list_after_create_dialing_info(rb_dialing* dialing)
 	tmp = get_utc_timestamp();
 
 	// get
-	ast_asprintf(&try_count_field, "trycnt_%"PRIdMAX,
-			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "dial_index"))
-			);
+	ast_asprintf(&try_count_field, "trycnt_%d", dialing->dial_index);
 
 	// create update dl_list
-	j_dl_update = ast_json_pack("{s:s, s:I, s:i, s:s, s:s, s:s, s:s}",
-			"uuid",				 				ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")),
-			try_count_field,			ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "dial_trycnt")),
+	j_dl_update = ast_json_pack("{s:s, s:i, s:i, s:s, s:s, s:s, s:s}",
+			"uuid",				 				dialing->dl_list_uuid,
+			try_count_field,			dialing->dial_trycnt,
 			"status",			   			E_DL_DIALING,
 			"dialing_uuid",		 		dialing->uuid,
-			"dialing_camp_uuid",	ast_json_string_get(ast_json_object_get(dialing->j_dialing, "camp_uuid")),
-			"dialing_plan_uuid",	ast_json_string_get(ast_json_object_get(dialing->j_dialing, "plan_uuid")),
+			"dialing_camp_uuid",	dialing->camp_uuid,
+			"dialing_plan_uuid",	dialing->plan_uuid,
 			"tm_last_dial",		 		tmp
 			);
 	ast_free(tmp);
 	ast_free(try_count_field);
 
+	// dial key
+	set_dl_list_dial_key(j_dl_update, dialing->j_info_dl_list);
+
 	// dl update
+	// the caller takes care of the dialing on failure.
 	ret = update_dl_list(j_dl_update);
 	AST_JSON_UNREF(j_dl_update);
 	if(ret == false) {
-		rb_dialing_destory(dialing);
-		clear_dl_list_dialing(ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")));
 		ast_log(LOG_ERROR, "Could not update dial list info.\n");
 		return false;
 	}
@@ -56,6 +56,7 @@ int get_dl_list_cnt_tried(struct ast_json* j_dlma);
 struct ast_json* get_dl_available_predictive(struct ast_json* j_dlma, struct ast_json* j_plan);
 bool is_endable_dl_list(struct ast_json* j_dlma, struct ast_json* j_plan);
 void clear_dl_list_dialing(const char* uuid);
+void set_dl_list_dial_key(struct ast_json* j_dl_update, struct ast_json* j_dl_list);
 
 struct ast_json* create_dial_info(struct ast_json* j_plan, struct ast_json* j_dl_list, struct ast_json* j_dest);
 struct ast_json* create_json_for_dl_result(rb_dialing* dialing);
@@ -11,6 +11,7 @@
 #include <event2/event.h>
 #include <event2/thread.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "asterisk/json.h"
 #include "asterisk/utils.h"
@@ -27,25 +28,42 @@
 #include "dl_handler.h"
 #include "plan_handler.h"
 #include "destination_handler.h"
+#include "originate_handler.h"
 #include "utils.h"
 
 #define TEMP_FILENAME "/tmp/asterisk_outbound_tmp.txt"
 #define DEF_EVENT_TIME_FAST "100000"
 #define DEF_EVENT_TIME_SLOW "3000000"
 #define DEF_ONE_SEC_IN_MICRO_SEC	1000000
+#define DEF_DIAL_CPS_GLOBAL	"10"
+#define DEF_DIAL_CPS_CAMPAIGN	"0"
 
 
 struct event_base*  g_base = NULL;
 
+static int g_dial_cps_global = 0;				///< global calls per second limit. 0 is unlimited.
+static int g_dial_cps_campaign = 0;				///< per-campaign calls per second limit. 0 is unlimited.
+static struct ast_json* g_j_dial_bucket_global = NULL;	///< global cps token bucket.
+static struct ast_json* g_j_dial_buckets = NULL;		///< per-campaign cps token buckets. key:camp_uuid
+
+static struct timeval g_tm_fast;							///< fast event time delay.
+static struct event* g_ev_campaign_start = NULL;			///< dialing. woken up by capacity free.
+static struct event* g_ev_campaign_starting = NULL;
+static struct event* g_ev_campaign_stopping = NULL;
+static struct event* g_ev_campaign_stopping_force = NULL;
+static struct event* g_ev_check_dialing_end = NULL;
+static struct event* g_ev_dial_retry = NULL;				///< one-shot dialing retry for the cps limit.
+
 static int init_outbound(void);
 
 static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
+static int dial_campaign(struct ast_json* j_camp);
 static void cb_campaign_starting(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 static void cb_campaign_stopping(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 static void cb_campaign_stopping_force(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 static void cb_check_dialing_end(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
-static void cb_check_dialing_error(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 static void cb_check_campaign_end(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
+static void cb_dialing_watchdog(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 static void cb_check_campaign_schedule_start(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 static void cb_check_campaign_schedule_end(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
 //static void cb_campaign_schedule_stopping(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg);
@@ -56,7 +74,7 @@ static void cb_check_campaign_schedule_end(__attribute__((unused)) int fd, __att
 
 static void dial_desktop(const struct ast_json* j_camp, const struct ast_json* j_plan, const struct ast_json* j_dlma);
 static void dial_power(const struct ast_json* j_camp, const struct ast_json* j_plan, const struct ast_json* j_dlma);
-static void dial_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest);
+static int dial_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest);
 static void dial_robo(const struct ast_json* j_camp, const struct ast_json* j_plan, const struct ast_json* j_dlma);
 static void dial_redirect(const struct ast_json* j_camp, const struct ast_json* j_plan, const struct ast_json* j_dlma);
 
@@ -64,9 +82,19 @@ static void dial_redirect(const struct ast_json* j_camp, const struct ast_json*
 //struct ast_json* get_queue_param(const char* name);
 
 static bool write_result_json(struct ast_json* j_res);
+static bool finalize_dialing(rb_dialing* dialing);
+static bool finalize_dialing_dl_list(rb_dialing* dialing);
 
 // todo
 static int check_dial_avaiable_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest);
+static bool originate_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest, struct ast_json* j_dl_list);
+static bool originate_direct(rb_dialing* dialing, struct ast_json* j_dial, E_DESTINATION_TYPE dial_type);
+
+static int get_dial_bucket_avail(const char* camp_uuid);
+static void take_dial_bucket(const char* camp_uuid, int cnt);
+static int refill_dial_bucket(struct ast_json* j_bucket, int cps);
+
+static void activate_event(struct event* ev);
 
 int run_outbound(void)
 {
@@ -74,8 +102,8 @@ int run_outbound(void)
 	int event_delay;
 	const char* tmp_const;
 	struct event* ev;
-	struct timeval tm_fast;
 	struct timeval tm_slow;
+	struct timeval tm_watchdog;
 
 	// event delay fast.
 	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "event_time_fast"));
@@ -86,8 +114,8 @@ int run_outbound(void)
 	ast_log(LOG_NOTICE, "Event delay time for fast event. event_time_fast[%s]\n", tmp_const);
 
 	event_delay = atoi(tmp_const);
-	tm_fast.tv_sec = event_delay / DEF_ONE_SEC_IN_MICRO_SEC;
-	tm_fast.tv_usec = event_delay % DEF_ONE_SEC_IN_MICRO_SEC;
+	g_tm_fast.tv_sec = event_delay / DEF_ONE_SEC_IN_MICRO_SEC;
+	g_tm_fast.tv_usec = event_delay % DEF_ONE_SEC_IN_MICRO_SEC;
 
 	// event delay slow.
 	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "event_time_slow"));
@@ -101,6 +129,24 @@ int run_outbound(void)
 	tm_slow.tv_sec = event_delay / DEF_ONE_SEC_IN_MICRO_SEC;
 	tm_slow.tv_usec = event_delay % DEF_ONE_SEC_IN_MICRO_SEC;
 
+	// global calls per second.
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "dial_cps_global"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_DIAL_CPS_GLOBAL;
+		ast_log(LOG_NOTICE, "Could not get correct dial_cps_global value. Set default. dial_cps_global[%s]\n", tmp_const);
+	}
+	ast_log(LOG_NOTICE, "Global calls per second limit. dial_cps_global[%s]\n", tmp_const);
+	g_dial_cps_global = atoi(tmp_const);
+
+	// campaign calls per second.
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "general"), "dial_cps_campaign"));
+	if(tmp_const == NULL) {
+		tmp_const = DEF_DIAL_CPS_CAMPAIGN;
+		ast_log(LOG_NOTICE, "Could not get correct dial_cps_campaign value. Set default. dial_cps_campaign[%s]\n", tmp_const);
+	}
+	ast_log(LOG_NOTICE, "Campaign calls per second limit. dial_cps_campaign[%s]\n", tmp_const);
+	g_dial_cps_campaign = atoi(tmp_const);
+
 	// init libevent
 	ret = init_outbound();
 	if(ret == false) {
@@ -108,29 +154,37 @@ int run_outbound(void)
 		return false;
 	}
 
+	// the timers below are safety net only.
+	// the dialing/campaign events are woken up by wakeup_outbound_dialing() and wakeup_outbound_campaign().
+
 	// check start.
-	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_start, NULL);
-	event_add(ev, &tm_fast);
+	g_ev_campaign_start = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_start, NULL);
+	event_add(g_ev_campaign_start, &tm_slow);
+
+	// dialing retry for cps limit.
+	g_ev_dial_retry = evtimer_new(g_base, cb_campaign_start, NULL);
 
 	// check starting
-	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_starting, NULL);
-	event_add(ev, &tm_slow);
+	g_ev_campaign_starting = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_starting, NULL);
+	event_add(g_ev_campaign_starting, &tm_slow);
 
 	// check stopping.
-	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_stopping, NULL);
-	event_add(ev, &tm_slow);
+	g_ev_campaign_stopping = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_stopping, NULL);
+	event_add(g_ev_campaign_stopping, &tm_slow);
 
 	// check force stopping
-	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_stopping_force, NULL);
-	event_add(ev, &tm_slow);
+	g_ev_campaign_stopping_force = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_campaign_stopping_force, NULL);
+	event_add(g_ev_campaign_stopping_force, &tm_slow);
 
-	// chceck dialing end
-	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_check_dialing_end, NULL);
-	event_add(ev, &tm_fast);
+	// check dialing end(hangup/error). drains the completion queue.
+	g_ev_check_dialing_end = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_check_dialing_end, NULL);
+	event_add(g_ev_check_dialing_end, &tm_slow);
 
-	// check diaing error
-	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_check_dialing_error, NULL);
-	event_add(ev, &tm_fast);
+	// dialing watchdog
+	tm_watchdog.tv_sec = 0;
+	tm_watchdog.tv_usec = DEF_DIALING_WATCHDOG_TICK * 1000;
+	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_dialing_watchdog, NULL);
+	event_add(ev, &tm_watchdog);
 
 	// check end
 	ev = event_new(g_base, -1, EV_TIMEOUT | EV_PERSIST, cb_check_campaign_end, NULL);
@@ -175,6 +229,12 @@ static int init_outbound(void)
 		return false;
 	}
 
+	// init cps token buckets
+	AST_JSON_UNREF(g_j_dial_bucket_global);
+	AST_JSON_UNREF(g_j_dial_buckets);
+	g_j_dial_bucket_global = ast_json_object_create();
+	g_j_dial_buckets = ast_json_object_create();
+
 	// check database tables.
 	db_res = db_query("select 1 from campaign limit 1;");
 	if(db_res == NULL) {
@@ -192,6 +252,12 @@ static int init_outbound(void)
 		return false;
 	}
 
+	ret = init_campaign();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate campaign.\n");
+		return false;
+	}
+
 	ast_log(LOG_NOTICE, "Initiated outbound.\n");
 
 	return true;
@@ -209,26 +275,96 @@ void stop_outbound(void)
 	return;
 }
 
+/**
+ * Wake up the dialer.
+ * Call this when the dialing capacity could be freed.(hangup, agent complete, ...)
+ * Thread safe.
+ */
+void wakeup_outbound_dialing(void)
+{
+	// finish the ended dialings first, then dial.
+	activate_event(g_ev_check_dialing_end);
+	activate_event(g_ev_campaign_start);
+
+	return;
+}
+
+/**
+ * Wake up the campaign status handlers.
+ * Call this when the campaign status changed.
+ * Thread safe.
+ */
+void wakeup_outbound_campaign(void)
+{
+	activate_event(g_ev_campaign_starting);
+	activate_event(g_ev_campaign_stopping);
+	activate_event(g_ev_campaign_stopping_force);
+	activate_event(g_ev_campaign_start);
+
+	return;
+}
+
+/**
+ * Make the given event active.
+ * Multiple activations before the callback are merged into one.
+ * @param ev
+ */
+static void activate_event(struct event* ev)
+{
+	if(ev == NULL) {
+		// not initiated yet.
+		return;
+	}
+
+	event_active(ev, EV_TIMEOUT, 0);
+
+	return;
+}
+
 /**
  *  @brief  Check start status campaign and trying to make a call.
+ *  Gives one full round of the run queue to the started campaigns.
  */
 static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg)
 {
 	struct ast_json* j_camp;
+	int round;
+	int dial_cnt;
+	int i;
+
+	dial_cnt = 0;
+	round = get_campaign_rq_round_size();
+	for(i = 0; i < round; i++) {
+		j_camp = get_campaign_for_dialing();
+		if(j_camp == NULL) {
+			// Nothing.
+			break;
+		}
+
+		dial_cnt += dial_campaign(j_camp);
+		AST_JSON_UNREF(j_camp);
+	}
+
+	// there could be more capacity for the campaigns.
+	if(dial_cnt > 0) {
+		activate_event(g_ev_campaign_start);
+	}
+
+	return;
+}
+
+/**
+ * Make calls of the given campaign.
+ * @param j_camp
+ * @return dialed count
+ */
+static int dial_campaign(struct ast_json* j_camp)
+{
 	struct ast_json* j_plan;
 	struct ast_json* j_dlma;
 	struct ast_json* j_dest;
 	int dial_mode;
-
-	j_camp = get_campaign_for_dialing();
-	if(j_camp == NULL) {
-		// Nothing.
-		return;
-	}
-//	ast_log(LOG_DEBUG, "Get campaign info. camp_uuid[%s], camp_name[%s]\n",
-//			ast_json_string_get(ast_json_object_get(j_camp, "uuid")),
-//			ast_json_string_get(ast_json_object_get(j_camp, "name"))
-//			);
+	int dial_cnt;
 
 	// get plan
 	j_plan = get_plan(ast_json_string_get(ast_json_object_get(j_camp, "plan")));
@@ -238,8 +374,7 @@ static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unu
 				ast_json_string_get(ast_json_object_get(j_camp, "plan"))
 				);
 		update_campaign_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOPPING);
-		AST_JSON_UNREF(j_camp);
-		return;
+		return 0;
 	}
 
 	// get destination
@@ -250,9 +385,8 @@ static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unu
 						ast_json_string_get(ast_json_object_get(j_camp, "dest"))? : ""
 						);
 		update_campaign_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOPPING);
-		AST_JSON_UNREF(j_camp);
 		AST_JSON_UNREF(j_plan);
-		return;
+		return 0;
 	}
 
 	// get dl_master_info
@@ -264,10 +398,9 @@ static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unu
 				ast_json_string_get(ast_json_object_get(j_camp, "dlma"))
 				);
 		update_campaign_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOPPING);
-		AST_JSON_UNREF(j_camp);
 		AST_JSON_UNREF(j_plan);
 		AST_JSON_UNREF(j_dest);
-		return;
+		return 0;
 	}
 	ast_log(LOG_VERBOSE, "Get dlma info. dlma_uuid[%s], dlma_name[%s]\n",
 			ast_json_string_get(ast_json_object_get(j_dlma, "uuid")),
@@ -283,16 +416,16 @@ static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unu
 				);
 
 		update_campaign_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOPPING);
-		AST_JSON_UNREF(j_camp);
 		AST_JSON_UNREF(j_plan);
 		AST_JSON_UNREF(j_dlma);
 		AST_JSON_UNREF(j_dest);
-		return;
+		return 0;
 	}
 
+	dial_cnt = 0;
 	switch(dial_mode) {
 		case E_DIAL_MODE_PREDICTIVE: {
-			dial_predictive(j_camp, j_plan, j_dlma, j_dest);
+			dial_cnt = dial_predictive(j_camp, j_plan, j_dlma, j_dest);
 		}
 		break;
 
@@ -323,12 +456,11 @@ static void cb_campaign_start(__attribute__((unused)) int fd, __attribute__((unu
 	}
 
 	// release
-	AST_JSON_UNREF(j_camp);
 	AST_JSON_UNREF(j_plan);
 	AST_JSON_UNREF(j_dlma);
 	AST_JSON_UNREF(j_dest);
 
-	return;
+	return dial_cnt;
 }
 
 /**
@@ -416,7 +548,9 @@ static void cb_campaign_stopping(__attribute__((unused)) int fd, __attribute__((
 				ast_json_string_get(ast_json_object_get(j_camp, "uuid")),
 				ast_json_string_get(ast_json_object_get(j_camp, "name"))
 				);
+			continue;
 		}
+		ast_json_object_del(g_j_dial_buckets, ast_json_string_get(ast_json_object_get(j_camp, "uuid")));
 	}
 
 	AST_JSON_UNREF(j_camps);
@@ -435,7 +569,6 @@ static void cb_campaign_stopping_force(__attribute__((unused)) int fd, __attribu
 	struct ast_json* j_camp;
 	struct ao2_iterator iter;
 	rb_dialing* dialing;
-	const char* tmp_const;
 	int i;
 	int size;
 
@@ -461,12 +594,11 @@ static void cb_campaign_stopping_force(__attribute__((unused)) int fd, __attribu
 				break;
 			}
 
-			tmp_const = ast_json_string_get(ast_json_object_get(dialing->j_dialing, "camp_uuid"));
-			if(tmp_const == NULL) {
+			if(dialing->camp_uuid == NULL) {
 				continue;
 			}
 
-			if(strcmp(tmp_const, ast_json_string_get(ast_json_object_get(j_camp, "uuid"))) != 0) {
+			if(strcmp(dialing->camp_uuid, ast_json_string_get(ast_json_object_get(j_camp, "uuid"))) != 0) {
 				continue;
 			}
 
@@ -481,6 +613,7 @@ static void cb_campaign_stopping_force(__attribute__((unused)) int fd, __attribu
 
 		// update status to stop
 		update_campaign_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOP);
+		ast_json_object_del(g_j_dial_buckets, ast_json_string_get(ast_json_object_get(j_camp, "uuid")));
 	}
 	AST_JSON_UNREF(j_camps);
 }
@@ -534,170 +667,159 @@ static void cb_campaign_stopping_force(__attribute__((unused)) int fd, __attribu
 //
 //}
 
+/**
+ * Finalize the completed dialings.
+ * Drains the completion queue only. The dialings which were failed to finalize are pushed back
+ * and retried by the next wakeup or the safety net timer.
+ * @param fd
+ * @param event
+ * @param arg
+ */
 static void cb_check_dialing_end(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg)
 {
-	struct ao2_iterator iter;
 	rb_dialing* dialing;
-	struct ast_json* j_tmp;
 	int ret;
-	char* timestamp;
+	int cnt;
+	int i;
 
-	iter = rb_dialing_iter_init();
-	while(1) {
-		dialing = rb_dialing_iter_next(&iter);
+	cnt = rb_dialing_get_completed_count();
+	for(i = 0; i < cnt; i++) {
+		dialing = rb_dialing_pop_completed();
 		if(dialing == NULL) {
 			break;
 		}
 
-		if(dialing->status != E_DIALING_HANGUP) {
-			continue;
-		}
-
-		// create dl_list for update
-		timestamp = get_utc_timestamp();
-		j_tmp = ast_json_pack("{s:s, s:i, s:O, s:O, s:O, s:s}",
-				"uuid",				 ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")),
-				"status",			   E_DL_IDLE,
-				"dialing_uuid",		 ast_json_null(),
-				"dialing_camp_uuid",	ast_json_null(),
-				"dialing_plan_uuid",	ast_json_null(),
-				"tm_last_hangup",			timestamp
-				);
-		ast_json_object_set(j_tmp, "res_hangup", ast_json_ref(ast_json_object_get(dialing->j_dialing, "res_hangup")));
-		ast_json_object_set(j_tmp, "res_dial", ast_json_ref(ast_json_object_get(dialing->j_dialing, "res_dial")));
-		ast_free(timestamp);
-		if(j_tmp == NULL) {
-			ast_log(LOG_ERROR, "Could not create update dl_list json. dl_list_uuid[%s], res_hangup[%"PRIdMAX"], res_dial[%"PRIdMAX"]\n",
-					ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")),
-					ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "res_hangup")),
-					ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "res_dial"))
-					);
-		}
-
-		// update dl_list
-		ret = update_dl_list(j_tmp);
-		AST_JSON_UNREF(j_tmp);
+		ret = finalize_dialing(dialing);
 		if(ret == false) {
-			ast_log(LOG_WARNING, "Could not update dialing result. dialing_uuid[%s], dl_list_uuid[%s]\n",
-					dialing->uuid, ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")));
-			continue;
+			rb_dialing_push_completed(dialing);
 		}
+		ao2_ref(dialing, -1);
+	}
 
-		// create result data
-		j_tmp = create_json_for_dl_result(dialing);
-		ast_log(LOG_DEBUG, "Check result value. dial_channel[%s], dial_addr[%s], dial_index[%"PRIdMAX"], dial_trycnt[%"PRIdMAX"], dial_timeout[%"PRIdMAX"], dial_type[%"PRIdMAX"], dial_exten[%s], res_dial[%"PRIdMAX"], res_hangup[%"PRIdMAX"], res_hangup_detail[%s]\n",
-
-				// dial
-				ast_json_string_get(ast_json_object_get(j_tmp, "dial_channel")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "dial_addr")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_index")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_trycnt")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_timeout")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_type")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "dial_exten")),
-
-				// result
-				ast_json_integer_get(ast_json_object_get(j_tmp, "res_dial")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "res_hangup")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "res_hangup_detail"))
-				);
-
-//		db_insert("dl_result", j_tmp);
-		ret = write_result_json(j_tmp);
-		AST_JSON_UNREF(j_tmp);
-		if(ret == false) {
-			ast_log(LOG_ERROR, "Could not write result correctly.\n");
-			continue;
-		}
+	return;
+}
 
-		rb_dialing_destory(dialing);
-		ast_log(LOG_DEBUG, "Destroyed dialing info.\n");
+/**
+ * Run the dialing watchdog.
+ * The reaped dialings are finalized by the cb_check_dialing_end().
+ * @param fd
+ * @param event
+ * @param arg
+ */
+static void cb_dialing_watchdog(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg)
+{
+	int ret;
 
+	ret = rb_dialing_watchdog_tick();
+	if(ret > 0) {
+		ast_log(LOG_NOTICE, "Reaped expired dialings. count[%d]\n", ret);
+		wakeup_outbound_dialing();
 	}
-	ao2_iterator_destroy(&iter);
 
 	return;
 }
 
-static void cb_check_dialing_error(__attribute__((unused)) int fd, __attribute__((unused)) short event, __attribute__((unused)) void *arg)
+/**
+ * Finalize the hangup/error dialing.
+ * Updates the dl_list, writes the result and destroys the dialing.
+ * The dialing is destroyed only after the result is written.
+ * If it fails, the caller keeps it and retries. The dl_list is not updated again in the retry.
+ * @param dialing
+ * @return
+ */
+static bool finalize_dialing(rb_dialing* dialing)
 {
-	struct ao2_iterator iter;
-	rb_dialing* dialing;
 	struct ast_json* j_tmp;
 	int ret;
-	char* timestamp;
-
-	iter = rb_dialing_iter_init();
-	while(1) {
-		dialing = rb_dialing_iter_next(&iter);
-		if(dialing == NULL) {
-			break;
-		}
 
-		if(dialing->status != E_DIALING_ERROR) {
-			continue;
+	if(dialing->dl_list_updated == false) {
+		ret = finalize_dialing_dl_list(dialing);
+		if(ret == false) {
+			return false;
 		}
+		dialing->dl_list_updated = true;
+	}
 
+	// create result data
+	j_tmp = create_json_for_dl_result(dialing);
+	ast_log(LOG_DEBUG, "Check result value. status[%d], dial_channel[%s], dial_addr[%s], dial_index[%d], dial_trycnt[%d], dial_timeout[%d], dial_type[%"PRIdMAX"], dial_exten[%s], res_dial[%d], res_hangup[%d], res_hangup_detail[%s]\n",
+			dialing->status,
+
+			// dial
+			ast_json_string_get(ast_json_object_get(j_tmp, "dial_channel")),
+			ast_json_string_get(ast_json_object_get(j_tmp, "dial_addr")),
+			dialing->dial_index,
+			dialing->dial_trycnt,
+			dialing->dial_timeout,
+			ast_json_integer_get(ast_json_object_get(j_tmp, "dial_type")),
+			ast_json_string_get(ast_json_object_get(j_tmp, "dial_exten")),
+
+			// result
+			dialing->res_dial,
+			dialing->res_hangup,
+			dialing->res_hangup_detail ? : ""
+			);
 
-		// create dl_list for update
-		timestamp = get_utc_timestamp();
-		j_tmp = ast_json_pack("{s:s, s:i, s:O, s:O, s:O, s:s}",
-				"uuid",				 ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")),
-				"status",			   E_DL_IDLE,
-				"dialing_uuid",		 ast_json_null(),
-				"dialing_camp_uuid",	ast_json_null(),
-				"dialing_plan_uuid",	ast_json_null(),
-				"tm_last_hangup",			timestamp
-				);
-		ast_json_object_set(j_tmp, "res_hangup", ast_json_ref(ast_json_object_get(dialing->j_dialing, "res_hangup")));
-		ast_json_object_set(j_tmp, "res_dial", ast_json_ref(ast_json_object_get(dialing->j_dialing, "res_dial")));
-		ast_free(timestamp);
-		if(j_tmp == NULL) {
-			ast_log(LOG_ERROR, "Could not create update dl_list json. dl_list_uuid[%s], res_hangup[%"PRIdMAX"], res_dial[%"PRIdMAX"]\n",
-					ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")),
-					ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "res_hangup")),
-					ast_json_integer_get(ast_json_object_get(dialing->j_dialing, "res_dial"))
-					);
-		}
+//	db_insert("dl_result", j_tmp);
+	ret = write_result_json(j_tmp);
+	AST_JSON_UNREF(j_tmp);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not write result correctly. Retry later. dialing_uuid[%s], dl_list_uuid[%s]\n",
+				dialing->uuid, dialing->dl_list_uuid);
+		return false;
+	}
 
-		// update dl_list
-		ret = update_dl_list(j_tmp);
-		AST_JSON_UNREF(j_tmp);
-		if(ret == false) {
-			ast_log(LOG_WARNING, "Could not update dialing result. dialing_uuid[%s], dl_list_uuid[%s]\n",
-					dialing->uuid, ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")));
-			continue;
-		}
+	rb_dialing_destory(dialing);
+	ast_log(LOG_DEBUG, "Destroyed dialing info.\n");
 
-		// create result data
-		j_tmp = create_json_for_dl_result(dialing);
-		ast_log(LOG_DEBUG, "Check result value. dial_channel[%s], dial_addr[%s], dial_index[%"PRIdMAX"], dial_trycnt[%"PRIdMAX"], dial_timeout[%"PRIdMAX"], dial_type[%"PRIdMAX"], dial_exten[%s], res_dial[%"PRIdMAX"], res_hangup[%"PRIdMAX"], res_hangup_detail[%s]\n",
-
-				// dial
-				ast_json_string_get(ast_json_object_get(j_tmp, "dial_channel")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "dial_addr")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_index")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_trycnt")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_timeout")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "dial_type")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "dial_exten")),
-
-				// result
-				ast_json_integer_get(ast_json_object_get(j_tmp, "res_dial")),
-				ast_json_integer_get(ast_json_object_get(j_tmp, "res_hangup")),
-				ast_json_string_get(ast_json_object_get(j_tmp, "res_hangup_detail"))
-				);
+	return true;
+}
 
-		ret = write_result_json(j_tmp);
-		AST_JSON_UNREF(j_tmp);
+/**
+ * Update the dl_list of the finalizing dialing.
+ * Releases the dl_list and sets the dialing result.
+ * @param dialing
+ * @return
+ */
+static bool finalize_dialing_dl_list(rb_dialing* dialing)
+{
+	struct ast_json* j_tmp;
+	int ret;
+	char* timestamp;
 
-		rb_dialing_destory(dialing);
-		ast_log(LOG_DEBUG, "Destroyed!\n");
+	// create dl_list for update
+	timestamp = get_utc_timestamp();
+	j_tmp = ast_json_pack("{s:s, s:i, s:O, s:O, s:O, s:s}",
+			"uuid",				 dialing->dl_list_uuid,
+			"status",			   E_DL_IDLE,
+			"dialing_uuid",		 ast_json_null(),
+			"dialing_camp_uuid",	ast_json_null(),
+			"dialing_plan_uuid",	ast_json_null(),
+			"tm_last_hangup",			timestamp
+			);
+	ast_free(timestamp);
+	if(j_tmp == NULL) {
+		ast_log(LOG_ERROR, "Could not create update dl_list json. dl_list_uuid[%s], res_hangup[%d], res_dial[%d]\n",
+				dialing->dl_list_uuid,
+				dialing->res_hangup,
+				dialing->res_dial
+				);
+		return false;
+	}
+	ast_json_object_set(j_tmp, "res_hangup", ast_json_integer_create(dialing->res_hangup));
+	ast_json_object_set(j_tmp, "res_dial", ast_json_integer_create(dialing->res_dial));
+	set_dl_list_dial_key(j_tmp, dialing->j_info_dl_list);
 
+	// update dl_list
+	ret = update_dl_list(j_tmp);
+	AST_JSON_UNREF(j_tmp);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not update dialing result. dialing_uuid[%s], dl_list_uuid[%s]\n",
+				dialing->uuid, dialing->dl_list_uuid);
+		return false;
 	}
-	ao2_iterator_destroy(&iter);
 
-	return;
+	return true;
 }
 
 /**
@@ -853,51 +975,153 @@ static void dial_power(const struct ast_json* j_camp, const struct ast_json* j_p
 }
 
 /**
- *  Make a call by predictive algorithms.
+ *  Make calls by predictive algorithms.
  *  Currently, just consider ready agent only.
+ *  Fills all of the available capacity in one tick, bounded by the cps token buckets.
  * @param j_camp	campaign info
  * @param j_plan	plan info
  * @param j_dlma	dial list master info
  */
-static void dial_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest)
+static int dial_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest)
 {
 	int ret;
+	int cnt_avail;
+	int cnt_bucket;
+	int cnt_window;
+	int i;
+	const char* camp_uuid;
 	struct ast_json* j_dl_list;
-	struct ast_json* j_dial;
-	struct ast_json* j_res;
-	rb_dialing* dialing;
-	char* tmp;
-	E_DESTINATION_TYPE dial_type;
 
-	// get dl_list info to dial.
-	j_dl_list = get_dl_available_predictive(j_dlma, j_plan);
-	if(j_dl_list == NULL) {
-		// No available list
-//		ast_log(LOG_VERBOSE, "No more dialing list. stopping the campaign.\n");
-//		update_campaign_info_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOPPING);
-		return;
-	}
+	camp_uuid = ast_json_string_get(ast_json_object_get(j_camp, "uuid"));
 
 	// check available outgoing call.
-	ret = check_dial_avaiable_predictive(j_camp, j_plan, j_dlma, j_dest);
-	if(ret == -1) {
+	// the dl_list is taken from the prefetch after the checks. it should not be dropped.
+	cnt_avail = check_dial_avaiable_predictive(j_camp, j_plan, j_dlma, j_dest);
+	if(cnt_avail == -1) {
 		// something was wrong. stop the campaign.
-		update_campaign_status(ast_json_string_get(ast_json_object_get(j_camp, "uuid")), E_CAMP_STOPPING);
-		AST_JSON_UNREF(j_dl_list);
-		return;
+		update_campaign_status(camp_uuid, E_CAMP_STOPPING);
+		return 0;
 	}
-	else if(ret == 0) {
+	else if(cnt_avail == 0) {
 		// Too much calls already outgoing.
+		return 0;
+	}
+
+	// check cps limit
+	cnt_bucket = get_dial_bucket_avail(camp_uuid);
+	if(cnt_bucket < cnt_avail) {
+		cnt_avail = cnt_bucket;
+
+		// no more wakeup will come for the tokens. retry after a while.
+		if((g_ev_dial_retry != NULL) && (evtimer_pending(g_ev_dial_retry, NULL) == 0)) {
+			evtimer_add(g_ev_dial_retry, &g_tm_fast);
+		}
+	}
+	if(cnt_avail <= 0) {
+		ast_log(LOG_DEBUG, "Reached calls per second limit. camp_uuid[%s]\n", camp_uuid);
+		return 0;
+	}
+
+	// check originate window.
+	// the window is opened by the originate response. it wakes up the dialing.
+	cnt_window = rb_dialing_get_originate_window_avail();
+	if(cnt_window < cnt_avail) {
+		cnt_avail = cnt_window;
+	}
+	if(cnt_avail <= 0) {
+		ast_log(LOG_DEBUG, "Reached originate window limit. camp_uuid[%s], outstanding[%d]\n", camp_uuid, rb_dialing_get_originate_outstanding());
+		return 0;
+	}
+	ast_log(LOG_DEBUG, "Dialing count for this tick. camp_uuid[%s], count[%d]\n", camp_uuid, cnt_avail);
+
+	for(i = 0; i < cnt_avail; i++) {
+		// get dl_list info to dial.
+		j_dl_list = get_dl_available_predictive(j_dlma, j_plan);
+		if(j_dl_list == NULL) {
+			// No available list
+			break;
+		}
+
+		ret = originate_predictive(j_camp, j_plan, j_dlma, j_dest, j_dl_list);
 		AST_JSON_UNREF(j_dl_list);
-		return;
+		if(ret == false) {
+			break;
+		}
+		take_dial_bucket(camp_uuid, 1);
 	}
 
+	return i;
+}
+
+/**
+ * Originate the dialing through the core.
+ * The core raises no OriginateResponse event, so the dialing is marked as
+ * originate pending. The first answer(Newstate) or Hangup event takes it.
+ * Returns false if the dialing could be originated through the AMI.
+ * @param dialing
+ * @param j_dial	dial info
+ * @param dial_type
+ * @return
+ */
+static bool originate_direct(rb_dialing* dialing, struct ast_json* j_dial, E_DESTINATION_TYPE dial_type)
+{
+	int ret;
+
+	// must be set before the request. the channel events could come first.
+	rb_dialing_update_status(dialing, E_DIALING_ORIGINATE_REQUEST);
+	rb_dialing_update_originate_pending(dialing, true);
+
+	switch(dial_type) {
+		case DESTINATION_EXTEN: {
+			ret = originate_direct_to_exten(j_dial);
+		}
+		break;
+
+		case DESTINATION_APPLICATION: {
+			ret = originate_direct_to_application(j_dial);
+		}
+		break;
+
+		default: {
+			ret = false;
+		}
+		break;
+	}
+
+	if(ret == false) {
+		// the hangup of the failed channel has taken it already.
+		// the dialing is done. no fallback.
+		if(rb_dialing_take_originate_pending(dialing) == false) {
+			return true;
+		}
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Originate a call to the given dial list.
+ * @param j_camp	campaign info
+ * @param j_plan	plan info
+ * @param j_dlma	dial list master info
+ * @param j_dest	destination info
+ * @param j_dl_list	dial list info to dial
+ * @return
+ */
+static bool originate_predictive(struct ast_json* j_camp, struct ast_json* j_plan, struct ast_json* j_dlma, struct ast_json* j_dest, struct ast_json* j_dl_list)
+{
+	int ret;
+	struct ast_json* j_dial;
+	rb_dialing* dialing;
+	E_DESTINATION_TYPE dial_type;
+	E_PLAN_ORIGINATE_BACKEND backend;
+
 	// creating dialing info
 	j_dial = create_dial_info(j_plan, j_dl_list, j_dest);
 	if(j_dial == NULL) {
-		AST_JSON_UNREF(j_dl_list);
 		ast_log(LOG_DEBUG, "Could not create dialing info.");
-		return;
+		return false;
 	}
 	ast_log(LOG_NOTICE, "Originating. camp_uuid[%s], camp_name[%s], channel[%s], chan_id[%s], timeout[%"PRIdMAX"], dial_index[%"PRIdMAX"], dial_trycnt[%"PRIdMAX"], dial_type[%"PRIdMAX"]\n",
 			ast_json_string_get(ast_json_object_get(j_camp, "uuid")),
@@ -920,33 +1144,48 @@ static void dial_predictive(struct ast_json* j_camp, struct ast_json* j_plan, st
 			j_dl_list,
 			j_dial
 			);
-	AST_JSON_UNREF(j_dl_list);
 	if(dialing == NULL) {
 		ast_log(LOG_WARNING, "Could not create rbtree object.\n");
 		AST_JSON_UNREF(j_dial);
-		return;
+		return false;
 	}
 
 	// update dl list using dialing info
 	ret = update_dl_list_after_create_dialing_info(dialing);
 	if(ret == false) {
+		AST_JSON_UNREF(j_dial);
+		clear_dl_list_dialing(dialing->dl_list_uuid);
 		rb_dialing_destory(dialing);
-		clear_dl_list_dialing(ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")));
 		ast_log(LOG_ERROR, "Could not update dial list info.\n");
-		return;
+		return false;
 	}
 
 	// dial to customer
+	// counted in the originate window until the response.
+	rb_dialing_originate_submit(dialing);
 	dial_type = ast_json_integer_get(ast_json_object_get(j_dial, "dial_type"));
+	backend = ast_json_integer_get(ast_json_object_get(j_plan, "originate_backend"));
+	if(backend == E_PLAN_ORIGINATE_BACKEND_CORE) {
+		ret = originate_direct(dialing, j_dial, dial_type);
+		if(ret == true) {
+			AST_JSON_UNREF(j_dial);
+			return true;
+		}
+		ast_log(LOG_NOTICE, "Could not originate through the core. Falling back to the AMI. chan_id[%s]\n", dialing->uuid);
+	}
+
+	// must be set before the request. the async response or the hangup could come first.
+	rb_dialing_update_status(dialing, E_DIALING_ORIGINATE_REQUEST);
+
 	switch(dial_type) {
 		case DESTINATION_EXTEN: {
-			j_res = ami_cmd_originate_to_exten(j_dial);
+			ret = ami_cmd_originate_to_exten(j_dial);
 			AST_JSON_UNREF(j_dial);
 		}
 		break;
 
 		case DESTINATION_APPLICATION: {
-			j_res = ami_cmd_originate_to_application(j_dial);
+			ret = ami_cmd_originate_to_application(j_dial);
 			AST_JSON_UNREF(j_dial);
 		}
 		break;
@@ -954,29 +1193,22 @@ static void dial_predictive(struct ast_json* j_camp, struct ast_json* j_plan, st
 		default: {
 			AST_JSON_UNREF(j_dial);
 			ast_log(LOG_ERROR, "Unsupported dialing type.");
-			clear_dl_list_dialing(ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")));
+			clear_dl_list_dialing(dialing->dl_list_uuid);
 			rb_dialing_destory(dialing);
-			return;
+			return false;
 		}
 		break;
 	}
 
-	if(j_res == NULL) {
+	if(ret == false) {
 		ast_log(LOG_WARNING, "Originating has been failed.\n");
-		clear_dl_list_dialing(ast_json_string_get(ast_json_object_get(dialing->j_dialing, "dl_list_uuid")));
+		rb_dialing_originate_response(dialing, false);
+		clear_dl_list_dialing(dialing->dl_list_uuid);
 		rb_dialing_destory(dialing);
-		return;
+		return false;
 	}
 
-	tmp = ast_json_dump_string_format(j_res, 0);
-	ast_log(LOG_DEBUG, "Check value. tmp[%s]\n", tmp);
-	ast_json_free(tmp);
-	AST_JSON_UNREF(j_res);
-
-	// update dialing status
-	rb_dialing_update_status(dialing, E_DIALING_ORIGINATE_REQUEST);
-
-	return;
+	return true;
 }
 
 /**
@@ -1006,10 +1238,10 @@ static void dial_redirect(const struct ast_json* j_camp, const struct ast_json*
 /**
  * Return dialing availability.
  * todo: need something more here.. currently, just compare dial numbers..
- * If can dialing returns true, if not returns false.
+ * Returns the number of calls which can be made now.
  * @param j_camp
  * @param j_plan
- * @return 1:OK, 0:NO, -1:ERROR
+ * @return INT_MAX:Unlimited, 0:NO, -1:ERROR
  */
 static int check_dial_avaiable_predictive(
 		struct ast_json* j_camp,
@@ -1027,7 +1259,7 @@ static int check_dial_avaiable_predictive(
 	cnt_avail = get_destination_available_count(j_dest);
 	if(cnt_avail == DEF_DESTINATION_AVAIL_CNT_UNLIMITED) {
 		ast_log(LOG_DEBUG, "Available destination count is unlimited. cnt[%d]\n", cnt_avail);
-		return 1;
+		return INT_MAX;
 	}
 	ast_log(LOG_DEBUG, "Available destination count. cnt[%d]\n", cnt_avail);
 
@@ -1054,7 +1286,99 @@ static int check_dial_avaiable_predictive(
 		return 0;
 	}
 
-	return 1;
+	return ret;
+}
+
+/**
+ * Refill the given token bucket and return the available token count.
+ * The bucket holds at most one second worth of tokens.
+ * @param j_bucket	token bucket
+ * @param cps		calls per second. 0 is unlimited.
+ * @return
+ */
+static int refill_dial_bucket(struct ast_json* j_bucket, int cps)
+{
+	struct timespec tm_now;
+	double now;
+	double tokens;
+
+	if((j_bucket == NULL) || (cps <= 0)) {
+		return INT_MAX;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tm_now);
+	now = tm_now.tv_sec + ((double)tm_now.tv_nsec / 1000000000);
+
+	if(ast_json_object_get(j_bucket, "tm_refill") == NULL) {
+		// new bucket starts full.
+		tokens = cps;
+	}
+	else {
+		tokens = ast_json_real_get(ast_json_object_get(j_bucket, "tokens"));
+		tokens += (now - ast_json_real_get(ast_json_object_get(j_bucket, "tm_refill"))) * cps;
+		if(tokens > cps) {
+			tokens = cps;
+		}
+	}
+	ast_json_object_set(j_bucket, "tokens", ast_json_real_create(tokens));
+	ast_json_object_set(j_bucket, "tm_refill", ast_json_real_create(now));
+
+	return (int)tokens;
+}
+
+/**
+ * Return the number of calls which can be made now without exceeding
+ * the global and campaign cps limit.
+ * @param camp_uuid
+ * @return
+ */
+static int get_dial_bucket_avail(const char* camp_uuid)
+{
+	struct ast_json* j_bucket;
+	int cnt_global;
+	int cnt_camp;
+
+	if(camp_uuid == NULL) {
+		return 0;
+	}
+
+	cnt_global = refill_dial_bucket(g_j_dial_bucket_global, g_dial_cps_global);
+
+	j_bucket = ast_json_object_get(g_j_dial_buckets, camp_uuid);
+	if((j_bucket == NULL) && (g_dial_cps_campaign > 0)) {
+		j_bucket = ast_json_object_create();
+		ast_json_object_set(g_j_dial_buckets, camp_uuid, j_bucket);
+	}
+	cnt_camp = refill_dial_bucket(j_bucket, g_dial_cps_campaign);
+
+	return cnt_global < cnt_camp ? cnt_global : cnt_camp;
+}
+
+/**
+ * Consume tokens from the global and campaign cps buckets.
+ * @param camp_uuid
+ * @param cnt
+ */
+static void take_dial_bucket(const char* camp_uuid, int cnt)
+{
+	struct ast_json* j_bucket;
+	int i;
+	struct ast_json* j_buckets[2];
+
+	j_buckets[0] = g_dial_cps_global > 0 ? g_j_dial_bucket_global : NULL;
+	j_buckets[1] = g_dial_cps_campaign > 0 ? ast_json_object_get(g_j_dial_buckets, camp_uuid) : NULL;
+
+	for(i = 0; i < 2; i++) {
+		j_bucket = j_buckets[i];
+		if(j_bucket == NULL) {
+			continue;
+		}
+		ast_json_object_set(j_bucket, "tokens",
+				ast_json_real_create(ast_json_real_get(ast_json_object_get(j_bucket, "tokens")) - cnt)
+				);
+	}
+
+	return;
 }
 
 static bool write_result_json(struct ast_json* j_res)
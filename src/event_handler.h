@@ -8,7 +8,13 @@
 #ifndef SRC_EVENT_HANDLER_H_
 #define SRC_EVENT_HANDLER_H_
 
+struct event_base;
+extern struct event_base* g_base;
+
 int	 run_outbound(void);
 void	stop_outbound(void);
 
+void wakeup_outbound_dialing(void);
+void wakeup_outbound_campaign(void);
+
 #endif /* SRC_EVENT_HANDLER_H_ */
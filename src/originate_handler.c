@@ -0,0 +1,290 @@
+/*
+ * originate_handler.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: pchero
+ *
+ *  Originates the dialing through the core(ast_pbx_outgoing_exten/app).
+ *  No AMI action text is built and no response is parsed.
+ */
+
+#include "asterisk.h"
+#include "asterisk/utils.h"
+#include "asterisk/strings.h"
+#include "asterisk/json.h"
+#include "asterisk/pbx.h"
+#include "asterisk/callerid.h"
+#include "asterisk/format_cap.h"
+#include "asterisk/format_cache.h"
+
+#include <stdbool.h>
+
+#include "originate_handler.h"
+#include "utils.h"
+
+/**
+ * Core originate request.
+ * Built from the dial info.
+ */
+struct originate_req {
+	char* channel;		///< copy of the dial_channel. tech and addr point into it.
+	const char* tech;	 ///< channel tech. SIP, PJSIP, ...
+	const char* addr;	 ///< channel address. number@trunk, ...
+	char* callerid;	   ///< copy of the callerid. cid_name and cid_num point into it.
+	char* cid_name;
+	char* cid_num;
+	const char* account;
+	int timeout;		  ///< dial timeout(ms)
+	int early_media;
+	struct ast_format_cap* cap;
+	struct ast_variable* vars;
+	struct ast_assigned_ids ids;
+};
+
+static void originate_req_clear(struct originate_req* req);
+static bool originate_req_init(struct originate_req* req, struct ast_json* j_dial);
+static struct ast_variable* originate_create_variables(const char* variables);
+
+/**
+ * Create channel variable list from the json string of the variables.
+ * @param variables
+ * @return
+ */
+static struct ast_variable* originate_create_variables(const char* variables)
+{
+	struct ast_json* j_vars;
+	struct ast_json_iter* j_iter;
+	struct ast_variable* head;
+	struct ast_variable* var;
+
+	if((variables == NULL) || (strlen(variables) == 0)) {
+		return NULL;
+	}
+
+	j_vars = ast_json_load_string(variables, NULL);
+	if(j_vars == NULL) {
+		ast_log(LOG_WARNING, "Could not parse the variables. variables[%s]\n", variables);
+		return NULL;
+	}
+
+	head = NULL;
+	for(j_iter = ast_json_object_iter(j_vars);
+			j_iter != NULL;
+			j_iter = ast_json_object_iter_next(j_vars, j_iter))
+	{
+		var = ast_variable_new(
+				ast_json_object_iter_key(j_iter),
+				ast_json_string_get(ast_json_object_iter_value(j_iter)) ? : "",
+				""
+				);
+		if(var == NULL) {
+			continue;
+		}
+		var->next = head;
+		head = var;
+	}
+	AST_JSON_UNREF(j_vars);
+
+	return head;
+}
+
+/**
+ * Release the originate request's resources.
+ * @param req
+ */
+static void originate_req_clear(struct originate_req* req)
+{
+	if(req == NULL) {
+		return;
+	}
+
+	ast_free(req->channel);
+	ast_free(req->callerid);
+	ao2_cleanup(req->cap);
+	ast_variables_destroy(req->vars);
+
+	memset(req, 0x00, sizeof(*req));
+	return;
+}
+
+/**
+ * Build the originate request from the dial info.
+ * @param req
+ * @param j_dial
+ * @return
+ */
+static bool originate_req_init(struct originate_req* req, struct ast_json* j_dial)
+{
+	const char* tmp_const;
+	char* tmp;
+
+	memset(req, 0x00, sizeof(*req));
+
+	// channel. tech/addr
+	tmp_const = ast_json_string_get(ast_json_object_get(j_dial, "dial_channel"));
+	if(tmp_const == NULL) {
+		ast_log(LOG_WARNING, "Could not get dial channel.\n");
+		return false;
+	}
+	req->channel = ast_strdup(tmp_const);
+	tmp = strchr(req->channel, '/');
+	if((tmp == NULL) || (tmp == req->channel) || (*(tmp + 1) == '\0')) {
+		ast_log(LOG_WARNING, "Wrong dial channel. channel[%s]\n", tmp_const);
+		originate_req_clear(req);
+		return false;
+	}
+	*tmp = '\0';
+	req->tech = req->channel;
+	req->addr = tmp + 1;
+
+	// callerid
+	tmp_const = ast_json_string_get(ast_json_object_get(j_dial, "callerid"));
+	if((tmp_const != NULL) && (strlen(tmp_const) != 0)) {
+		req->callerid = ast_strdup(tmp_const);
+		ast_callerid_parse(req->callerid, &req->cid_name, &req->cid_num);
+		if(req->cid_num != NULL) {
+			ast_shrink_phone_number(req->cid_num);
+		}
+	}
+
+	// codecs
+	req->cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT);
+	if(req->cap == NULL) {
+		ast_log(LOG_ERROR, "Could not allocate format capabilities.\n");
+		originate_req_clear(req);
+		return false;
+	}
+	tmp_const = ast_json_string_get(ast_json_object_get(j_dial, "codecs"));
+	if((tmp_const != NULL) && (strlen(tmp_const) != 0)) {
+		ast_format_cap_update_by_allow_disallow(req->cap, tmp_const, 1);
+	}
+	else {
+		ast_format_cap_append(req->cap, ast_format_slin, 0);
+	}
+
+	req->account = ast_json_string_get(ast_json_object_get(j_dial, "account"));
+	req->timeout = ast_json_integer_get(ast_json_object_get(j_dial, "dial_timeout"));
+	req->early_media = ast_true(ast_json_string_get(ast_json_object_get(j_dial, "early_media")));
+	req->vars = originate_create_variables(ast_json_string_get(ast_json_object_get(j_dial, "variables")));
+
+	// the channel ids are given. the channel events are matched with these.
+	req->ids.uniqueid = ast_json_string_get(ast_json_object_get(j_dial, "channelid"));
+	req->ids.uniqueid2 = ast_json_string_get(ast_json_object_get(j_dial, "otherchannelid"));
+
+	return true;
+}
+
+/**
+ * Originate the dialing to the extension through the core.
+ * Async. Returns after the channel has been requested.
+ * No OriginateResponse event follows.
+ * @param j_dial
+ * @return
+ */
+bool originate_direct_to_exten(struct ast_json* j_dial)
+{
+	struct originate_req req;
+	const char* exten;
+	const char* context;
+	const char* priority;
+	int prio;
+	int reason;
+	int ret;
+
+	if(j_dial == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	exten = ast_json_string_get(ast_json_object_get(j_dial, "dial_exten"));
+	context = ast_json_string_get(ast_json_object_get(j_dial, "dial_context"));
+	priority = ast_json_string_get(ast_json_object_get(j_dial, "dial_priority"));
+	if((exten == NULL) || (context == NULL)) {
+		ast_log(LOG_WARNING, "Could not get dial extension.\n");
+		return false;
+	}
+
+	// priority. number or label.
+	if((priority == NULL) || (strlen(priority) == 0)) {
+		prio = 1;
+	}
+	else if(sscanf(priority, "%30d", &prio) != 1) {
+		prio = ast_findlabel_extension(NULL, context, exten, priority, NULL);
+	}
+	if(prio < 1) {
+		ast_log(LOG_WARNING, "Wrong dial priority. priority[%s]\n", priority);
+		return false;
+	}
+
+	ret = originate_req_init(&req, j_dial);
+	if(ret == false) {
+		return false;
+	}
+
+	ast_log(LOG_DEBUG, "Originating through the core. tech[%s], addr[%s], context[%s], exten[%s], priority[%d], chan_id[%s]\n",
+			req.tech, req.addr, context, exten, prio, req.ids.uniqueid ? : "");
+
+	reason = 0;
+	ret = ast_pbx_outgoing_exten(req.tech, req.cap, req.addr, req.timeout,
+			context, exten, prio, &reason, 0,
+			req.cid_num, req.cid_name, req.vars, req.account, NULL,
+			req.early_media, &req.ids
+			);
+	originate_req_clear(&req);
+	if(ret != 0) {
+		ast_log(LOG_WARNING, "Could not originate through the core. ret[%d], reason[%d]\n", ret, reason);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Originate the dialing to the application through the core.
+ * Async. Returns after the channel has been requested.
+ * No OriginateResponse event follows.
+ * @param j_dial
+ * @return
+ */
+bool originate_direct_to_application(struct ast_json* j_dial)
+{
+	struct originate_req req;
+	const char* application;
+	const char* data;
+	int reason;
+	int ret;
+
+	if(j_dial == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	application = ast_json_string_get(ast_json_object_get(j_dial, "dial_application"));
+	data = ast_json_string_get(ast_json_object_get(j_dial, "dial_data"));
+	if((application == NULL) || (strlen(application) == 0)) {
+		ast_log(LOG_WARNING, "Could not get dial application.\n");
+		return false;
+	}
+
+	ret = originate_req_init(&req, j_dial);
+	if(ret == false) {
+		return false;
+	}
+
+	ast_log(LOG_DEBUG, "Originating through the core. tech[%s], addr[%s], application[%s], data[%s], chan_id[%s]\n",
+			req.tech, req.addr, application, data ? : "", req.ids.uniqueid ? : "");
+
+	reason = 0;
+	ret = ast_pbx_outgoing_app(req.tech, req.cap, req.addr, req.timeout,
+			application, data, &reason, 0,
+			req.cid_num, req.cid_name, req.vars, req.account, NULL,
+			&req.ids
+			);
+	originate_req_clear(&req);
+	if(ret != 0) {
+		ast_log(LOG_WARNING, "Could not originate through the core. ret[%d], reason[%d]\n", ret, reason);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,18 @@
+/*
+ * originate_handler.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_ORIGINATE_HANDLER_H_
+#define SRC_ORIGINATE_HANDLER_H_
+
+#include "asterisk/json.h"
+
+#include <stdbool.h>
+
+bool originate_direct_to_exten(struct ast_json* j_dial);
+bool originate_direct_to_application(struct ast_json* j_dial);
+
+#endif /* SRC_ORIGINATE_HANDLER_H_ */
@@ -136,18 +136,18 @@ bool delete_plan(const char* uuid)
  */
 struct ast_json* get_plan(const char* uuid)
 {
-	char* sql;
 	struct ast_json* j_res;
+	struct ast_json* j_binds;
 	db_res_t* db_res;
 
 	if(uuid == NULL) {
 		ast_log(LOG_WARNING, "Invalid input parameters.\n");
 		return NULL;
 	}
-	ast_asprintf(&sql, "select * from plan where in_use=%d and uuid=\"%s\";", E_DL_USE_OK, uuid);
+	j_binds = ast_json_pack("[i, s]", E_DL_USE_OK, uuid);
 
-	db_res = db_query(sql);
-	ast_free(sql);
+	db_res = db_query_bind("select * from plan where in_use=? and uuid=?;", j_binds);
+	AST_JSON_UNREF(j_binds);
 	if(db_res == NULL) {
 		ast_log(LOG_ERROR, "Could not get plan info. uuid[%s]\n", uuid);
 		return NULL;
@@ -25,6 +25,14 @@ typedef enum _E_PLAN_DL_END_HANDLE {
 	E_PLAN_DL_END_STOP 			= 1,	/// Stop the campaign.
 } E_PLAN_DL_END_HANDLE;
 
+/**
+ * Originate backend of the plan.
+ */
+typedef enum _E_PLAN_ORIGINATE_BACKEND {
+	E_PLAN_ORIGINATE_BACKEND_AMI	= 0,	/// Originate action through the AMI.
+	E_PLAN_ORIGINATE_BACKEND_CORE	= 1,	/// Originate through the core. Falls back to the AMI on failure.
+} E_PLAN_ORIGINATE_BACKEND;
+
 
 bool init_plan(void);
 
@@ -21,8 +21,10 @@
 #include "ami_handler.h"
 #include "dialing_handler.h"
 #include "cli_handler.h"
+#include "campaign_handler.h"
 #include "utils.h"
 #include "application_handler.h"
+#include "destination_handler.h"
 
 
 #include <stdbool.h>
@@ -99,6 +101,7 @@ static int init_module(void)
 
 static void release_module(void)
 {
+	term_campaign();
 	db_exit();
 	AST_JSON_UNREF(g_app->j_conf);
 	ast_free(g_app);
@@ -109,6 +112,7 @@ static void release_module(void)
 static int unload_module(void)
 {
 	term_ami_handle();
+	term_destination_handler();
 	term_cli_handler();
 	term_application_handler();
 	stop_outbound();
@@ -162,6 +166,13 @@ static int load_module(void)
 		return AST_MODULE_LOAD_DECLINE;
 	}
 
+	ret = init_destination_handler();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate destination handler.\n");
+		unload_module();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	ret = init_cli_handler();
 	if(ret == false) {
 		ast_log(LOG_ERROR, "Could not initiate cli handler.\n");
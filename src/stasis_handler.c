@@ -0,0 +1,406 @@
+/*
+ * stasis_handler.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: pchero
+ *
+ *  Event source of the ami_evt_source=stasis.
+ *  Subscribes the channel/bridge/queue topics and gives the events of the dialings
+ *  to the ami event handlers. The channel and bridge messages are built from the
+ *  typed snapshots. No manager event text is formatted or parsed for them.
+ */
+
+#include "asterisk.h"
+#include "asterisk/utils.h"
+#include "asterisk/json.h"
+#include "asterisk/app.h"
+#include "asterisk/causes.h"
+#include "asterisk/channel.h"
+#include "asterisk/manager.h"
+#include "asterisk/stasis.h"
+#include "asterisk/stasis_message_router.h"
+#include "asterisk/stasis_channels.h"
+#include "asterisk/stasis_bridges.h"
+
+#include <stdbool.h>
+
+#include "stasis_handler.h"
+#include "ami_handler.h"
+#include "dialing_handler.h"
+#include "utils.h"
+
+static struct stasis_message_router* g_stasis_router_channel = NULL;	///< channel topic(cached)
+static struct stasis_message_router* g_stasis_router_bridge = NULL;		///< bridge topic
+static struct stasis_message_router* g_stasis_router_queue = NULL;		///< queue topic
+
+static struct ast_json* stasis_create_event(const char* event, struct ast_channel_snapshot* snapshot);
+static void stasis_set_str(struct ast_json* j_evt, const char* prefix, const char* name, const char* val);
+static void stasis_set_snapshot(struct ast_json* j_evt, const char* prefix, struct ast_channel_snapshot* snapshot);
+static void stasis_push_event(struct ast_json* j_evt);
+
+static void stasis_cb_channel_snapshot(void* data, struct stasis_subscription* sub, struct stasis_message* message);
+static void stasis_cb_channel_varset(void* data, struct stasis_subscription* sub, struct stasis_message* message);
+static void stasis_cb_channel_dial(void* data, struct stasis_subscription* sub, struct stasis_message* message);
+static void stasis_cb_bridge_enter(void* data, struct stasis_subscription* sub, struct stasis_message* message);
+static void stasis_cb_queue(void* data, struct stasis_subscription* sub, struct stasis_message* message);
+
+bool init_stasis_handler(void)
+{
+	int ret;
+
+	// channel. snapshot, varset, dial
+	g_stasis_router_channel = stasis_message_router_create(ast_channel_topic_all_cached());
+	if(g_stasis_router_channel == NULL) {
+		ast_log(LOG_ERROR, "Could not create channel message router.\n");
+		term_stasis_handler();
+		return false;
+	}
+	ret = stasis_message_router_add_cache_update(g_stasis_router_channel, ast_channel_snapshot_type(), stasis_cb_channel_snapshot, NULL);
+	ret |= stasis_message_router_add(g_stasis_router_channel, ast_channel_varset_type(), stasis_cb_channel_varset, NULL);
+	ret |= stasis_message_router_add(g_stasis_router_channel, ast_channel_dial_type(), stasis_cb_channel_dial, NULL);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not add channel message routes.\n");
+		term_stasis_handler();
+		return false;
+	}
+
+	// bridge
+	g_stasis_router_bridge = stasis_message_router_create(ast_bridge_topic_all());
+	if(g_stasis_router_bridge == NULL) {
+		ast_log(LOG_ERROR, "Could not create bridge message router.\n");
+		term_stasis_handler();
+		return false;
+	}
+	ret = stasis_message_router_add(g_stasis_router_bridge, ast_channel_entered_bridge_type(), stasis_cb_bridge_enter, NULL);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not add bridge message routes.\n");
+		term_stasis_handler();
+		return false;
+	}
+
+	// queue.
+	// the message types of the app_queue are not exported.
+	// so the queue/agent messages are taken with their manager representation.
+	g_stasis_router_queue = stasis_message_router_create(ast_queue_topic_all());
+	if(g_stasis_router_queue == NULL) {
+		ast_log(LOG_ERROR, "Could not create queue message router.\n");
+		term_stasis_handler();
+		return false;
+	}
+	ret = stasis_message_router_set_default(g_stasis_router_queue, stasis_cb_queue, NULL);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not set queue message route.\n");
+		term_stasis_handler();
+		return false;
+	}
+
+	ast_log(LOG_NOTICE, "Initiated stasis handler.\n");
+	return true;
+}
+
+void term_stasis_handler(void)
+{
+	if(g_stasis_router_channel != NULL) {
+		stasis_message_router_unsubscribe_and_join(g_stasis_router_channel);
+		g_stasis_router_channel = NULL;
+	}
+
+	if(g_stasis_router_bridge != NULL) {
+		stasis_message_router_unsubscribe_and_join(g_stasis_router_bridge);
+		g_stasis_router_bridge = NULL;
+	}
+
+	if(g_stasis_router_queue != NULL) {
+		stasis_message_router_unsubscribe_and_join(g_stasis_router_queue);
+		g_stasis_router_queue = NULL;
+	}
+
+	return;
+}
+
+/**
+ * Set the string value with the prefixed key.
+ * @param j_evt
+ * @param prefix
+ * @param name
+ * @param val
+ */
+static void stasis_set_str(struct ast_json* j_evt, const char* prefix, const char* name, const char* val)
+{
+	char key[64];
+
+	snprintf(key, sizeof(key), "%s%s", prefix, name);
+	ast_json_object_set(j_evt, key, ast_json_string_create(val ? : ""));
+
+	return;
+}
+
+/**
+ * Set the channel snapshot info to the event.
+ * Same keys with the manager event(lower case). Every value is a string.
+ * @param j_evt
+ * @param prefix "" or "dest"
+ * @param snapshot
+ */
+static void stasis_set_snapshot(struct ast_json* j_evt, const char* prefix, struct ast_channel_snapshot* snapshot)
+{
+	char tmp[32];
+
+	stasis_set_str(j_evt, prefix, "channel", snapshot->name);
+	stasis_set_str(j_evt, prefix, "uniqueid", snapshot->uniqueid);
+	stasis_set_str(j_evt, prefix, "linkedid", snapshot->linkedid);
+	snprintf(tmp, sizeof(tmp), "%d", snapshot->state);
+	stasis_set_str(j_evt, prefix, "channelstate", tmp);
+	stasis_set_str(j_evt, prefix, "channelstatedesc", ast_state2str(snapshot->state));
+	stasis_set_str(j_evt, prefix, "calleridnum", S_OR(snapshot->caller_number, "<unknown>"));
+	stasis_set_str(j_evt, prefix, "calleridname", S_OR(snapshot->caller_name, "<unknown>"));
+	stasis_set_str(j_evt, prefix, "connectedlinenum", S_OR(snapshot->connected_number, "<unknown>"));
+	stasis_set_str(j_evt, prefix, "connectedlinename", S_OR(snapshot->connected_name, "<unknown>"));
+	stasis_set_str(j_evt, prefix, "language", snapshot->language);
+	stasis_set_str(j_evt, prefix, "accountcode", snapshot->accountcode);
+	stasis_set_str(j_evt, prefix, "context", snapshot->context);
+	stasis_set_str(j_evt, prefix, "exten", snapshot->exten);
+	snprintf(tmp, sizeof(tmp), "%d", snapshot->priority);
+	stasis_set_str(j_evt, prefix, "priority", tmp);
+
+	return;
+}
+
+/**
+ * Create the event of the channel.
+ * @param event
+ * @param snapshot
+ * @return
+ */
+static struct ast_json* stasis_create_event(const char* event, struct ast_channel_snapshot* snapshot)
+{
+	struct ast_json* j_evt;
+
+	j_evt = ast_json_pack("{s:s}", "event", event);
+	if(j_evt == NULL) {
+		ast_log(LOG_WARNING, "Could not create event. event[%s]\n", event);
+		return NULL;
+	}
+
+	if(snapshot != NULL) {
+		stasis_set_snapshot(j_evt, "", snapshot);
+	}
+
+	return j_evt;
+}
+
+/**
+ * Push the event to the event worker and release it.
+ * @param j_evt
+ */
+static void stasis_push_event(struct ast_json* j_evt)
+{
+	if(j_evt == NULL) {
+		return;
+	}
+
+	ami_evt_push(j_evt);
+	AST_JSON_UNREF(j_evt);
+
+	return;
+}
+
+/**
+ * Channel snapshot update.
+ * Newchannel, Newstate, Newexten, Hangup.
+ */
+static void stasis_cb_channel_snapshot(void* data, struct stasis_subscription* sub, struct stasis_message* message)
+{
+	struct stasis_cache_update* update;
+	struct ast_channel_snapshot* old_snapshot;
+	struct ast_channel_snapshot* new_snapshot;
+	struct ast_json* j_evt;
+	char tmp[32];
+
+	update = stasis_message_data(message);
+	if(update->new_snapshot == NULL) {
+		// cache clear. hangup has been given already.
+		return;
+	}
+	new_snapshot = stasis_message_data(update->new_snapshot);
+	old_snapshot = (update->old_snapshot != NULL) ? stasis_message_data(update->old_snapshot) : NULL;
+
+	// not ours
+	if(rb_dialing_is_exist_uuid(new_snapshot->uniqueid) == false) {
+		return;
+	}
+
+	// Newchannel
+	if(old_snapshot == NULL) {
+		stasis_push_event(stasis_create_event("Newchannel", new_snapshot));
+		return;
+	}
+
+	// Hangup
+	if(ast_test_flag(&new_snapshot->flags, AST_FLAG_DEAD)) {
+		if(ast_test_flag(&old_snapshot->flags, AST_FLAG_DEAD)) {
+			return;
+		}
+		j_evt = stasis_create_event("Hangup", new_snapshot);
+		if(j_evt == NULL) {
+			return;
+		}
+		snprintf(tmp, sizeof(tmp), "%d", new_snapshot->hangupcause);
+		ast_json_object_set(j_evt, "cause", ast_json_string_create(tmp));
+		ast_json_object_set(j_evt, "cause-txt", ast_json_string_create(ast_cause2str(new_snapshot->hangupcause) ? : ""));
+		stasis_push_event(j_evt);
+		return;
+	}
+
+	// Newstate
+	if(old_snapshot->state != new_snapshot->state) {
+		stasis_push_event(stasis_create_event("Newstate", new_snapshot));
+	}
+
+	// Newexten
+	if((ast_strlen_zero(new_snapshot->appl) == 0)
+			&& ((old_snapshot->priority != new_snapshot->priority)
+					|| (strcmp(old_snapshot->context, new_snapshot->context) != 0)
+					|| (strcmp(old_snapshot->exten, new_snapshot->exten) != 0)
+					)
+			)
+	{
+		j_evt = stasis_create_event("Newexten", new_snapshot);
+		if(j_evt == NULL) {
+			return;
+		}
+		ast_json_object_set(j_evt, "extension", ast_json_string_create(new_snapshot->exten ? : ""));
+		ast_json_object_set(j_evt, "application", ast_json_string_create(new_snapshot->appl ? : ""));
+		ast_json_object_set(j_evt, "appdata", ast_json_string_create(new_snapshot->data ? : ""));
+		stasis_push_event(j_evt);
+	}
+
+	return;
+}
+
+/**
+ * Channel variable set.
+ * VarSet
+ */
+static void stasis_cb_channel_varset(void* data, struct stasis_subscription* sub, struct stasis_message* message)
+{
+	struct ast_channel_blob* blob;
+	struct ast_json* j_evt;
+
+	blob = stasis_message_data(message);
+	if((blob->snapshot == NULL) || (rb_dialing_is_exist_uuid(blob->snapshot->uniqueid) == false)) {
+		return;
+	}
+
+	j_evt = stasis_create_event("VarSet", blob->snapshot);
+	if(j_evt == NULL) {
+		return;
+	}
+	ast_json_object_set(j_evt, "variable", ast_json_string_create(ast_json_string_get(ast_json_object_get(blob->blob, "variable")) ? : ""));
+	ast_json_object_set(j_evt, "value", ast_json_string_create(ast_json_string_get(ast_json_object_get(blob->blob, "value")) ? : ""));
+	stasis_push_event(j_evt);
+
+	return;
+}
+
+/**
+ * Dial.
+ * DialBegin, DialEnd.
+ * The caller is unprefixed and the peer is "dest" prefixed. Same with the manager event.
+ */
+static void stasis_cb_channel_dial(void* data, struct stasis_subscription* sub, struct stasis_message* message)
+{
+	struct ast_multi_channel_blob* blob;
+	struct ast_channel_snapshot* caller;
+	struct ast_channel_snapshot* peer;
+	struct ast_json* j_blob;
+	struct ast_json* j_evt;
+	const char* dialstatus;
+
+	blob = stasis_message_data(message);
+	caller = ast_multi_channel_blob_get_channel(blob, "caller");
+	peer = ast_multi_channel_blob_get_channel(blob, "peer");
+	if(peer == NULL) {
+		return;
+	}
+
+	// not ours. the handlers find the dialing by the caller's uniqueid(same as the AMI DialBegin/DialEnd).
+	if((caller == NULL) || (rb_dialing_is_exist_uuid(caller->uniqueid) == false)) {
+		return;
+	}
+
+	j_blob = ast_multi_channel_blob_get_json(blob);
+	dialstatus = ast_json_string_get(ast_json_object_get(j_blob, "dialstatus"));
+
+	j_evt = stasis_create_event(ast_strlen_zero(dialstatus) ? "DialBegin" : "DialEnd", caller);
+	if(j_evt == NULL) {
+		return;
+	}
+	stasis_set_snapshot(j_evt, "dest", peer);
+	if(ast_strlen_zero(dialstatus) == 0) {
+		ast_json_object_set(j_evt, "dialstatus", ast_json_string_create(dialstatus));
+	}
+	else {
+		ast_json_object_set(j_evt, "dialstring", ast_json_string_create(ast_json_string_get(ast_json_object_get(j_blob, "dialstring")) ? : ""));
+	}
+	stasis_push_event(j_evt);
+
+	return;
+}
+
+/**
+ * Channel entered bridge.
+ * BridgeEnter
+ */
+static void stasis_cb_bridge_enter(void* data, struct stasis_subscription* sub, struct stasis_message* message)
+{
+	struct ast_bridge_blob* blob;
+	struct ast_json* j_evt;
+	char tmp[32];
+
+	blob = stasis_message_data(message);
+	if((blob->channel == NULL) || (rb_dialing_is_exist_uuid(blob->channel->uniqueid) == false)) {
+		return;
+	}
+
+	j_evt = stasis_create_event("BridgeEnter", blob->channel);
+	if(j_evt == NULL) {
+		return;
+	}
+	if(blob->bridge != NULL) {
+		ast_json_object_set(j_evt, "bridgeuniqueid", ast_json_string_create(blob->bridge->uniqueid ? : ""));
+		snprintf(tmp, sizeof(tmp), "%u", blob->bridge->num_channels);
+		ast_json_object_set(j_evt, "bridgenumchannels", ast_json_string_create(tmp));
+	}
+	stasis_push_event(j_evt);
+
+	return;
+}
+
+/**
+ * Queue/Agent messages.
+ * Converted to the manager event text. The event worker checks the uniqueid.
+ */
+static void stasis_cb_queue(void* data, struct stasis_subscription* sub, struct stasis_message* message)
+{
+	struct ast_manager_event_blob* ami_blob;
+	struct ast_str* content;
+
+	ami_blob = stasis_message_to_ami(message);
+	if(ami_blob == NULL) {
+		return;
+	}
+
+	content = ast_str_create(1024);
+	if(content == NULL) {
+		ao2_ref(ami_blob, -1);
+		return;
+	}
+	ast_str_set(&content, 0, "Event: %s\r\n%s", ami_blob->manager_event, ami_blob->extra_fields ? : "");
+	ao2_ref(ami_blob, -1);
+
+	ami_evt_push_content(ast_str_buffer(content));
+	ast_free(content);
+
+	return;
+}
@@ -0,0 +1,16 @@
+/*
+ * stasis_handler.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_STASIS_HANDLER_H_
+#define SRC_STASIS_HANDLER_H_
+
+#include <stdbool.h>
+
+bool init_stasis_handler(void);
+void term_stasis_handler(void);
+
+#endif /* SRC_STASIS_HANDLER_H_ */
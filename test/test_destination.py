@@ -6,8 +6,15 @@ import common
 
 import os
 import sys
+import time
 import uuid
 
+# queue for the queue destination tests. must be in the queues.conf with no static members.
+QUEUE_NAME = "sales_1"
+
+# queue_cache_max_age of the res_outbound.conf.
+QUEUE_CACHE_MAX_AGE = 60
+
 
 def get_destination_by_name(name):
     '''
@@ -97,6 +104,78 @@ def verify_destination(obj, **args):
     return ret
 
 
+def create_queue_destination():
+    '''
+    Create the queue destination and return the uuid.
+    '''
+    ast = common.acli()
+    ast.conn()
+
+    name = uuid.uuid4().__str__()
+    res = ast.sendCmd("OutDestinationCreate", Name=name, Type="1", Application="queue", Data=QUEUE_NAME)
+    res_dict = common.make_dict(res)
+    if res_dict["Response"] != "Success":
+        return None
+
+    res = get_destination_by_name(name)
+    if res == None:
+        return None
+    res_dict = common.make_dict(res)
+
+    return res_dict["Uuid"]
+
+
+def get_destination_available_count(uuid_str):
+    '''
+    Get the available count of the destination.
+    '''
+    res = get_destination(uuid_str)
+    if res == None:
+        return None
+
+    res_dict = common.make_dict(res)
+    if "AvailableCount" not in res_dict:
+        return None
+
+    return int(res_dict["AvailableCount"])
+
+
+def add_queue_members(ast, names):
+    '''
+    Add the queue members. The member's state is given by the Custom device state.
+    '''
+    for name in names:
+        set_queue_member_state(ast, name, "NOT_INUSE")
+        res = ast.sendCmd("QueueAdd", Queue=QUEUE_NAME, Interface="Local/%s@default" % name, StateInterface="Custom:%s" % name, Paused="false")
+        res_dict = common.make_dict(res)
+        if res_dict["Response"] != "Success":
+            return False
+
+    # wait for the member events
+    time.sleep(1)
+    return True
+
+
+def remove_queue_members(ast, names):
+    '''
+    Remove the queue members.
+    '''
+    for name in names:
+        ast.sendCmd("QueueRemove", Queue=QUEUE_NAME, Interface="Local/%s@default" % name)
+
+    # wait for the member events
+    time.sleep(1)
+    return
+
+
+def set_queue_member_state(ast, name, state):
+    '''
+    Set the device state of the queue member.
+    '''
+    ast.sendCmd("Setvar", Variable="DEVICE_STATE(Custom:%s)" % name, Value=state)
+    return
+
+
 def test_destination_create_no_arg():
     '''
     test destination create with no options
@@ -201,10 +280,148 @@ def test_destination_update_name():
     print("Finished test_destination_update_name")
     return
 
+def test_destination_queue_cache_seed():
+    '''
+    test queue destination available count seeded by the QueueStatus
+    '''
+    ast = common.acli()
+    ast.conn()
+
+    members = [uuid.uuid4().__str__(), uuid.uuid4().__str__()]
+    if add_queue_members(ast, members) != True:
+        raise Exception("Failed test_destination_queue_cache_seed")
+
+    uuid_str = create_queue_destination()
+    if uuid_str == None:
+        remove_queue_members(ast, members)
+        raise Exception("Failed test_destination_queue_cache_seed")
+
+    # the first get seeds the queue cache
+    cnt = get_destination_available_count(uuid_str)
+
+    delete_destination(uuid_str)
+    remove_queue_members(ast, members)
+    if cnt != 2:
+        raise Exception("Failed test_destination_queue_cache_seed. cnt[%s]" % cnt)
+
+    print("Finished test_destination_queue_cache_seed")
+    return
+
+
+def test_destination_queue_cache_member_status():
+    '''
+    test queue destination available count updated by the QueueMemberStatus
+    '''
+    ast = common.acli()
+    ast.conn()
+
+    members = [uuid.uuid4().__str__(), uuid.uuid4().__str__()]
+    if add_queue_members(ast, members) != True:
+        raise Exception("Failed test_destination_queue_cache_member_status")
+
+    uuid_str = create_queue_destination()
+    if uuid_str == None:
+        remove_queue_members(ast, members)
+        raise Exception("Failed test_destination_queue_cache_member_status")
+
+    # seed
+    cnt_seed = get_destination_available_count(uuid_str)
+
+    # member in use
+    set_queue_member_state(ast, members[0], "INUSE")
+    time.sleep(1)
+    cnt_inuse = get_destination_available_count(uuid_str)
+
+    # member not in use again
+    set_queue_member_state(ast, members[0], "NOT_INUSE")
+    time.sleep(1)
+    cnt_notinuse = get_destination_available_count(uuid_str)
+
+    delete_destination(uuid_str)
+    remove_queue_members(ast, members)
+    if cnt_seed != 2 or cnt_inuse != 1 or cnt_notinuse != 2:
+        raise Exception("Failed test_destination_queue_cache_member_status. cnt_seed[%s], cnt_inuse[%s], cnt_notinuse[%s]" % (cnt_seed, cnt_inuse, cnt_notinuse))
+
+    print("Finished test_destination_queue_cache_member_status")
+    return
+
+
+def test_destination_queue_cache_member_removed():
+    '''
+    test queue destination available count updated by the QueueMemberRemoved
+    '''
+    ast = common.acli()
+    ast.conn()
+
+    members = [uuid.uuid4().__str__(), uuid.uuid4().__str__()]
+    if add_queue_members(ast, members) != True:
+        raise Exception("Failed test_destination_queue_cache_member_removed")
+
+    uuid_str = create_queue_destination()
+    if uuid_str == None:
+        remove_queue_members(ast, members)
+        raise Exception("Failed test_destination_queue_cache_member_removed")
+
+    # seed
+    cnt_seed = get_destination_available_count(uuid_str)
+
+    # remove one
+    remove_queue_members(ast, members[1:])
+    cnt_removed = get_destination_available_count(uuid_str)
+
+    delete_destination(uuid_str)
+    remove_queue_members(ast, members[:1])
+    if cnt_seed != 2 or cnt_removed != 1:
+        raise Exception("Failed test_destination_queue_cache_member_removed. cnt_seed[%s], cnt_removed[%s]" % (cnt_seed, cnt_removed))
+
+    print("Finished test_destination_queue_cache_member_removed")
+    return
+
+
+def test_destination_queue_cache_max_age():
+    '''
+    test queue destination available count after the queue_cache_max_age.
+    The queue is seeded again and keeps the updated members.
+    '''
+    ast = common.acli()
+    ast.conn()
+
+    members = [uuid.uuid4().__str__(), uuid.uuid4().__str__()]
+    if add_queue_members(ast, members) != True:
+        raise Exception("Failed test_destination_queue_cache_max_age")
+
+    uuid_str = create_queue_destination()
+    if uuid_str == None:
+        remove_queue_members(ast, members)
+        raise Exception("Failed test_destination_queue_cache_max_age")
+
+    # seed and update
+    cnt_seed = get_destination_available_count(uuid_str)
+    set_queue_member_state(ast, members[0], "INUSE")
+    time.sleep(1)
+    cnt_inuse = get_destination_available_count(uuid_str)
+
+    # expire and seed again
+    time.sleep(QUEUE_CACHE_MAX_AGE + 1)
+    cnt_expired = get_destination_available_count(uuid_str)
+
+    delete_destination(uuid_str)
+    remove_queue_members(ast, members)
+    if cnt_seed != 2 or cnt_inuse != 1 or cnt_expired != 1:
+        raise Exception("Failed test_destination_queue_cache_max_age. cnt_seed[%s], cnt_inuse[%s], cnt_expired[%s]" % (cnt_seed, cnt_inuse, cnt_expired))
+
+    print("Finished test_destination_queue_cache_max_age")
+    return
+
+
 def main():
     test_destination_create_no_arg()
     test_destination_create_name()
     test_destination_update_name()
+    test_destination_queue_cache_seed()
+    test_destination_queue_cache_member_status()
+    test_destination_queue_cache_member_removed()
+    test_destination_queue_cache_max_age()
     
     print("Finished destination test")
     return